@@ -180,6 +180,22 @@ ach_status_t Channel::put(const void* buf,
     return r;
 }
 
+ach_status_t Channel::put(const struct iovec *iov,
+                          int iovcnt,
+                          int allow_mask,
+                          int warn_mask) {
+
+    ach_status_t r = ach_putv(&channel, iov, iovcnt);
+
+    switch(check_status(r, allow_mask, warn_mask)) {
+    case STATUS_WARN: warn_put(r);  break;
+    case STATUS_ERR:  error_put(r); break;
+    case STATUS_OK: break;
+    }
+
+    return r;
+}
+
 void Channel::warn_open( ach_status_t r ) {}
 void Channel::error_open( ach_status_t r ) {}
 
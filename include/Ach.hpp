@@ -39,6 +39,7 @@
 #ifndef _ACH_HPP_
 #define _ACH_HPP_
 
+#include <sys/uio.h>
 #include <ach.h>
 #include <vector>
 
@@ -63,6 +64,7 @@ enum ach_mask_t {
     ACH_MASK_CORRUPT        = ACH_MASK_FROM_STATUS(ACH_CORRUPT),
     ACH_MASK_BAD_HEADER     = ACH_MASK_FROM_STATUS(ACH_BAD_HEADER),
     ACH_MASK_EACCES         = ACH_MASK_FROM_STATUS(ACH_EACCES),
+    ACH_MASK_OVERWRITTEN    = ACH_MASK_FROM_STATUS(ACH_OVERWRITTEN),
 
     ACH_MASK_NONE           = 0,
     ACH_MASK_ALL            = 0xffffffff
@@ -112,6 +114,12 @@ public:
                      int allow_mask=ACH_MASK_OK,
                      int warn_mask=ACH_MASK_NONE);
 
+    /** Put frame gathered from several buffers to channel. */
+    ach_status_t put(const struct iovec *iov,
+                     int iovcnt,
+                     int allow_mask=ACH_MASK_OK,
+                     int warn_mask=ACH_MASK_NONE);
+
     /** Get frame from channel into an STL vector.
      *
      * This function will resize vec if it is too small.  Note that
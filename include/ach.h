@@ -186,15 +186,46 @@ extern "C" {
 /** prefix to apply to channel names to get the shared memory file name */
 #define ACH_CHAN_NAME_PREFIX "/achshm-"
 
+/** where shm_open() keeps its files, for renaming a resized channel
+ * into place */
+#ifndef ACH_SHM_DIR
+#define ACH_SHM_DIR "/dev/shm"
+#endif
+
+/** hugetlbfs mount holding channels created with ACH_HUGE_TLB */
+#ifndef ACH_HUGETLBFS_DIR
+#define ACH_HUGETLBFS_DIR "/dev/hugepages"
+#endif
+
 /** Number of times to retry a syscall on EINTR before giving up */
 #define ACH_INTR_RETRY 8
 
+/** Nanoseconds ACH_WAIT_SPIN polls before sleeping, when
+ * ach_attr_t.spin_ns is 0 */
+#ifndef ACH_DEFAULT_SPIN_NS
+#define ACH_DEFAULT_SPIN_NS 50000
+#endif
+
+/** Frame size in bytes from which puts and gets copy with
+ * non-temporal stores, when ach_attr_t.stream_min is 0.  Sweep
+ * frame sizes with achbench -Z to tune it for a machine. */
+#ifndef ACH_DEFAULT_STREAM_MIN
+#define ACH_DEFAULT_STREAM_MIN (1024*1024)
+#endif
+
     /** magic number that appears the the beginning of our mmaped files.
 
         This is just to be used as a check.
     */
 #define ACH_SHM_MAGIC_NUM 0xb07511f3
 
+    /** magic number of channels with the cache-line-aware layout
+        (ACH_LAYOUT_2), see ach_header_hot_t.
+
+        Older libraries reject these files instead of misreading them.
+    */
+#define ACH_SHM_MAGIC_NUM_V2 0xb07511f4
+
 
     /** A separator between different shm sections.
 
@@ -229,13 +260,14 @@ extern "C" {
         ACH_TIMEOUT = 7,        /**< timeout before frame received */
         ACH_EEXIST = 8,         /**< channel file already exists */
         ACH_ENOENT = 9,         /**< channel file doesn't exist */
-        ACH_CLOSED = 10,        /**< unused */
+        ACH_CLOSED = 10,        /**< the other end of a socket closed */
         ACH_BUG = 11,           /**< internal ach error */
         ACH_EINVAL = 12,        /**< invalid channel */
         ACH_CORRUPT = 13,       /**< channel memory has been corrupted */
         ACH_BAD_HEADER = 14,    /**< an invalid header was given */
         ACH_EACCES = 15,        /**< permission denied */
-        ACH_CANCELED = 16       /**< operation canceled */
+        ACH_CANCELED = 16,      /**< operation canceled */
+        ACH_OVERWRITTEN = 17    /**< frame was overwritten while in use */
     } ach_status_t;
 
 
@@ -263,10 +295,59 @@ extern "C" {
         ACH_O_COPY = 0x04
     } ach_get_opts_t;
 
+    /** Flags stored in ach_header_t describing how a channel was
+     * created. */
+    enum ach_header_flags {
+        /** Waiting readers block on ach_header_t.futex rather than
+         *  the condition variable. */
+        ACH_HEADER_FUTEX = 0x01,
+        /** The shm block ends with an ach_pollfd_registry_t. */
+        ACH_HEADER_POLLFD = 0x02,
+        /** The shm block ends with an ach_stats_t. */
+        ACH_HEADER_STATS = 0x04,
+        /** Mappings ask for transparent huge pages. */
+        ACH_HEADER_THP = 0x08,
+        /** The file is on hugetlbfs, under ACH_HUGETLBFS_DIR. */
+        ACH_HEADER_HUGETLB = 0x10,
+        /** ach_open() prefaults the whole mapping. */
+        ACH_HEADER_POPULATE = 0x20,
+        /** ach_open() locks the mapping in memory, if permitted. */
+        ACH_HEADER_MLOCK = 0x40,
+        /** Every frame has its own slot of slot_size bytes; frame i
+         *  of the index is at offset i * slot_size. */
+        ACH_HEADER_FIXED = 0x80,
+        /** Index entries are ach_index_time_t, stamped when each
+         *  frame is put.  Layout 2 only. */
+        ACH_HEADER_TIMES = 0x100,
+        /** ach_resize() replaced this channel with a new one of the
+         *  same name.  Handles follow on their next get or put. */
+        ACH_HEADER_RESIZED = 0x200,
+        /** A table of the channel's readers follows the statistics,
+         *  see ach_reader_t */
+        ACH_HEADER_READERS = 0x400,
+        /** Puts reserve a slot atomically and copy without the lock,
+         *  committing in sequence order (ach_create_attr_t.multi_put) */
+        ACH_HEADER_MULTI_PUT = 0x800,
+        /** One process puts, publishing frames without the lock
+         *  (ach_create_attr_t.single_writer) */
+        ACH_HEADER_SINGLE_WRITER = 0x1000,
+        /** The data array starts on a page at data_offset and is
+         *  mapped a second time right after itself, so frames that
+         *  wrap around are contiguous (ach_create_attr_t.mirror) */
+        ACH_HEADER_MIRROR = 0x2000,
+        /** Puts time how long they hold the write lock, in
+         *  ach_stats_t.lock_ns and lock_max_ns
+         *  (ach_create_attr_t.lock_times) */
+        ACH_HEADER_LOCK_TIMES = 0x4000
+    };
+
     /** Header for shared memory area.
      *
      * There is no tail pointer here.  Every subscriber that opens the
      * channel must maintain its own tail pointer.
+     *
+     * In layout 2, the cursors, last_seq and the futex words are kept
+     * in ach_header_hot_t instead; see ACH_SHM_HOT().
      */
     typedef struct {
         uint32_t magic;          /**< magic number of ach shm files */
@@ -281,6 +362,14 @@ extern "C" {
                 size_t index_head;       /**< index into index array of first unused index entry */
                 size_t index_free;       /**< number of unused index entries */
                 int anon;                /**< is channel in the heap? */
+                uint32_t flags;          /**< bitwise OR of ach_header_flags */
+                clockid_t clock;         /**< clock for timed waits */
+                uint32_t futex;          /**< incremented on every put and cancel (ACH_HEADER_FUTEX) */
+                uint32_t futex_waiters;  /**< readers waiting on futex (ACH_HEADER_FUTEX) */
+                uint32_t cond_waiters;   /**< readers waiting on the condition variable */
+                size_t slot_size;        /**< bytes per slot (ACH_HEADER_FIXED) */
+                uint64_t generation;     /**< number of times the channel was resized */
+                size_t data_offset;      /**< offset of the data array (ACH_HEADER_MIRROR) */
             };
             uint64_t reserved[16];  /**< Reserve to compatibly add future variables */
         };
@@ -293,6 +382,130 @@ extern "C" {
         uint64_t last_seq;        /**< last sequence number written */
     } ach_header_t;
 
+    /** Most descriptors that may be registered with ach_pollfd_open()
+     *  on one channel */
+#define ACH_POLLFD_MAX 32
+
+    /** Registry of subscribers' pollable descriptors, stored after the
+     * data guard of channels created with ach_create_attr_t.pollfd.
+     *
+     * Each slot names an abstract unix socket by the pid and
+     * descriptor of its owner, or is 0 when free.
+     */
+    typedef struct {
+        uint32_t cnt;                  /**< number of slots in use */
+        uint32_t reserved;
+        uint64_t slot[ACH_POLLFD_MAX]; /**< owner's pid << 32 | socket descriptor */
+    } ach_pollfd_registry_t;
+
+    /** Counters kept in the shm block of channels with
+     * ACH_HEADER_STATS.
+     *
+     * Values are totals since the channel was created.  Sample twice
+     * and take differences to get rates.  Publishers only write the
+     * first cache line, with plain stores.  Subscribers only write
+     * the second, and only the first one to get each frame does, so
+     * gets don't bounce a line between them.  What each subscriber
+     * got and missed is kept in its own ach_reader_t instead.
+     */
+    typedef struct {
+        /* written by publishers, holding the write lock */
+        uint64_t put_cnt;        /**< frames put */
+        uint64_t put_bytes;      /**< bytes put */
+        uint64_t overwritten;    /**< frames evicted before any get returned them */
+        uint64_t lock_ns;        /**< total time the write lock was held
+                                  *   (ACH_HEADER_LOCK_TIMES) */
+        uint64_t lock_max_ns;    /**< longest time the write lock was held
+                                  *   (ACH_HEADER_LOCK_TIMES) */
+        uint64_t lock_start_ns;  /**< when the write lock was last taken
+                                  *   (ACH_HEADER_LOCK_TIMES) */
+        uint64_t last_put_ns;    /**< when the last frame was put, on
+                                  *   ACH_STATS_PUT_CLOCK */
+        uint64_t reserved_put;
+
+        /* written by subscribers */
+        uint64_t read_seq;       /**< newest seq_num any get returned */
+        uint64_t waiters;        /**< subscribers waiting on the condition variable */
+        uint64_t reserved_get[6];
+    } ach_stats_t;
+
+    /** Process id in an owner word of ach_reader_t or
+     * ach_header_hot_t.
+     *
+     * Owner words keep the process id in the low 32 bits and the low
+     * 32 bits of the process's start time, in clock ticks since boot,
+     * in the high ones (0 where that is unknown), so that a process
+     * that reuses the pid of one that died is not mistaken for it.
+     * See ach_owner_dead().
+     */
+#define ACH_OWNER_PID(owner) ((pid_t)((owner) & 0xffffffffu))
+
+    /** Most handles that may hold a slot in a channel's reader table */
+#define ACH_READERS_MAX 64
+
+    /** Slot in the reader table of channels created with
+     * ach_create_attr_t.readers.
+     *
+     * ach_open() claims a free slot, or one whose owner died without
+     * closing, and ach_close() frees it.  Gets and ach_flush() publish
+     * the handle's place in the sequence, so tools can see how far
+     * behind each subscriber is.  Each slot has its own cache line and
+     * only its owner writes it.
+     */
+    typedef struct {
+        uint64_t owner;      /**< process holding the slot as in
+                              *   ACH_OWNER_PID(), or 0 when free */
+        uint64_t seq_num;    /**< newest frame this handle got */
+        uint64_t got;        /**< frames this handle got */
+        uint64_t missed;     /**< frames this handle skipped over */
+        uint64_t bytes;      /**< bytes this handle got */
+        uint64_t reserved[3];
+    } ach_reader_t;
+
+    /** Clock for the lock times in ach_stats_t, in nanoseconds */
+#define ACH_STATS_CLOCK CLOCK_MONOTONIC
+
+    /** Clock for ach_stats_t.last_put_ns.  Every put reads it, so
+     * where there is a cheaper, coarser clock, use that. */
+#ifdef CLOCK_MONOTONIC_COARSE
+#define ACH_STATS_PUT_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define ACH_STATS_PUT_CLOCK CLOCK_MONOTONIC
+#endif
+
+    /** Fields that layout 2 moves out of ach_header_t.
+     *
+     * In the original layout, subscribers polling last_seq share a
+     * cache line with the condition variable and dirty flag, and the
+     * publisher's cursors share lines with index_cnt, data_size and
+     * flags, which every get reads.  Layout 2 keeps these fields
+     * after the header guard instead, on one cache line for what
+     * subscribers poll and another for what only the publisher
+     * touches.  The fields of the same name in ach_header_t are then
+     * unused.  Use ACH_SHM_HOT() to access them in either layout.
+     */
+    typedef struct {
+        /* written by the publisher, polled by subscribers */
+        uint64_t last_seq;       /**< last sequence number written */
+        size_t index_head;       /**< index into index array of first unused index entry */
+        size_t index_free;       /**< number of unused index entries */
+        uint32_t futex;          /**< as in ach_header_t */
+        uint32_t futex_waiters;  /**< as in ach_header_t */
+        uint32_t cond_waiters;   /**< as in ach_header_t */
+        uint8_t pad_polled[64 - sizeof(uint64_t) - 2*sizeof(size_t) - 3*sizeof(uint32_t)];
+
+        /* only touched by publishers */
+        size_t data_head;        /**< offset to first open byte of data */
+        size_t data_free;        /**< number of free data bytes */
+        uint64_t reserve_seq;    /**< last sequence number a put reserved
+                                  *   (ACH_HEADER_MULTI_PUT and
+                                  *   ACH_HEADER_SINGLE_WRITER) */
+        uint64_t writer_owner;   /**< process allowed to put as in
+                                  *   ACH_OWNER_PID(), 0 if none yet
+                                  *   (ACH_HEADER_SINGLE_WRITER) */
+        uint8_t pad_writer[64 - 2*sizeof(size_t) - 2*sizeof(uint64_t)];
+    } ach_header_hot_t;
+
     /** Entry in shared memory index array
      */
     typedef struct {
@@ -301,6 +514,42 @@ extern "C" {
         uint64_t seq_num; /**< number of frame */
     } ach_index_t ;
 
+    /** Index entry of channels with ACH_HEADER_TIMES.
+     *
+     * The times fill part of the cache line that layout 2 already
+     * gives every entry, so they cost no extra space.  Both are taken
+     * with the write lock held, so mono_ns never decreases from one
+     * frame to the next.
+     */
+    typedef struct {
+        ach_index_t index;  /**< the usual entry */
+        uint64_t mono_ns;   /**< CLOCK_MONOTONIC when the frame was put */
+        uint64_t real_ns;   /**< CLOCK_REALTIME when the frame was put */
+    } ach_index_time_t;
+
+    /** Who reserved an index entry of an ACH_HEADER_MULTI_PUT channel.
+     *
+     * It follows the times in the cache line layout 2 gives every
+     * entry.  A put waiting on the ones ahead of it checks here
+     * whether the put it waits on died before publishing.
+     */
+    typedef struct {
+        uint64_t seq_num;   /**< frame the entry was reserved for */
+        uint64_t owner;     /**< reserving process, as in ACH_OWNER_PID() */
+    } ach_index_owner_t;
+
+
+    /** How gets with ACH_O_WAIT wait, for ach_attr_t.wait_policy */
+    enum ach_wait_policy {
+        /** sleep on the condition variable or futex */
+        ACH_WAIT_BLOCK = 0,
+        /** poll for a new frame for ach_attr_t.spin_ns, then sleep.
+         *  Saves the wakeup when frames come at short intervals. */
+        ACH_WAIT_SPIN = 1,
+        /** poll until a frame comes or the timeout passes, never
+         *  sleeping.  Takes a whole CPU; meant for isolated cores. */
+        ACH_WAIT_POLL = 2
+    };
 
     /** Attributes to pass to ach_open */
     typedef struct {
@@ -308,11 +557,64 @@ extern "C" {
             struct{
                 int map_anon;        /**< anonymous channel (put it in process heap, not shm) */
                 ach_header_t *shm;   /**< the memory buffer used by anonymous channels */
+                int populate;        /**< prefault the whole mapping */
+                int lock_memory;     /**< mlock() the mapping, failing
+                                      *   with ACH_FAILED_SYSCALL if not
+                                      *   permitted */
+                int use_fd;          /**< open the channel from fd rather
+                                      *   than by name */
+                int fd;              /**< descriptor of the channel if
+                                      *   use_fd, such as from a create
+                                      *   with ach_create_attr_t.memfd.
+                                      *   ach_open() makes its own
+                                      *   duplicate. */
+                int wait_policy;     /**< an ach_wait_policy value, for
+                                      *   gets with ACH_O_WAIT */
+                uint64_t spin_ns;    /**< how long ACH_WAIT_SPIN polls,
+                                      *   or 0 for ACH_DEFAULT_SPIN_NS */
+                int no_reader;       /**< don't claim a slot in the reader
+                                      *   table, as for a handle that only
+                                      *   puts */
+                size_t stream_min;   /**< copy frames of at least this
+                                      *   many bytes with non-temporal
+                                      *   stores, which bypass the cache
+                                      *   (x86 only), or 0 for
+                                      *   ACH_DEFAULT_STREAM_MIN.
+                                      *   SIZE_MAX never does. */
             };
             uint64_t reserved_size[8]; /**< Reserve space to compatibly add future options */
         };
     } ach_attr_t;
 
+    /** Page sizes for ach_create_attr_t.huge_pages */
+    enum ach_huge_pages {
+        /** ordinary pages */
+        ACH_HUGE_NONE = 0,
+        /** madvise(MADV_HUGEPAGE) every mapping.  Only has effect
+         *  when /sys/kernel/mm/transparent_hugepage/shmem_enabled
+         *  allows it (Linux only). */
+        ACH_HUGE_TRANSPARENT = 1,
+        /** Put the file on the hugetlbfs mounted at
+         *  ACH_HUGETLBFS_DIR instead of in shm.  Huge pages must be
+         *  reserved, see /proc/sys/vm/nr_hugepages. */
+        ACH_HUGE_TLB = 2
+    };
+
+    /** Shared memory layouts for ach_create_attr_t.layout */
+    enum ach_layout {
+        /** the original layout, which older versions of ach can
+         *  open, unless an option set in ach_create_attr_t needs
+         *  layout 2 */
+        ACH_LAYOUT_DEFAULT = 0,
+        /** the original layout, which programs built against older
+         *  versions of ach can open */
+        ACH_LAYOUT_1 = 1,
+        /** header fields split by who writes them onto separate
+         *  cache lines, and index entries and frames aligned to 64
+         *  bytes (ACH_SHM_MAGIC_NUM_V2) */
+        ACH_LAYOUT_2 = 2
+    };
+
     /** Attributes to pass to ach_create  */
     typedef struct {
         union {
@@ -323,6 +625,95 @@ extern "C" {
                 int set_clock;     /**< if true, set the clock of the condition variable */
                 clockid_t clock;   /**< Which clock to use if set_clock is true.
                                     *   The default is defined by ACH_DEFAULT_CLOCK. */
+                int futex;         /**< if true, readers wait on a futex
+                                    *   instead of the condition variable
+                                    *   (Linux only).  Puts with no
+                                    *   waiting readers make no syscalls.
+                                    *   The clock must be CLOCK_MONOTONIC
+                                    *   or CLOCK_REALTIME. */
+                int pollfd;        /**< if true, reserve room for
+                                    *   subscribers to register descriptors
+                                    *   with ach_pollfd_open() (Linux
+                                    *   only) */
+                int no_stats;      /**< if true, don't keep an ach_stats_t.
+                                    *   Counting gets also needs the
+                                    *   reader table (readers). */
+                int huge_pages;    /**< an ach_huge_pages value */
+                int populate;      /**< if true, every ach_open()
+                                    *   prefaults the whole mapping */
+                int lock_memory;   /**< if true, every ach_open() tries
+                                    *   to mlock() the mapping; opens
+                                    *   without permission go on
+                                    *   unlocked */
+                int layout;        /**< an ach_layout value */
+                int fixed_size;    /**< if true, divide the data array into
+                                    *   frame_cnt slots of frame_size bytes.
+                                    *   Larger frames are refused with
+                                    *   ACH_OVERFLOW, and puts never need
+                                    *   to evict more than one frame or
+                                    *   wrap around. */
+                int timestamps;    /**< if true, record the monotonic and
+                                    *   realtime clocks with every frame,
+                                    *   for ach_find_time() and
+                                    *   ach_get_time().  Needs layout 2. */
+                int memfd;         /**< if true, create the channel in an
+                                    *   anonymous memory file rather than
+                                    *   in shm (Linux only).  The channel
+                                    *   has no name in the file system
+                                    *   and is freed once every descriptor
+                                    *   and mapping of it is gone. */
+                int fd;            /**< descriptor of the channel, set on
+                                    *   output of create iff memfd.  Open
+                                    *   with ach_attr_t.use_fd, and pass
+                                    *   to other processes by fork() or
+                                    *   ach_channel_send().  The caller
+                                    *   must close it. */
+                int readers;       /**< if true, keep a table of open
+                                    *   handles and how far each has read
+                                    *   (ach_reader_t) */
+                int multi_put;     /**< if true, puts don't hold the lock
+                                    *   while they copy: each takes the
+                                    *   next slot atomically, copies into
+                                    *   it alongside other publishers, and
+                                    *   then publishes in sequence order.
+                                    *   Needs fixed_size, futex and layout
+                                    *   2.  ach_put_reserve() and
+                                    *   ach_resize() are not supported.
+                                    *   A publisher that dies between
+                                    *   taking a slot and publishing it
+                                    *   stops the channel: later puts,
+                                    *   and gets that need the frames
+                                    *   it was replacing, fail with
+                                    *   ACH_CORRUPT. */
+                int single_writer; /**< if true, only one handle in one
+                                    *   process may put.  The first put
+                                    *   claims the channel, others get
+                                    *   ACH_EACCES until it closes or its
+                                    *   process dies.  Puts publish with
+                                    *   atomic stores and take the mutex
+                                    *   only when a reader is waiting on
+                                    *   the condition variable, or not
+                                    *   at all with futex.  If the writer
+                                    *   dies part way through a put, gets
+                                    *   that need the frames it was
+                                    *   replacing fail with ACH_CORRUPT.
+                                    *   Needs layout 2, and excludes
+                                    *   multi_put. */
+                int mirror;        /**< if true, map the data array twice
+                                    *   back to back, so that every frame
+                                    *   is contiguous in memory: puts and
+                                    *   gets make one copy and views have
+                                    *   one segment even for frames that
+                                    *   wrap around.  The data array is
+                                    *   rounded up to whole pages.  Needs
+                                    *   layout 2 and a file (not map_anon
+                                    *   or hugetlbfs), and excludes
+                                    *   fixed_size, whose frames never
+                                    *   wrap. */
+                int lock_times;    /**< if true, also time how long each
+                                    *   put holds the write lock, at the
+                                    *   cost of two clock reads per put.
+                                    *   Needs statistics. */
             };
             uint64_t reserved[16]; /**< Reserve space to compatibly add future options */
         };
@@ -340,6 +731,9 @@ extern "C" {
                 size_t next_index;   /**< next index entry to try get from */
                 ach_attr_t attr;     /**< attributes used to create this channel */
                 volatile sig_atomic_t cancel; /**< cancel a waiting ach_get */
+                size_t reader;       /**< our slot in the reader table, or SIZE_MAX */
+                int writer;          /**< if true, we hold the claim of a
+                                      *   ACH_HEADER_SINGLE_WRITER channel */
             };
             uint64_t reserved[16]; /**< Reserve space to compatibly add future options */
         };
@@ -350,22 +744,103 @@ extern "C" {
     /** Size of ach_attr_t */
     extern size_t ach_attr_size;
 
+/** Rounds up to a multiple of 64 bytes */
+#define ACH_ALIGN64( n ) (((size_t)(n) + 63) & ~(size_t)63)
+
+/** Whether the channel has layout 2 */
+#define ACH_SHM_IS_V2( shm ) (ACH_SHM_MAGIC_NUM_V2 == ((ach_header_t*)(shm))->magic)
+
 /** Gets pointer to guard uint64 following the header */
 #define ACH_SHM_GUARD_HEADER( shm ) ((uint64_t*)((ach_header_t*)(shm) + 1))
 
+/** Gets the pointer to the ach_header_hot_t of a layout 2 channel,
+ * the cache line after the header guard */
+#define ACH_SHM_HOT_BLOCK( shm )                                        \
+    ((ach_header_hot_t*)((uint8_t*)(shm) +                              \
+                         ACH_ALIGN64(sizeof(ach_header_t) + sizeof(uint64_t))))
+
+/** Names a header field that layout 2 keeps in ach_header_hot_t */
+#define ACH_SHM_HOT( shm, field )                                       \
+    (*(ACH_SHM_IS_V2(shm) ? &ACH_SHM_HOT_BLOCK(shm)->field              \
+       : &((ach_header_t*)(shm))->field))
+
 /** Gets the pointer to the index array in the shm block */
-#define ACH_SHM_INDEX( shm ) ((ach_index_t*)(ACH_SHM_GUARD_HEADER(shm) + 1))
+#define ACH_SHM_INDEX( shm )                                            \
+    ((ach_index_t*)(ACH_SHM_IS_V2(shm)                                  \
+                    ? (uint8_t*)(ACH_SHM_HOT_BLOCK(shm) + 1)            \
+                    : (uint8_t*)(ACH_SHM_GUARD_HEADER(shm) + 1)))
+
+/** Bytes between index entries; each entry has its own cache line
+ * in layout 2 */
+#define ACH_SHM_INDEX_STRIDE( shm )                                     \
+    (ACH_SHM_IS_V2(shm) ? (size_t)64 : sizeof(ach_index_t))
+
+/** Gets the pointer to entry i of the index array */
+#define ACH_SHM_INDEX_AT( shm, i )                                      \
+    ((ach_index_t*)((uint8_t*)ACH_SHM_INDEX(shm) +                      \
+                    (size_t)(i) * ACH_SHM_INDEX_STRIDE(shm)))
+
+/** Gets the pointer to entry i of the index array of a channel with
+ * ACH_HEADER_TIMES */
+#define ACH_SHM_INDEX_TIME_AT( shm, i )                                 \
+    ((ach_index_time_t*)ACH_SHM_INDEX_AT(shm, i))
+
+/** Gets the pointer to the reservation of entry i of the index array
+ * of a channel with ACH_HEADER_MULTI_PUT */
+#define ACH_SHM_INDEX_OWNER_AT( shm, i )                                \
+    ((ach_index_owner_t*)((uint8_t*)ACH_SHM_INDEX_AT(shm, i) +          \
+                          sizeof(ach_index_time_t)))
 
 /**  gets pointer to the guard following the index section */
 #define ACH_SHM_GUARD_INDEX( shm )                                      \
-    ((uint64_t*)(ACH_SHM_INDEX(shm) + ((ach_header_t*)(shm))->index_cnt))
+    ((uint64_t*)ACH_SHM_INDEX_AT(shm, ((ach_header_t*)(shm))->index_cnt))
 
 /** Gets the pointer to the data buffer in the shm block */
-#define ACH_SHM_DATA( shm ) ( (uint8_t*)(ACH_SHM_GUARD_INDEX(shm) + 1) )
+#define ACH_SHM_DATA( shm )                                             \
+    ((((ach_header_t*)(shm))->flags & ACH_HEADER_MIRROR)                \
+     ? (uint8_t*)(shm) + ((ach_header_t*)(shm))->data_offset            \
+     : (uint8_t*)ACH_SHM_GUARD_INDEX(shm) +                             \
+       (ACH_SHM_IS_V2(shm) ? (size_t)64 : sizeof(uint64_t)))
 
 /** Gets the pointer to the guard following data buffer in the shm block */
 #define ACH_SHM_GUARD_DATA( shm )                                       \
-    ((uint64_t*)(ACH_SHM_DATA(shm) + ((ach_header_t*)(shm))->data_size))
+    ((uint64_t*)(ACH_SHM_DATA(shm) + ((ach_header_t*)(shm))->data_size * \
+                 ((((ach_header_t*)(shm))->flags & ACH_HEADER_MIRROR) ? 2 : 1)))
+
+/** Bytes of the data array taken by a frame of n bytes; layout 2
+ * starts every frame on a cache line */
+#define ACH_SHM_FRAME_SPACE( shm, n )                                   \
+    (ACH_SHM_IS_V2(shm) ? ACH_ALIGN64(n) : (size_t)(n))
+
+/** Offset of the optional sections after the data guard */
+#define ACH_SHM_TAIL_OFFSET( shm )                                      \
+    ACH_ALIGN64( (uint8_t*)(ACH_SHM_GUARD_DATA(shm) + 1) - (uint8_t*)(shm) )
+
+/** Gets the pointer to the pollfd registry (ACH_HEADER_POLLFD) */
+#define ACH_SHM_POLLFD( shm )                                           \
+    ((ach_pollfd_registry_t*)((uint8_t*)(shm) + ACH_SHM_TAIL_OFFSET(shm)))
+
+/** Gets the pointer to the statistics (ACH_HEADER_STATS), which
+ * follow the pollfd registry if there is one */
+#define ACH_SHM_STATS( shm )                                            \
+    ((ach_stats_t*)((uint8_t*)(shm) + ACH_SHM_TAIL_OFFSET(shm) +        \
+                    ((((ach_header_t*)(shm))->flags & ACH_HEADER_POLLFD) ? \
+                     ACH_ALIGN64(sizeof(ach_pollfd_registry_t)) : 0)))
+
+/** Gets the pointer to the ACH_READERS_MAX slots of the reader table
+ * (ACH_HEADER_READERS), which follow the statistics if there are any */
+#define ACH_SHM_READERS( shm )                                          \
+    ((ach_reader_t*)((uint8_t*)ACH_SHM_STATS(shm) +                     \
+                     ((((ach_header_t*)(shm))->flags & ACH_HEADER_STATS) ? \
+                      ACH_ALIGN64(sizeof(ach_stats_t)) : 0)))
+
+/** Bytes of address space a mapping of the channel takes, which is
+ * more than the file for the second copy of an ACH_HEADER_MIRROR
+ * data array */
+#define ACH_SHM_MAP_LEN( shm )                                          \
+    (((ach_header_t*)(shm))->len +                                      \
+     ((((ach_header_t*)(shm))->flags & ACH_HEADER_MIRROR) ?             \
+      ((ach_header_t*)(shm))->data_size : 0))
 
 
     /** Initialize attributes for opening channels. */
@@ -428,12 +903,238 @@ extern "C" {
              const struct timespec *ACH_RESTRICT abstime,
              int options );
 
+    /** Same as ach_get().
+
+        \deprecated This used to print each step to stdout.  Build
+        libach with ACH_TRACE and use ach_trace_dump() instead.
+    */
     enum ach_status
     ach_get_loud( ach_channel_t *chan, void *buf, size_t size,
              size_t *frame_size,
              const struct timespec *ACH_RESTRICT abstime,
              int options );
 
+    /** Pulls the frame with a particular sequence number.
+
+        The frame is found directly from seq_num rather than by
+        scanning the channel, and neither the channel mutex nor
+        chan.seq_num is touched, so this is cheap enough to serve
+        retransmit requests.
+
+        \pre chan has been opened with ach_open()
+
+        \param chan The previously opened channel handle
+        \param seq_num Sequence number of the desired frame
+        \param buf Buffer to store data
+        \param size Length of buffer in bytes
+        \param frame_size The number of bytes copied to buf, or the
+        size of the frame if buf is too small.
+
+        \return ACH_OK on success, ACH_STALE_FRAMES if seq_num has not
+        been put yet, ACH_MISSED_FRAME if the frame has already been
+        overwritten, ACH_OVERFLOW if buf is too small, and ACH_EINVAL
+        if seq_num is 0.
+    */
+    enum ach_status
+    ach_get_seq( ach_channel_t *chan, uint64_t seq_num,
+                 void *buf, size_t size, size_t *frame_size );
+
+    /** A frame found by ach_find_time() */
+    typedef struct ach_frame_time {
+        uint64_t seq_num;       /**< sequence number, or 0 if there is no such frame */
+        struct timespec time;   /**< when the frame was put, in the clock searched */
+    } ach_frame_time_t;
+
+    /** Which frame ach_get_time() copies */
+    enum ach_time_match {
+        ACH_TIME_NEAREST = 0,   /**< the frame put closest to the time */
+        ACH_TIME_BEFORE = 1,    /**< the newest frame put at or before the time */
+        ACH_TIME_AFTER = 2      /**< the oldest frame put after the time */
+    };
+
+    /** Finds the frames put on either side of a time.
+
+        Searches the frames still in the channel by binary search on
+        their index entries, without copying any of them or taking the
+        channel mutex.  Follow up with ach_get_seq() to copy the
+        frames.  Searching CLOCK_REALTIME assumes the clock was not
+        stepped backwards while the frames were put.
+
+        \pre chan has been opened with ach_open() and the channel was
+        created with ach_create_attr_t.timestamps
+
+        \param chan The previously opened channel handle
+        \param clock CLOCK_MONOTONIC or CLOCK_REALTIME
+        \param when The time to search for
+        \param before The newest frame put at or before when
+        \param after The oldest frame put after when
+
+        \return ACH_OK if either frame was found, ACH_STALE_FRAMES if
+        the channel is empty, and ACH_EINVAL if the channel has no
+        timestamps or clock is not supported.
+    */
+    enum ach_status
+    ach_find_time( ach_channel_t *chan, clockid_t clock,
+                   const struct timespec *when,
+                   ach_frame_time_t *before, ach_frame_time_t *after );
+
+    /** Pulls the frame put nearest to a time.
+
+        Like ach_find_time() followed by ach_get_seq(), searching
+        again if the frame is overwritten in between.  chan.seq_num
+        is not changed.
+
+        \param chan The previously opened channel handle
+        \param clock CLOCK_MONOTONIC or CLOCK_REALTIME
+        \param when The time to search for
+        \param match an ach_time_match value
+        \param buf Buffer to store data
+        \param size Length of buffer in bytes
+        \param frame_size The number of bytes copied to buf, or the
+        size of the frame if buf is too small.
+        \param frame If not NULL, receives the sequence number and
+        time of the frame
+
+        \return ACH_STALE_FRAMES if no frame in the channel matches,
+        otherwise as for ach_find_time() and ach_get_seq()
+    */
+    enum ach_status
+    ach_get_time( ach_channel_t *chan, clockid_t clock,
+                  const struct timespec *when, int match,
+                  void *buf, size_t size, size_t *frame_size,
+                  ach_frame_time_t *frame );
+
+    /** Location of one frame copied by ach_get_many() */
+    typedef struct ach_frame_desc {
+        size_t offset;          /**< start of the frame in the buffer */
+        size_t size;            /**< length of the frame in bytes */
+        uint64_t seq_num;       /**< sequence number of the frame */
+    } ach_frame_desc_t;
+
+    /** Pulls several consecutive messages from the channel at once.
+
+        The first frame is selected exactly as ach_get() would select
+        it.  Frames following it are then copied back to back into
+        buf until max_frames are copied, buf is full, or no unseen
+        frames remain.  With ACH_O_LAST, only the newest frame is
+        copied.
+
+        \pre chan has been opened with ach_open()
+
+        \post On ACH_OK or ACH_MISSED_FRAME, frames[0] through
+        frames[*frame_cnt-1] describe the copied frames and
+        chan.seq_num is set to the last of them.  On ACH_OVERFLOW,
+        frames[0].size holds the size of the first frame, which did
+        not fit in buf, and no other side effects occur.
+
+        \param chan The previously opened channel handle
+        \param buf Buffer to store frame data
+        \param size Length of buffer in bytes
+        \param frames Array receiving the location of each frame
+        \param max_frames Length of the frames array
+        \param frame_cnt The number of frames copied
+        \param abstime An absolute timeout if ACH_O_WAIT is specified.
+        \param options Option flags, as for ach_get()
+
+        \return ACH_MISSED_FRAME if frames were skipped before the
+        first copied frame, otherwise as for ach_get()
+    */
+    enum ach_status
+    ach_get_many( ach_channel_t *chan, void *buf, size_t size,
+                  ach_frame_desc_t *frames, size_t max_frames,
+                  size_t *frame_cnt,
+                  const struct timespec *ACH_RESTRICT abstime,
+                  int options );
+
+    /** Copies the newest frames in the channel.
+
+        Takes one consistent snapshot of the last max_frames frames
+        still in the channel, or as many of the newest as fit in buf,
+        and copies them oldest first.  Frames already returned by
+        other gets are copied again, and chan.seq_num is not changed,
+        so a filter can call this every cycle in place of keeping its
+        own history of the channel.
+
+        \pre chan has been opened with ach_open()
+
+        \post On ACH_OK, frames[0] through frames[*frame_cnt-1]
+        describe the copied frames, oldest first.  On ACH_OVERFLOW,
+        frames[0].size holds the size of the newest frame, which did
+        not fit in buf.
+
+        \param chan The previously opened channel handle
+        \param buf Buffer to store frame data
+        \param size Length of buffer in bytes
+        \param frames Array receiving the location of each frame
+        \param max_frames Length of the frames array, the most frames
+        to copy
+        \param frame_cnt The number of frames copied
+
+        \return ACH_OK on success, ACH_STALE_FRAMES if the channel is
+        empty, ACH_OVERFLOW if buf is too small for the newest frame.
+    */
+    enum ach_status
+    ach_get_window( ach_channel_t *chan, void *buf, size_t size,
+                    ach_frame_desc_t *frames, size_t max_frames,
+                    size_t *frame_cnt );
+
+    /** A frame borrowed in place from a channel's data array.
+
+        A frame that wraps around the end of the data array is split
+        into two segments, except in ACH_HEADER_MIRROR channels.
+        Otherwise, seg[1] is NULL and seg_size[1] is zero.
+    */
+    typedef struct ach_view {
+        const void *seg[2];     /**< start of each segment of the frame */
+        size_t seg_size[2];     /**< length of each segment in bytes */
+        size_t frame_size;      /**< total length of the frame in bytes */
+        uint64_t seq_num;       /**< sequence number of the frame */
+        size_t index_offset;    /**< private: index entry of the frame */
+    } ach_view_t;
+
+    /** Pulls a message from the channel without copying it.
+
+        Selects a frame exactly as ach_get() does, but rather than
+        copying the frame, points view at it in shared memory.  No lock
+        is held once this returns, so a publisher may overwrite the
+        frame at any time.  Call ach_view_validate() or
+        ach_view_release() after reading the data to find out whether
+        it was intact.
+
+        \pre chan has been opened with ach_open()
+
+        \post On ACH_OK or ACH_MISSED_FRAME, view describes the frame
+        and chan.seq_num is set to the frame's sequence number.
+
+        \param chan The previously opened channel handle
+        \param view Receives the location of the frame
+        \param abstime An absolute timeout if ACH_O_WAIT is specified.
+        \param options Option flags, as for ach_get()
+    */
+    enum ach_status
+    ach_get_view( ach_channel_t *chan, ach_view_t *view,
+                  const struct timespec *ACH_RESTRICT abstime,
+                  int options );
+
+    /** Checks whether the frame in view is still intact.
+
+        \return ACH_OK if the frame has not been touched since
+        ach_get_view() returned, and ACH_OVERWRITTEN if a publisher
+        has reused its space.  Data read from the view before an
+        ACH_OK return is good.
+    */
+    enum ach_status
+    ach_view_validate( const ach_channel_t *chan, const ach_view_t *view );
+
+    /** Finishes with a view from ach_get_view().
+
+        \post view no longer refers to the channel
+
+        \return as for ach_view_validate()
+    */
+    enum ach_status
+    ach_view_release( ach_channel_t *chan, ach_view_t *view );
+
     /** Writes a new message in the channel.
 
         \pre chan has been opened with ach_open()
@@ -444,14 +1145,89 @@ extern "C" {
         \param chan (action) The channel to write to
         \param buf The buffer containing the data to copy into the channel
         \param len number of bytes in buf to copy, len > 0
-        \return ACH_OK on success.
+        \return ACH_OK on success, ACH_EACCES if another handle holds
+        the claim of an ACH_HEADER_SINGLE_WRITER channel.
     */
     enum ach_status
     ach_put( ach_channel_t *chan, const void *buf, size_t len );
 
+    /** Same as ach_put().
+
+        \deprecated This used to print each step to stdout.  Build
+        libach with ACH_TRACE and use ach_trace_dump() instead.
+    */
     enum ach_status
     ach_put_loud( ach_channel_t *chan, const void *buf, size_t len );
 
+    struct iovec;
+
+    /** Writes a new message gathered from several buffers.
+
+        Equivalent to ach_put() of the concatenation of the iovcnt
+        buffers in iov, without needing to assemble them first.
+
+        \pre chan has been opened with ach_open()
+
+        \param chan (action) The channel to write to
+        \param iov The buffers to copy into the channel, in order
+        \param iovcnt number of elements in iov
+        \return ACH_OK on success, ACH_EINVAL if the buffers hold zero
+        bytes in total.
+    */
+    enum ach_status
+    ach_putv( ach_channel_t *chan, const struct iovec *iov, int iovcnt );
+
+    /** Reserves space for a new message directly in the channel.
+
+        This is the first half of a zero-copy put.  Write the message
+        into *buf, then publish it with ach_put_commit(), or drop it
+        with ach_put_abort().
+
+        \pre chan has been opened with ach_open()
+
+        \post On ACH_OK, the channel is locked for writing and *buf
+        points to len contiguous bytes of the channel's data array.
+        Older messages occupying that space have been discarded.  Other
+        publishers block until the matching commit or abort, so keep
+        the time between them short.
+
+        \param chan (action) The channel to write to
+        \param len number of bytes to reserve, len > 0
+        \param buf (output) where to write the message
+        \return ACH_OK on success, ACH_OVERFLOW if len is larger than
+        the channel, ACH_EINVAL for channels with ACH_HEADER_MULTI_PUT,
+        ACH_EACCES as for ach_put().
+    */
+    enum ach_status
+    ach_put_reserve( ach_channel_t *chan, size_t len, void **buf );
+
+    /** Publishes a message written into space from ach_put_reserve().
+
+        \pre ach_put_reserve() on chan returned ACH_OK
+
+        \post The message is visible to subscribers and the channel
+        is unlocked.
+
+        \param chan (action) The channel to write to
+        \param len number of bytes actually written, 0 < len <= the
+        reserved length
+        \return ACH_OK on success.  ACH_EINVAL if len is zero or runs
+        past the reserved space, in which case the message is dropped
+        and the channel unlocked.
+    */
+    enum ach_status
+    ach_put_commit( ach_channel_t *chan, size_t len );
+
+    /** Drops a message reserved with ach_put_reserve().
+
+        \pre ach_put_reserve() on chan returned ACH_OK
+
+        \post The channel is unlocked.  Messages discarded to make
+        room for the reservation are not restored.
+    */
+    enum ach_status
+    ach_put_abort( ach_channel_t *chan );
+
 
     /** Discards all previously received messages for this handle.  Does
         not change the actual channel, just resets the sequence number in
@@ -480,14 +1256,109 @@ extern "C" {
     */
     void ach_dump( ach_header_t *shm);
 
+    /** Whether the process in an owner word of ach_reader_t or
+        ach_header_hot_t has exited.
+
+        A process now running under the same pid counts as exited if
+        its start time differs.  Where start times can't be read
+        (there is no /proc), only the pid is checked.
+
+        \param owner an owner word, see ACH_OWNER_PID()
+        \return nonzero if the owner has exited
+    */
+    int ach_owner_dead( uint64_t owner );
+
+    /** Writes the tracepoints this process recorded to fd as Chrome
+        trace event JSON, for chrome://tracing or Perfetto.
+
+        Tracepoints are compiled in only if libach was built with
+        ACH_TRACE defined (configure --enable-trace, or cmake
+        -DACH_TRACE=ON), and ACH_TRACE_MASK picks which ones.  They
+        record taking and releasing the channel mutex, waits for
+        frames, copies of frame data, and evictions, each with the
+        channel and thread, into a ring of the ACH_TRACE_RECORDS most
+        recent ones.  Each process that opens a channel with the
+        environment variable ACH_TRACE_FILE set writes its trace to
+        ACH_TRACE_FILE.PID.json when it exits.
+
+        \return ACH_OK, ACH_EINVAL if libach was built without
+        tracepoints, or ACH_FAILED_SYSCALL if writing failed.
+    */
+    enum ach_status
+    ach_trace_dump( int fd );
+
+    /** Discards the tracepoints this process recorded so far */
+    void
+    ach_trace_clear( void );
+
     /** Sets permissions of chan to specified mode */
     enum ach_status
     ach_chmod( ach_channel_t *chan, mode_t mode );
 
+    /** Changes the number and size of frames in a channel, while it
+        is in use.
+
+        Builds a new channel of the same name and with the same
+        options, and moves over the newest frames that fit, keeping
+        their sequence numbers.  Other handles to the channel find the
+        new one on their next get or put, and waiting gets wake up and
+        follow it.
+
+        Frames put while the resize runs wait for it.  The new
+        channel is built in a temporary file and renamed over the old
+        one once it holds the frames, so opening by name always finds
+        one of the two, and a resize that fails leaves the old channel
+        in place.  Registrations from
+        ach_pollfd_open() carry over.  Release views from
+        ach_get_view() before the handle's next get or put, which
+        unmaps the old channel when it follows the resize.
+
+        \pre chan was opened by name, not from a heap channel or a
+        memfd
+
+        \param chan The previously opened channel handle, which will
+        refer to the new channel
+        \param frame_cnt number of frames in the new channel
+        \param frame_size nominal size of each frame
+
+        \return ACH_OK on success, ACH_OVERFLOW if the newest frame
+        would not fit, ACH_EINVAL if chan was not opened by name, has
+        ACH_HEADER_MULTI_PUT, or frame_cnt or frame_size is 0,
+        ACH_EACCES if another handle holds the claim of an
+        ACH_HEADER_SINGLE_WRITER channel.
+    */
+    enum ach_status
+    ach_resize( ach_channel_t *chan, size_t frame_cnt, size_t frame_size );
+
     /** Delete an ach channel */
     enum ach_status
     ach_unlink( const char *name );
 
+    /** Sends the descriptor of an open channel over a unix socket.
+
+        This is the way to share a channel created with
+        ach_create_attr_t.memfd with processes that were not forked
+        after its creation.  Works for shm channels as well.
+
+        \param sock a connected AF_UNIX socket
+        \param chan an open channel, not a heap channel
+    */
+    enum ach_status
+    ach_channel_send( int sock, const ach_channel_t *chan );
+
+    /** Receives a channel sent by ach_channel_send() and opens it.
+
+        \param sock a connected AF_UNIX socket
+        \param chan the channel handle to open
+        \param attr options for ach_open(), or NULL
+
+        \return ACH_OK on success, ACH_CLOSED if the sender closed the
+        socket, ACH_BAD_SHM_FILE if no descriptor came, otherwise as for
+        ach_open()
+    */
+    enum ach_status
+    ach_channel_recv( int sock, ach_channel_t *chan, ach_attr_t *attr );
+
 
     /** Attributes parameter for ach_cancel */
     typedef struct ach_cancel_attr {
@@ -501,6 +1372,69 @@ extern "C" {
     } ach_cancel_attr_t;
 
 
+    /** Waits until any of several channels has an unseen frame.
+
+        Blocks on the channels' futexes, so no thread per channel and
+        no polling is needed.  Follow up with ach_get() on each ready
+        channel.
+
+        Only available on Linux 5.16 and later.
+
+        \pre chans have been opened with ach_open()
+
+        \post ready[i] is nonzero for each chans[i] holding a frame
+        newer than its seq_num
+
+        \param chans The channels to wait on, at most 128
+        \param n Number of channels in chans
+        \param ready Array of n flags receiving which channels are ready
+        \param abstime An absolute timeout, or NULL to wait
+        indefinitely.  Measured against the channels' clock, which
+        must be CLOCK_MONOTONIC or CLOCK_REALTIME and the same for
+        every channel.
+
+        \return ACH_OK if some channel is ready, ACH_TIMEOUT,
+        ACH_CANCELED if ach_cancel() was called on any of the
+        channels, or ACH_EINVAL if unsupported or if abstime is given
+        for channels with different clocks.
+    */
+    enum ach_status
+    ach_wait_any( ach_channel_t *const *chans, size_t n, int *ready,
+                  const struct timespec *ACH_RESTRICT abstime );
+
+    /** Opens a descriptor that becomes readable when a frame is put.
+
+        The descriptor can be watched with poll(), select(), or epoll
+        alongside sockets and timers.  After it polls readable, call
+        ach_pollfd_clear() and then ach_get() until ACH_STALE_FRAMES.
+
+        Only available on Linux, for channels created with
+        ach_create_attr_t.pollfd set.
+
+        \pre chan has been opened with ach_open()
+
+        \param chan The channel to watch
+        \param fd Receives the descriptor
+        \return ACH_OK on success, ACH_EINVAL if the channel was not
+        created with pollfd, or ACH_OVERFLOW if ACH_POLLFD_MAX
+        descriptors are already registered.
+    */
+    enum ach_status
+    ach_pollfd_open( ach_channel_t *chan, int *fd );
+
+    /** Consumes pending notifications on a descriptor from
+        ach_pollfd_open(). */
+    enum ach_status
+    ach_pollfd_clear( int fd );
+
+    /** Unregisters and closes a descriptor from ach_pollfd_open().
+
+        Descriptors of processes that exit without calling this are
+        unregistered by the next put.
+    */
+    enum ach_status
+    ach_pollfd_close( ach_channel_t *chan, int fd );
+
     /** Initialize attributes */
     void
     ach_cancel_attr_init( ach_cancel_attr_t *attr );
@@ -51,6 +51,9 @@
 
 #define ACHD_LINE_LENGTH 1024
 
+/* Most frames to push from the channel at once */
+#define ACHD_BATCH_FRAMES 64
+
 #ifdef __GNUC__
 #define ACHD_ATTR_PRINTF(m,n) __attribute__((format(printf, m, n)))
 #else
@@ -122,6 +125,11 @@ struct achd_conn {
     size_t pipeframe_size;
     ach_pipe_frame_t *pipeframe;
 
+    size_t batch_size;  ///< size of batch in bytes
+    uint8_t *batch;     ///< data of frames from ach_get_many()
+    size_t batch_cnt;   ///< number of frames in batch
+    ach_frame_desc_t batch_frames[ACHD_BATCH_FRAMES];
+
     const struct achd_conn_vtab *vtab;
 
     void *cx;
@@ -146,6 +154,8 @@ void achd_error_log( enum ach_status code, const char fmt[], ... )    ACHD_ATTR_
 /* basic i/o */
 ssize_t achd_read(int fd, void *buf, size_t cnt );
 ssize_t achd_write(int fd, const void *buf, size_t cnt );
+struct iovec;
+ssize_t achd_writev(int fd, const struct iovec *iov, int iovcnt );
 enum ach_status achd_readline(int fd, char *buf, size_t n );
 enum ach_status achd_printf(int fd, const char fmt[], ...) ACHD_ATTR_PRINTF(2,3);
 
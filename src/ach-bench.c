@@ -40,6 +40,10 @@
  *
  */
 
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -71,6 +75,19 @@ size_t RECV_RT = 1;
 size_t RECV_NRT = 0;
 size_t SEND_RT = 1;
 int PASS_NO_RT = 0;
+int USE_FUTEX = 0;
+int LAYOUT = ACH_LAYOUT_2;
+int FIXED = 0;
+int SINGLE_WRITER = 0;
+int NO_STATS = 0;
+int READERS = 0;
+int LOCK_TIMES = 0;
+int CONTENTION = 0;
+int WAIT_POLICY = ACH_WAIT_BLOCK;
+uint64_t SPIN_NS = 0;
+int DISTRIBUTION = 0;
+size_t MULTI_PUT_SIZE = 0;
+int STREAM_SWEEP = 0;
 
 double overhead = 0;
 
@@ -212,11 +229,24 @@ void setup_ach(void) {
     /* create channel */
     int r = ach_unlink("bench");               /* delete first */
     assert( ACH_OK == r || ACH_ENOENT == r);
-    r = ach_create("bench", 10, 256, NULL );
+    ach_create_attr_t attr;
+    ach_create_attr_init(&attr);
+    attr.futex = USE_FUTEX;
+    attr.layout = LAYOUT;
+    attr.fixed_size = FIXED;
+    attr.single_writer = SINGLE_WRITER;
+    attr.no_stats = NO_STATS;
+    attr.readers = READERS;
+    attr.lock_times = LOCK_TIMES;
+    r = ach_create("bench", 10, 256, &attr );
     assert(ACH_OK == r);
 
     /* open channel */
-    r = ach_open(&chan, "bench", NULL);
+    ach_attr_t oattr;
+    ach_attr_init(&oattr);
+    oattr.wait_policy = WAIT_POLICY;
+    oattr.spin_ns = SPIN_NS;
+    r = ach_open(&chan, "bench", &oattr);
     assert(ACH_OK == r);
 }
 
@@ -225,6 +255,320 @@ void destroy_ach(void) {
     assert(ACH_OK == r);
 }
 
+/*******************/
+/* CONTENTION MODE */
+/*******************/
+
+/* The publisher puts as fast as it can while subscribers poll for the
+ * newest frame without waiting, so every put and get touches the
+ * shared header and index.  Compare -O with the default layout to see
+ * what false sharing costs, and -N with -R to see what statistics
+ * cost. */
+static void contention_subscriber(size_t id) {
+    ach_channel_t c;
+    int r = ach_open(&c, "bench", NULL);
+    assert(ACH_OK == r);
+
+    uint8_t buf[256];
+    uint64_t gets = 0, fresh = 0;
+    ticks_t t0 = get_ticks(), t1 = t0;
+    do {
+        size_t i;
+        for( i = 0; i < 1024; i++ ) {
+            size_t fs;
+            r = ach_get(&c, buf, sizeof(buf), &fs, NULL, ACH_O_LAST);
+            if( ACH_OK == r || ACH_MISSED_FRAME == r ) fresh++;
+            gets++;
+        }
+        t1 = get_ticks();
+    } while( ticks_delta(t0, t1) < SECS );
+
+    double dt = ticks_delta(t0, t1);
+    fprintf(stderr, "subscriber %"PRIuPTR": %.0f gets/s, %.0f new frames/s\n",
+            id, (double)gets / dt, (double)fresh / dt);
+    ach_close(&c);
+}
+
+static void contention_publisher(void) {
+    uint8_t buf[64];
+    memset(buf, 0, sizeof(buf));
+    uint64_t puts = 0;
+    ticks_t t0 = get_ticks(), t1 = t0;
+    do {
+        size_t i;
+        for( i = 0; i < 1024; i++ ) {
+            int r = ach_put(&chan, buf, sizeof(buf));
+            assert(ACH_OK == r);
+        }
+        puts += 1024;
+        t1 = get_ticks();
+    } while( ticks_delta(t0, t1) < SECS );
+
+    fprintf(stderr, "publisher: %.0f puts/s\n", (double)puts / ticks_delta(t0, t1));
+}
+
+static void contention(void) {
+    setup_ach();
+
+    size_t n_recv = RECV_RT + RECV_NRT;
+    pid_t pid_recv[n_recv];
+    size_t i;
+    for( i = 0; i < n_recv; i ++ ) {
+        pid_recv[i] = fork();
+        assert( pid_recv[i] >= 0 );
+        if( 0 == pid_recv[i] ) {
+            contention_subscriber(i);
+            exit(0);
+        }
+    }
+    contention_publisher();
+
+    for( i = 0; i < n_recv; i ++ ) {
+        int status;
+        waitpid( pid_recv[i], &status, 0 );
+    }
+    destroy_ach();
+}
+
+/************************/
+/* MULTI-PUBLISHER MODE */
+/************************/
+
+/* 1 to 16 publishers put MULTI_PUT_SIZE-byte frames as fast as they
+ * can for SECS, first to a channel whose puts copy under the lock and
+ * then to one with multi_put, where the copies overlap. */
+static uint64_t publishers_run(size_t n_pub, int multi_put, uint64_t *counts) {
+    int r = ach_unlink("bench");
+    assert( ACH_OK == r || ACH_ENOENT == r);
+    ach_create_attr_t attr;
+    ach_create_attr_init(&attr);
+    attr.futex = 1;
+    attr.fixed_size = 1;
+    attr.multi_put = multi_put;
+    r = ach_create("bench", 64, MULTI_PUT_SIZE, &attr );
+    assert(ACH_OK == r);
+
+    pid_t pid[n_pub];
+    size_t i;
+    fflush(stdout);
+    for( i = 0; i < n_pub; i ++ ) {
+        pid[i] = fork();
+        assert( pid[i] >= 0 );
+        if( 0 == pid[i] ) {
+            ach_channel_t c;
+            ach_attr_t oattr;
+            ach_attr_init(&oattr);
+            oattr.no_reader = 1;
+            r = ach_open(&c, "bench", &oattr);
+            assert(ACH_OK == r);
+            uint8_t *buf = (uint8_t*)malloc(MULTI_PUT_SIZE);
+            memset(buf, (int)i, MULTI_PUT_SIZE);
+            uint64_t puts = 0;
+            ticks_t t0 = get_ticks(), t1 = t0;
+            do {
+                r = ach_put(&c, buf, MULTI_PUT_SIZE);
+                assert(ACH_OK == r);
+                puts++;
+                if( 0 == puts % 64 ) t1 = get_ticks();
+            } while( ticks_delta(t0, t1) < SECS );
+            counts[i] = puts;
+            exit(0);
+        }
+    }
+
+    uint64_t total = 0;
+    for( i = 0; i < n_pub; i ++ ) {
+        int status;
+        waitpid( pid[i], &status, 0 );
+        total += counts[i];
+    }
+    destroy_ach();
+    return total;
+}
+
+static void publishers(void) {
+    uint64_t *counts = (uint64_t*)mmap(NULL, 16 * sizeof(uint64_t), PROT_READ|PROT_WRITE,
+                                       MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    assert( MAP_FAILED != counts );
+
+    printf("%"PRIuPTR"-byte frames for %.1f s\n", MULTI_PUT_SIZE, SECS);
+    printf("publishers     locked puts/s  multi_put puts/s\n");
+    size_t n;
+    for( n = 1; n <= 16; n *= 2 ) {
+        double locked = (double)publishers_run(n, 0, counts) / SECS;
+        double multi = (double)publishers_run(n, 1, counts) / SECS;
+        printf("%10"PRIuPTR" %18.0f %17.0f\n", n, locked, multi);
+    }
+    munmap(counts, 16 * sizeof(uint64_t));
+}
+
+/*********************/
+/* STREAM SWEEP MODE */
+/*********************/
+
+/* For each frame size, time puts and gets through a handle that
+ * copies with memcpy() and one that streams (ach_attr_t.stream_min),
+ * and how long a put plus a reread of a working set takes, as for a
+ * publisher that goes back to its own data after each put.  Streaming
+ * pays off from about the size where it keeps the working set
+ * cached. */
+
+#define SWEEP_WORK (256*1024)
+uint64_t sweep_sink;
+
+static double sweep_time( ach_channel_t *c, uint8_t *buf, size_t size, int get,
+                          const uint64_t *work ) {
+    int r;
+    if( get ) {
+        r = ach_put( c, buf, size );
+        assert( ACH_OK == r );
+    }
+    uint64_t n = 0, sum = 0;
+    ticks_t t0 = get_ticks(), t1 = t0;
+    do {
+        if( get ) {
+            size_t frame_size;
+            r = ach_get( c, buf, size, &frame_size, NULL, ACH_O_LAST | ACH_O_COPY );
+        } else {
+            r = ach_put( c, buf, size );
+        }
+        assert( ACH_OK == r || ACH_MISSED_FRAME == r );
+        if( work ) {
+            size_t i;
+            /* one load per cache line */
+            for( i = 0; i < SWEEP_WORK / sizeof(uint64_t); i += 8 ) sum += work[i];
+        }
+        n++;
+        t1 = get_ticks();
+    } while( ticks_delta(t0, t1) < SECS );
+    sweep_sink += sum;
+    return ticks_delta(t0, t1) / (double)n;
+}
+
+static void stream_sweep(void) {
+    uint64_t *work = (uint64_t*)calloc( 1, SWEEP_WORK );
+    uint8_t *buf = (uint8_t*)malloc( 32 << 20 );
+    assert( work && buf );
+    memset( buf, 1, 32 << 20 );
+
+    printf("%10s %11s %11s %11s %11s %12s %12s\n", "", "put GB/s", "",
+           "get GB/s", "", "put+reread us", "");
+    printf("%10s %11s %11s %11s %11s %12s %12s\n", "size",
+           "memcpy", "stream", "memcpy", "stream", "memcpy", "stream");
+    size_t size;
+    for( size = 4096; size <= (32 << 20); size *= 2 ) {
+        int r = ach_unlink("bench");
+        assert( ACH_OK == r || ACH_ENOENT == r);
+        r = ach_create("bench", 2, size, NULL );
+        assert(ACH_OK == r);
+
+        double t[2][3];
+        int k;
+        for( k = 0; k < 2; k ++ ) {
+            ach_channel_t c;
+            ach_attr_t attr;
+            ach_attr_init(&attr);
+            attr.stream_min = k ? 1 : SIZE_MAX;
+            r = ach_open(&c, "bench", &attr);
+            assert(ACH_OK == r);
+            t[k][0] = sweep_time( &c, buf, size, 0, NULL );
+            t[k][1] = sweep_time( &c, buf, size, 1, NULL );
+            t[k][2] = sweep_time( &c, buf, size, 0, work );
+            ach_close(&c);
+        }
+        printf("%10"PRIuPTR" %11.2f %11.2f %11.2f %11.2f %12.1f %12.1f\n", size,
+               (double)size / t[0][0] / 1e9, (double)size / t[1][0] / 1e9,
+               (double)size / t[0][1] / 1e9, (double)size / t[1][1] / 1e9,
+               t[0][2] * 1e6, t[1][2] * 1e6);
+        fflush(stdout);
+        destroy_ach();
+    }
+    free(work);
+    free(buf);
+}
+
+/****************/
+/* LATENCY MODE */
+/****************/
+
+/* One publisher and one receiver for each wait policy in turn,
+ * printing percentiles of the latency from put to the receiver's get
+ * returning. */
+static const char *policy_name[] = {"block", "spin", "poll"};
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[i];
+}
+
+static void latency_receiver(void) {
+    /* A polling receiver above the sender's priority would starve
+     * it on a shared core.  Only blocking receivers go above. */
+    make_realtime( (ACH_WAIT_BLOCK == WAIT_POLICY) ? 99 : 97 );
+
+    size_t max = (size_t)(SECS*FREQUENCY) + 1, n = 0;
+    double *lat = (double*)malloc(max * sizeof(lat[0]));
+    assert(lat);
+
+    while( n < max ) {
+        ticks_t ticks;
+        size_t fs;
+        ticks_t then = get_ticks();
+        then.tv_sec += 1;
+        int r = ach_get(&chan, &ticks, sizeof(ticks), &fs, &then,
+                        ACH_O_LAST | ACH_O_WAIT);
+        ticks_t now = get_ticks();
+        if( ACH_TIMEOUT == r ) break;
+        assert(ACH_OK == r || ACH_MISSED_FRAME == r);
+        lat[n++] = ticks_delta(ticks, now);
+    }
+
+    if( 0 == n ) {
+        printf("%-5s no frames\n", policy_name[WAIT_POLICY]);
+    } else {
+        qsort(lat, n, sizeof(lat[0]), compare_double);
+        printf("%-5s n=%-7"PRIuPTR" min %7.2f  p50 %7.2f  p90 %7.2f  "
+               "p99 %7.2f  p99.9 %7.2f  max %7.2f us\n",
+               policy_name[WAIT_POLICY], n,
+               lat[0]*1e6, percentile(lat, n, .5)*1e6,
+               percentile(lat, n, .9)*1e6, percentile(lat, n, .99)*1e6,
+               percentile(lat, n, .999)*1e6, lat[n-1]*1e6);
+        fflush(stdout);
+    }
+    free(lat);
+}
+
+static void distribution(void) {
+    calibrate();
+    for( WAIT_POLICY = ACH_WAIT_BLOCK; WAIT_POLICY <= ACH_WAIT_POLL; WAIT_POLICY++ ) {
+        setup_ach();
+        /* Start the sender first.  Once a polling receiver runs, it
+         * may keep us off the CPU. */
+        pid_t pid_send = fork();
+        assert( pid_send >= 0 );
+        if( 0 == pid_send ) {
+            sender_ach();
+            exit(0);
+        }
+        pid_t pid_recv = fork();
+        assert( pid_recv >= 0 );
+        if( 0 == pid_recv ) {
+            latency_receiver();
+            exit(0);
+        }
+        int status;
+        waitpid( pid_send, &status, 0 );
+        waitpid( pid_recv, &status, 0 );
+        ach_close(&chan);
+        destroy_ach();
+    }
+}
+
 /*****************/
 /* PIPE BENCHING */
 /*****************/
@@ -301,7 +645,7 @@ int main(int argc, char **argv) {
 
     struct vtab *vt = &vtab_ach;
 
-    while( (c = getopt( argc, argv, "f:s:p:r:l:gPhH?V")) != -1 ) {
+    while( (c = getopt( argc, argv, "f:s:p:r:l:w:S:M:gPFOCXWNRLDZhH?V")) != -1 ) {
         switch(c) {
         case 'f':
             FREQUENCY = strtod(optarg, &endptr);
@@ -327,6 +671,49 @@ int main(int argc, char **argv) {
         case 'P':
             vt = &vtab_pipe;
             break;
+        case 'F':
+            USE_FUTEX = 1;
+            break;
+        case 'O':
+            LAYOUT = ACH_LAYOUT_1;
+            break;
+        case 'C':
+            CONTENTION = 1;
+            break;
+        case 'X':
+            FIXED = 1;
+            break;
+        case 'W':
+            SINGLE_WRITER = 1;
+            break;
+        case 'N':
+            NO_STATS = 1;
+            break;
+        case 'R':
+            READERS = 1;
+            break;
+        case 'L':
+            LOCK_TIMES = 1;
+            break;
+        case 'w':
+            for( WAIT_POLICY = ACH_WAIT_POLL; WAIT_POLICY > ACH_WAIT_BLOCK; WAIT_POLICY-- ) {
+                if( 0 == strcmp(optarg, policy_name[WAIT_POLICY]) ) break;
+            }
+            break;
+        case 'S':
+            SPIN_NS = strtoull(optarg, &endptr, 10);
+            assert(endptr);
+            break;
+        case 'D':
+            DISTRIBUTION = 1;
+            break;
+        case 'Z':
+            STREAM_SWEEP = 1;
+            break;
+        case 'M':
+            MULTI_PUT_SIZE = (size_t)strtoul(optarg, &endptr, 10);
+            assert(MULTI_PUT_SIZE);
+            break;
         case 'V':   /* version     */
             ach_print_version("achbench");
             exit(EXIT_SUCCESS);
@@ -347,6 +734,28 @@ int main(int argc, char **argv) {
                  "  -l COUNT,           Non-Real-Time Receivers (0)\n"
                  "  -g,                 Proceed even if real-time setup fails\n"
                  "  -P,                 Benchmark pipes instead of ach\n"
+                 "  -F,                 Wait on a futex instead of a condition variable\n"
+                 "  -O,                 Use the original channel layout\n"
+                 "  -X,                 Use a channel with fixed-size frames\n"
+                 "  -W,                 Use a single-writer channel, whose puts skip\n"
+                 "                      the mutex (needs -p 1)\n"
+                 "  -N,                 Create the channel without statistics\n"
+                 "  -R,                 Keep a reader table, where gets count\n"
+                 "                      themselves\n"
+                 "  -L,                 Time how long puts hold the lock\n"
+                 "  -C,                 Measure put and polling get throughput for SECONDS\n"
+                 "                      instead of latency, with all receivers polling\n"
+                 "  -w POLICY,          Wait with POLICY: block, spin or poll (block)\n"
+                 "  -S NSEC,            Nanoseconds the spin policy polls before\n"
+                 "                      sleeping (50000)\n"
+                 "  -D,                 Print latency percentiles for each wait policy\n"
+                 "                      in turn, rather than every sample\n"
+                 "  -M SIZE,            Measure put throughput of 1 to 16 publishers\n"
+                 "                      putting SIZE-byte frames for SECONDS each,\n"
+                 "                      with and without multi_put\n"
+                 "  -Z,                 Sweep frame sizes from 4 KiB to 32 MiB, timing\n"
+                 "                      memcpy() against streaming copies for SECONDS\n"
+                 "                      each, to choose ach_attr_t.stream_min\n"
                 );
             exit(EXIT_SUCCESS);
         }
@@ -356,9 +765,36 @@ int main(int argc, char **argv) {
     fprintf(stderr, "-s %.2f ", SECS);
     fprintf(stderr, "-r %"PRIuPTR" ", RECV_RT);
     fprintf(stderr, "-l %"PRIuPTR" ", RECV_NRT);
-    fprintf(stderr, "-p %"PRIuPTR"\n", SEND_RT);
+    fprintf(stderr, "-p %"PRIuPTR"%s%s%s%s%s%s%s -w %s\n", SEND_RT, USE_FUTEX ? " -F" : "",
+            (ACH_LAYOUT_1 == LAYOUT) ? " -O" : "", FIXED ? " -X" : "",
+            SINGLE_WRITER ? " -W" : "", NO_STATS ? " -N" : "",
+            READERS ? " -R" : "", LOCK_TIMES ? " -L" : "", policy_name[WAIT_POLICY]);
+    if( SINGLE_WRITER && (SEND_RT > 1 || ACH_LAYOUT_1 == LAYOUT) ) {
+        fprintf(stderr, "-W needs one publisher and the default layout\n");
+        exit(EXIT_FAILURE);
+    }
     size_t i;
 
+    if( CONTENTION ) {
+        contention();
+        exit(0);
+    }
+
+    if( DISTRIBUTION ) {
+        distribution();
+        exit(0);
+    }
+
+    if( MULTI_PUT_SIZE ) {
+        publishers();
+        exit(0);
+    }
+
+    if( STREAM_SWEEP ) {
+        stream_sweep();
+        exit(0);
+    }
+
     init_time_chan();
 
 
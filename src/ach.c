@@ -54,6 +54,8 @@
 #endif
 
 #include <time.h>
+#include <signal.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <sys/mman.h>
@@ -61,15 +63,38 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/uio.h>
 
 #include <string.h>
 #include <inttypes.h>
 
+#ifdef __linux__
+#include <limits.h>
+#include <stddef.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#define ACH_HAVE_FUTEX
+#define ACH_HAVE_POLLFD
+#ifdef SYS_memfd_create
+#define ACH_HAVE_MEMFD
+#endif
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <immintrin.h>
+#define ACH_HAVE_STREAM_COPY
+#endif
+
 #include "ach.h"
 
 
@@ -90,14 +115,377 @@
 size_t ach_channel_size = sizeof(ach_channel_t);
 size_t ach_attr_size = sizeof(ach_attr_t);
 
+/** Number of times to retry a lock-free read before falling back to
+ * the channel mutex */
+#define ACH_OPTIMISTIC_RETRY 64
+
+/** Pauses between clock reads when ach_get() spins on last_seq */
+#define ACH_SPIN_CLOCK_CHECK 16
+
+/** Internal status: ach_resize() replaced the channel while we
+ * waited for it, so follow the handle to the new channel and start
+ * over.  Never returned to callers. */
+#define ACH_RESIZED ((enum ach_status)0x100)
+
+/** Internal status: a get raced puts to an ACH_HEADER_MULTI_PUT or
+ * ACH_HEADER_SINGLE_WRITER channel, where the read lock can't keep
+ * them away, so start over.  Never returned to callers. */
+#define ACH_AGAIN ((enum ach_status)0x101)
+
+/** Pauses a put to an ACH_HEADER_MULTI_PUT channel spins waiting on
+ * the puts ahead of it before it sleeps on the futex */
+#define ACH_PUT_SPIN 128
+
+/** How long a put to an ACH_HEADER_MULTI_PUT channel sleeps between
+ * checks that the put it waits on is still alive, in nanoseconds */
+#define ACH_PUT_CHECK_NS 10000000L
+
+/** Hint to the CPU that we are in a spin loop */
+static inline void cpu_relax( void ) {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* Streaming copies
+ * ----------------
+ *
+ * A put of a multi-megabyte frame, such as a camera image, would
+ * otherwise fill the publisher's cache with data it never reads
+ * again.  Frames of at least ach_attr_t.stream_min bytes are instead
+ * copied with non-temporal stores, using the widest vectors the CPU
+ * has.  Each kernel ends with a store fence, so the frame is in
+ * memory before publish_index() makes it visible.
+ */
+
+#ifdef ACH_HAVE_STREAM_COPY
+
+__attribute__((target("sse2")))
+static void
+stream_copy_sse2( uint8_t *dst, const uint8_t *src, size_t n ) {
+    size_t head = (size_t)(-(uintptr_t)dst & 15);
+    if( n < head + 64 ) {
+        memcpy( dst, src, n );
+        return;
+    }
+    memcpy( dst, src, head );
+    dst += head; src += head; n -= head;
+    for( ; n >= 64; n -= 64, dst += 64, src += 64 ) {
+        __m128i a = _mm_loadu_si128( (const __m128i*)src );
+        __m128i b = _mm_loadu_si128( (const __m128i*)src + 1 );
+        __m128i c = _mm_loadu_si128( (const __m128i*)src + 2 );
+        __m128i d = _mm_loadu_si128( (const __m128i*)src + 3 );
+        _mm_stream_si128( (__m128i*)dst, a );
+        _mm_stream_si128( (__m128i*)dst + 1, b );
+        _mm_stream_si128( (__m128i*)dst + 2, c );
+        _mm_stream_si128( (__m128i*)dst + 3, d );
+    }
+    _mm_sfence();
+    memcpy( dst, src, n );
+}
+
+__attribute__((target("avx2")))
+static void
+stream_copy_avx2( uint8_t *dst, const uint8_t *src, size_t n ) {
+    size_t head = (size_t)(-(uintptr_t)dst & 31);
+    if( n < head + 128 ) {
+        memcpy( dst, src, n );
+        return;
+    }
+    memcpy( dst, src, head );
+    dst += head; src += head; n -= head;
+    for( ; n >= 128; n -= 128, dst += 128, src += 128 ) {
+        __m256i a = _mm256_loadu_si256( (const __m256i*)src );
+        __m256i b = _mm256_loadu_si256( (const __m256i*)src + 1 );
+        __m256i c = _mm256_loadu_si256( (const __m256i*)src + 2 );
+        __m256i d = _mm256_loadu_si256( (const __m256i*)src + 3 );
+        _mm256_stream_si256( (__m256i*)dst, a );
+        _mm256_stream_si256( (__m256i*)dst + 1, b );
+        _mm256_stream_si256( (__m256i*)dst + 2, c );
+        _mm256_stream_si256( (__m256i*)dst + 3, d );
+    }
+    _mm_sfence();
+    memcpy( dst, src, n );
+}
+
+__attribute__((target("avx512f")))
+static void
+stream_copy_avx512( uint8_t *dst, const uint8_t *src, size_t n ) {
+    size_t head = (size_t)(-(uintptr_t)dst & 63);
+    if( n < head + 256 ) {
+        memcpy( dst, src, n );
+        return;
+    }
+    memcpy( dst, src, head );
+    dst += head; src += head; n -= head;
+    for( ; n >= 256; n -= 256, dst += 256, src += 256 ) {
+        __m512i a = _mm512_loadu_si512( (const void*)src );
+        __m512i b = _mm512_loadu_si512( (const void*)(src + 64) );
+        __m512i c = _mm512_loadu_si512( (const void*)(src + 128) );
+        __m512i d = _mm512_loadu_si512( (const void*)(src + 192) );
+        _mm512_stream_si512( (void*)dst, a );
+        _mm512_stream_si512( (void*)(dst + 64), b );
+        _mm512_stream_si512( (void*)(dst + 128), c );
+        _mm512_stream_si512( (void*)(dst + 192), d );
+    }
+    _mm_sfence();
+    memcpy( dst, src, n );
+}
+
+/** The best kernel for this CPU, or NULL to always memcpy() */
+static void (*stream_copy)( uint8_t *dst, const uint8_t *src, size_t n );
+static pthread_once_t stream_once = PTHREAD_ONCE_INIT;
+
+static void
+stream_init( void ) {
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx512f") ) stream_copy = stream_copy_avx512;
+    else if( __builtin_cpu_supports("avx2") ) stream_copy = stream_copy_avx2;
+    else if( __builtin_cpu_supports("sse2") ) stream_copy = stream_copy_sse2;
+}
+
+#endif /* ACH_HAVE_STREAM_COPY */
+
+/** Copies n bytes of a frame, streaming past the cache if stream */
+static inline void
+copy_bytes( uint8_t *dst, const void *src, size_t n, bool stream ) {
+#ifdef ACH_HAVE_STREAM_COPY
+    if( stream && stream_copy ) {
+        stream_copy( dst, (const uint8_t*)src, n );
+        return;
+    }
+#else
+    (void)stream;
+#endif
+    memcpy( dst, src, n );
+}
+
+/** The frame size from which chan copies with non-temporal stores */
+static inline size_t
+stream_min( const ach_channel_t *chan ) {
+    return chan->attr.stream_min ? chan->attr.stream_min : ACH_DEFAULT_STREAM_MIN;
+}
+
+
+static uint64_t
+timespec_ns( const struct timespec *ts ) {
+    if( ts->tv_sec < 0 ) return 0;
+    return (uint64_t)ts->tv_sec * 1000000000u + (uint64_t)ts->tv_nsec;
+}
+
+static uint64_t
+clock_ns( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return timespec_ns( &ts );
+}
+
+/* Tracing
+ * -------
+ *
+ * Built with ACH_TRACE defined, the lock, wait, copy and eviction
+ * paths record tracepoints into a ring shared by the threads of the
+ * process, which ach_trace_dump() writes out as Chrome trace JSON.
+ * Each tracepoint takes a slot with one atomic add and reads the
+ * monotonic clock.  ACH_TRACE_MASK picks which kinds are compiled
+ * in.  Without ACH_TRACE, TRACE() expands to nothing.
+ */
+
+/** Tracepoint kinds, for ACH_TRACE_MASK */
+#define ACH_TRACE_LOCKS  0x01   /**< mutex acquire, hold and release */
+#define ACH_TRACE_WAITS  0x02   /**< gets sleeping or spinning for a frame */
+#define ACH_TRACE_COPIES 0x04   /**< frames copied in and out */
+#define ACH_TRACE_EVICTS 0x08   /**< frames evicted by puts */
+
+#ifndef ACH_TRACE_MASK
+#define ACH_TRACE_MASK 0x0f
+#endif
+
+/** Tracepoints kept per process; a power of two */
+#ifndef ACH_TRACE_RECORDS
+#define ACH_TRACE_RECORDS 65536
+#endif
+
+/** Channel mappings whose names the dumper can show */
+#ifndef ACH_TRACE_NAMES
+#define ACH_TRACE_NAMES 256
+#endif
+
+enum trace_event {
+    TRACE_ACQUIRE = 1,  /**< about to take the mutex */
+    TRACE_LOCK,         /**< took the mutex; arg is 1 if a condition
+                         *   wait took it back */
+    TRACE_UNLOCK,       /**< released the mutex */
+    TRACE_WAIT_BEGIN,   /**< arg is an enum trace_wait */
+    TRACE_WAIT_END,     /**< arg is the enum ach_status of the wait */
+    TRACE_COPY_BEGIN,   /**< arg is the bytes to copy */
+    TRACE_COPY_END,
+    TRACE_EVICT         /**< arg is the frames evicted */
+};
+
+enum trace_wait {
+    TRACE_WAIT_COND,
+    TRACE_WAIT_FUTEX,
+    TRACE_WAIT_SPIN
+};
+
+#ifdef ACH_TRACE
+
+struct trace_record {
+    uint64_t seq;       /**< position in the ring plus one, once written */
+    uint64_t ns;        /**< CLOCK_MONOTONIC */
+    uint64_t arg;
+    const ach_header_t *shm;
+    uint32_t tid;
+    uint32_t event;     /**< an enum trace_event */
+};
+
+static struct trace_record trace_ring[ACH_TRACE_RECORDS];
+static uint64_t trace_head;
+
+/** Where ach_trace_clear() left the ring */
+static uint64_t trace_base;
+
+/** Names of open and recently closed channels, by mapping */
+static struct {
+    const ach_header_t *shm;
+    unsigned open;      /**< handles open on the mapping */
+    char name[1+ACH_CHAN_NAME_MAX];
+} trace_names[ACH_TRACE_NAMES];
+static unsigned trace_name_next;    /**< next slot to try replacing */
+static pthread_mutex_t trace_names_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+static __thread uint32_t trace_tid;
+
+static uint32_t
+trace_thread( void ) {
+    if( 0 == trace_tid ) {
+#ifdef SYS_gettid
+        trace_tid = (uint32_t)syscall( SYS_gettid );
+#else
+        trace_tid = (uint32_t)(uintptr_t)pthread_self();
+#endif
+    }
+    return trace_tid;
+}
+
+static void
+trace( enum trace_event event, const ach_header_t *shm, uint64_t arg ) {
+    uint64_t i = __atomic_fetch_add( &trace_head, 1, __ATOMIC_RELAXED );
+    struct trace_record *t = &trace_ring[i % ACH_TRACE_RECORDS];
+    /* seqlock-style, in case the dumper is looking at this slot */
+    __atomic_store_n( &t->seq, 0, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    t->ns = clock_ns( CLOCK_MONOTONIC );
+    t->arg = arg;
+    t->shm = shm;
+    t->tid = trace_thread();
+    t->event = event;
+    __atomic_store_n( &t->seq, i + 1, __ATOMIC_RELEASE );
+}
+
+#define TRACE( kind, event, shm, arg )                          \
+    do {                                                        \
+        if( ACH_TRACE_MASK & (kind) ) trace( event, shm, arg ); \
+    } while(0)
+
+/** The forked child starts an empty trace of its own */
+static void
+trace_forked( void ) {
+    trace_tid = 0;
+    ach_trace_clear();
+}
+
+/** Writes $ACH_TRACE_FILE.PID.json */
+static void
+trace_exit( void ) {
+    const char *file = getenv( "ACH_TRACE_FILE" );
+    if( NULL == file ) return;
+    char path[4096];
+    snprintf( path, sizeof(path), "%s.%d.json", file, (int)getpid() );
+    int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if( fd < 0 ) {
+        DEBUG_PERROR( "open trace file" );
+        return;
+    }
+    ach_trace_dump( fd );
+    close( fd );
+}
+
+static void
+trace_init( void ) {
+    pthread_atfork( NULL, NULL, trace_forked );
+    if( getenv( "ACH_TRACE_FILE" ) ) atexit( trace_exit );
+}
+
+/** Remembers the name of the channel mapped at shm for
+ * ach_trace_dump() */
+static void
+trace_channel( const ach_header_t *shm ) {
+    pthread_once( &trace_once, trace_init );
+    pthread_mutex_lock( &trace_names_lock );
+    unsigned i, k;
+    /* another handle on the same mapping, or an earlier one at the
+     * same address */
+    for( i = 0; i < ACH_TRACE_NAMES && trace_names[i].shm != shm; i++ );
+    if( ACH_TRACE_NAMES == i ) {
+        /* replace closed channels first, oldest first */
+        for( k = 0; k < ACH_TRACE_NAMES; k++ ) {
+            i = trace_name_next++ % ACH_TRACE_NAMES;
+            if( 0 == trace_names[i].open ) break;
+        }
+        trace_names[i].shm = shm;
+        trace_names[i].open = 0;
+    }
+    if( 0 == trace_names[i].open ) {
+        memcpy( trace_names[i].name, shm->name, sizeof(trace_names[i].name) );
+        trace_names[i].name[ACH_CHAN_NAME_MAX] = '\0';
+    }
+    trace_names[i].open++;
+    pthread_mutex_unlock( &trace_names_lock );
+}
+
+/** Notes that a handle on the channel mapped at shm closed.  Its
+ * name stays until the slot is needed for another channel. */
+static void
+trace_unchannel( const ach_header_t *shm ) {
+    pthread_mutex_lock( &trace_names_lock );
+    unsigned i;
+    for( i = 0; i < ACH_TRACE_NAMES; i++ ) {
+        if( trace_names[i].shm == shm && trace_names[i].open ) {
+            trace_names[i].open--;
+            break;
+        }
+    }
+    pthread_mutex_unlock( &trace_names_lock );
+}
+
+#else /* ACH_TRACE */
+
+/* no code, but the arguments still count as used */
+#define TRACE( kind, event, shm, arg ) ((void)sizeof(shm), (void)sizeof(arg))
+
+#endif /* ACH_TRACE */
 
 
+/** Whether ach_resize() has replaced the channel */
+static inline bool resized( ach_header_t *shm ) {
+    return __atomic_load_n( &shm->flags, __ATOMIC_ACQUIRE ) & ACH_HEADER_RESIZED;
+}
+
+/** Whether puts to the channel skip the mutex, so that gets must
+ * never rely on the read lock */
+static inline bool lock_free_puts( ach_header_t *shm ) {
+    return shm->flags & (ACH_HEADER_MULTI_PUT | ACH_HEADER_SINGLE_WRITER);
+}
+
 static size_t oldest_index_i( ach_header_t *shm ) {
-    return (shm->index_head + shm->index_free)%shm->index_cnt;
+    return (ACH_SHM_HOT(shm, index_head) + ACH_SHM_HOT(shm, index_free))%shm->index_cnt;
 }
 
 static size_t last_index_i( ach_header_t *shm ) {
-    return (shm->index_head + shm->index_cnt -1)%shm->index_cnt;
+    return (ACH_SHM_HOT(shm, index_head) + shm->index_cnt -1)%shm->index_cnt;
 }
 
 const char *ach_result_to_string(ach_status_t result) {
@@ -120,6 +508,7 @@ const char *ach_result_to_string(ach_status_t result) {
     case ACH_BAD_HEADER: return "ACH_BAD_HEADER";
     case ACH_EACCES: return "ACH_EACCES";
     case ACH_CANCELED: return "ACH_CANCELED";
+    case ACH_OVERWRITTEN: return "ACH_OVERWRITTEN";
     }
     return "UNKNOWN";
 
@@ -137,7 +526,7 @@ check_errno() {
 
 static enum ach_status
 check_guards( ach_header_t *shm ) {
-    if( ACH_SHM_MAGIC_NUM != shm->magic ||
+    if( (ACH_SHM_MAGIC_NUM != shm->magic && ACH_SHM_MAGIC_NUM_V2 != shm->magic) ||
         ACH_SHM_GUARD_HEADER_NUM != *ACH_SHM_GUARD_HEADER(shm) ||
         ACH_SHM_GUARD_INDEX_NUM != *ACH_SHM_GUARD_INDEX(shm) ||
         ACH_SHM_GUARD_DATA_NUM != *ACH_SHM_GUARD_DATA(shm)  )
@@ -178,27 +567,150 @@ shmfile_for_channel_name( const char *name, char *buf, size_t n ) {
     return ACH_OK;
 }
 
-/** Opens shm file descriptor for a channel.
-    \pre name is a valid channel name
+/** Path of a channel's file on hugetlbfs */
+#define ACH_HUGEFILE_MAX (sizeof(ACH_HUGETLBFS_DIR) + ACH_CHAN_NAME_MAX + 16)
+
+static void
+hugefile_for_channel_name( const char *shm_name, char *buf, size_t n ) {
+    snprintf( buf, n, "%s%s", ACH_HUGETLBFS_DIR, shm_name );
+}
+
+/** Path of a shm file in the file system, for rename() and unlink() */
+#define ACH_SHMPATH_MAX (sizeof(ACH_SHM_DIR) + ACH_HUGEFILE_MAX)
+
+static void
+shmpath_for_shmfile( const char *shm_name, int huge, char *buf, size_t n ) {
+    if( huge ) hugefile_for_channel_name( shm_name, buf, n );
+    else snprintf( buf, n, "%s%s", ACH_SHM_DIR, shm_name );
+}
+
+/** Opens the shm file shm_name.
+
+    Files not found in shm are looked for on hugetlbfs.
+
+    \param huge if true on entry, create on hugetlbfs.  On exit, whether
+    the file is on hugetlbfs.
 */
-static int fd_for_channel_name( const char *name, int oflag ) {
-    char shm_name[ACH_CHAN_NAME_MAX + 16];
-    int r = shmfile_for_channel_name( name, shm_name, sizeof(shm_name) );
-    if( 0 != r ) return ACH_BUG;
+static int fd_for_shmfile( const char *shm_name, int oflag, int *huge ) {
+    char huge_name[ACH_HUGEFILE_MAX];
+    hugefile_for_channel_name( shm_name, huge_name, sizeof(huge_name) );
     int fd;
     int i = 0;
+    if( ! *huge ) {
+        do {
+            fd = shm_open( shm_name, O_RDWR | oflag, 0666 );
+        }while( -1 == fd && EINTR == errno && i++ < ACH_INTR_RETRY);
+        if( fd >= 0 || ENOENT != errno || (oflag & O_CREAT) ) return fd;
+    }
+    i = 0;
     do {
-        fd = shm_open( shm_name, O_RDWR | oflag, 0666 );
+        fd = open( huge_name, O_RDWR | oflag, 0666 );
     }while( -1 == fd && EINTR == errno && i++ < ACH_INTR_RETRY);
+    if( fd >= 0 ) *huge = 1;
     return fd;
 }
 
+/** Opens shm file descriptor for a channel.
+
+    \pre name is a valid channel name
+    \param huge as for fd_for_shmfile()
+*/
+static int fd_for_channel_name( const char *name, int oflag, int *huge ) {
+    char shm_name[ACH_CHAN_NAME_MAX + 16];
+    int r = shmfile_for_channel_name( name, shm_name, sizeof(shm_name) );
+    if( 0 != r ) return ACH_BUG;
+    return fd_for_shmfile( shm_name, oflag, huge );
+}
+
+/** Creates the memory file for a channel created with
+    ach_create_attr_t.memfd */
+static int memfd_for_channel_name( const char *name, int huge ) {
+#ifdef ACH_HAVE_MEMFD
+    unsigned flags = MFD_CLOEXEC;
+    if( huge ) flags |= MFD_HUGETLB;
+    return (int)syscall( SYS_memfd_create, name, flags );
+#else
+    (void)name; (void)huge;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/** Page size of the file system holding fd */
+static size_t map_align( int fd ) {
+    struct statvfs st;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if( 0 == fstatvfs( fd, &st ) && st.f_bsize > page ) return st.f_bsize;
+    return page;
+}
+
+/** Maps the file_len bytes of an ACH_HEADER_MIRROR channel with a
+ * second copy of its data array right after the first.  The data
+ * array must start and end on page boundaries.  Returns the start of
+ * file_len + data_size bytes of address space, or MAP_FAILED. */
+static void *map_mirror( int fd, size_t file_len,
+                         size_t data_offset, size_t data_size ) {
+    const size_t len = file_len + data_size;
+    const size_t front = data_offset + data_size;
+    /* reserve the whole range so nothing else lands in between */
+    uint8_t *p = (uint8_t*)mmap( NULL, len, PROT_NONE,
+                                 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+    if( MAP_FAILED == p ) return MAP_FAILED;
+    const int prot = PROT_READ|PROT_WRITE;
+    const int flags = MAP_SHARED|MAP_FIXED;
+    if( MAP_FAILED == mmap( p, front, prot, flags, fd, 0 ) ||
+        MAP_FAILED == mmap( p + front, data_size, prot, flags, fd,
+                            (off_t)data_offset ) ||
+        MAP_FAILED == mmap( p + front + data_size, file_len - front, prot, flags, fd,
+                            (off_t)front ) )
+    {
+        int e = errno;
+        munmap( p, len );
+        errno = e;
+        return MAP_FAILED;
+    }
+    return p;
+}
+
+/** Faults in every page of a mapping */
+static void prefault( void *addr, size_t len ) {
+#ifdef MADV_POPULATE_WRITE
+    if( 0 == madvise( addr, len, MADV_POPULATE_WRITE ) ) return;
+#endif
+    /* A read fault maps shm pages writable, since nothing tracks
+     * their dirtiness */
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const volatile uint8_t *p = (const volatile uint8_t*)addr;
+    size_t i;
+    for( i = 0; i < len; i += page ) (void)p[i];
+}
+
+static void advise_huge( void *addr, size_t len ) {
+#ifdef MADV_HUGEPAGE
+    if( madvise( addr, len, MADV_HUGEPAGE ) ) DEBUG_PERROR("madvise");
+#else
+    (void)addr; (void)len;
+#endif
+}
+
 
 
 /*! \page synchronization Synchronization
  *
- * Synchronization currently uses a simple mutex+condition variable
- * around the whole shared memory block
+ * Writers and waiting readers use a simple mutex+condition variable
+ * around the whole shared memory block.
+ *
+ * Readers that do not need to wait copy frames without the mutex,
+ * seqlock-style.  The writer zeroes the seq_num of every index entry
+ * whose data it is about to overwrite before touching the data, and
+ * stores the seq_num of a new entry only after its data is written.
+ * A reader snapshots an index entry, copies the frame, and then
+ * checks that the entry still holds the same seq_num.  If not, the
+ * frame was overwritten during the copy and the reader retries,
+ * falling back to the mutex after ACH_OPTIMISTIC_RETRY attempts.
+ * Frames already published stay readable while a put is in progress,
+ * including one held open by ach_put_reserve(), so these readers only
+ * consult the dirty bit to notice a writer that died.
  *
  * Some idea for more complicated synchronization:
  *
@@ -230,6 +742,443 @@ static int fd_for_channel_name( const char *name, int oflag ) {
  * - Use eventfd to signal new data
  */
 
+#ifdef ACH_HAVE_FUTEX
+static long
+futex( uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout ) {
+    return syscall( SYS_futex, uaddr, op, val, timeout, NULL,
+                    FUTEX_BITSET_MATCH_ANY );
+}
+#endif
+
+/** Bumps the futex word and wakes any readers waiting on it.
+
+    Puts bump the futex after publishing last_seq and readers
+    increment futex_waiters before reading the futex, so either the
+    reader sees the new frame or we see the waiter.
+*/
+static enum ach_status
+futex_wake( ach_header_t *shm ) {
+#ifdef ACH_HAVE_FUTEX
+    __atomic_add_fetch( &ACH_SHM_HOT(shm, futex), 1, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &ACH_SHM_HOT(shm, futex_waiters), __ATOMIC_SEQ_CST ) &&
+        -1 == futex( &ACH_SHM_HOT(shm, futex), FUTEX_WAKE, INT_MAX, NULL ) )
+    {
+        return ACH_FAILED_SYSCALL;
+    }
+    return ACH_OK;
+#else
+    (void)shm;
+    return ACH_BUG;
+#endif
+}
+
+/** Waits on the futex until chan has an unseen frame.
+
+    \pre mutex is not held
+*/
+static enum ach_status
+futex_wait( ach_channel_t *chan, const struct timespec *abstime ) {
+#ifdef ACH_HAVE_FUTEX
+    ach_header_t *shm = chan->shm;
+    int op = FUTEX_WAIT_BITSET;
+    if( CLOCK_REALTIME == shm->clock ) op |= FUTEX_CLOCK_REALTIME;
+
+    enum ach_status r = ACH_OK;
+    TRACE( ACH_TRACE_WAITS, TRACE_WAIT_BEGIN, shm, TRACE_WAIT_FUTEX );
+    __atomic_add_fetch( &ACH_SHM_HOT(shm, futex_waiters), 1, __ATOMIC_SEQ_CST );
+    for(;;) {
+        uint32_t val = __atomic_load_n( &ACH_SHM_HOT(shm, futex), __ATOMIC_SEQ_CST );
+        if( chan->cancel ) {
+            r = ACH_CANCELED;
+            break;
+        }
+        if( chan->seq_num != __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE ) ) {
+            break;
+        }
+        if( resized( shm ) ) {
+            r = ACH_RESIZED;
+            break;
+        }
+        /* sleeps only if nothing has been put since we read val */
+        if( -1 == futex( &ACH_SHM_HOT(shm, futex), op, val, abstime ) ) {
+            if( ETIMEDOUT == errno ) {
+                r = ACH_TIMEOUT;
+                break;
+            } else if( EAGAIN != errno && EINTR != errno ) {
+                r = ACH_FAILED_SYSCALL;
+                break;
+            }
+        }
+    }
+    __atomic_sub_fetch( &ACH_SHM_HOT(shm, futex_waiters), 1, __ATOMIC_SEQ_CST );
+    TRACE( ACH_TRACE_WAITS, TRACE_WAIT_END, shm, r );
+    return r;
+#else
+    (void)chan; (void)abstime;
+    return ACH_BUG;
+#endif
+}
+
+/** Polls last_seq for spin_wait() */
+static enum ach_status
+spin_poll( ach_channel_t *chan, const struct timespec *abstime ) {
+    ach_header_t *shm = chan->shm;
+    const int policy = chan->attr.wait_policy;
+
+    /* both in the clock of abstime */
+    const uint64_t deadline = abstime ? timespec_ns( abstime ) : UINT64_MAX;
+    uint64_t spin_until = UINT64_MAX;
+    if( ACH_WAIT_SPIN == policy ) {
+        spin_until = clock_ns( shm->clock ) +
+            (chan->attr.spin_ns ? chan->attr.spin_ns : ACH_DEFAULT_SPIN_NS);
+    }
+
+    unsigned i;
+    for( i = 0; ; i++ ) {
+        if( chan->seq_num != __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE ) ) {
+            return ACH_OK;
+        }
+        if( chan->cancel ) return ACH_CANCELED;
+        /* the clock costs more than a pause, so look now and then */
+        if( 0 == i % ACH_SPIN_CLOCK_CHECK ) {
+            if( resized( shm ) ) return ACH_RESIZED;
+            uint64_t now = clock_ns( shm->clock );
+            if( now >= deadline ) return ACH_TIMEOUT;
+            if( now >= spin_until ) return ACH_STALE_FRAMES;
+        }
+        cpu_relax();
+    }
+}
+
+/** Polls last_seq before a get with ACH_O_WAIT goes to sleep, as
+    ach_attr_t.wait_policy asks.
+
+    \pre mutex is not held
+
+    \return ACH_OK once chan has an unseen frame, ACH_STALE_FRAMES if
+    the caller should go on to sleep, ACH_TIMEOUT or ACH_CANCELED.
+*/
+static enum ach_status
+spin_wait( ach_channel_t *chan, const struct timespec *abstime ) {
+    const int policy = chan->attr.wait_policy;
+    if( ACH_WAIT_SPIN != policy && ACH_WAIT_POLL != policy ) return ACH_STALE_FRAMES;
+
+    TRACE( ACH_TRACE_WAITS, TRACE_WAIT_BEGIN, chan->shm, TRACE_WAIT_SPIN );
+    enum ach_status r = spin_poll( chan, abstime );
+    TRACE( ACH_TRACE_WAITS, TRACE_WAIT_END, chan->shm, r );
+    return r;
+}
+
+/** Bumps the futex of a channel that waits on its condition
+    variable, so ach_wait_any() callers see the change.
+*/
+static enum ach_status
+wake_any( ach_header_t *shm ) {
+#ifdef ACH_HAVE_FUTEX
+    return futex_wake( shm );
+#else
+    (void)shm;
+    return ACH_OK;
+#endif
+}
+
+#ifdef ACH_HAVE_POLLFD
+/** Socket puts send notifications from, shared by all channels */
+static int pollfd_sock = -1;
+static pthread_once_t pollfd_once = PTHREAD_ONCE_INIT;
+
+static void
+pollfd_sock_init( void ) {
+    pollfd_sock = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+}
+
+/** Fills addr with the abstract socket name for a registry slot */
+static socklen_t
+pollfd_addr( struct sockaddr_un *addr, uint64_t slot ) {
+    memset( addr, 0, sizeof(*addr) );
+    addr->sun_family = AF_UNIX;
+    int n = snprintf( addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+                      "ach-pollfd/%"PRIu32"/%"PRIu32,
+                      (uint32_t)(slot >> 32), (uint32_t)slot );
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+/** Sends a datagram to every registered descriptor.
+
+    Best effort: a full socket is already readable, and slots of
+    subscribers that are gone get freed.
+*/
+static void
+pollfd_signal( ach_header_t *shm ) {
+    ach_pollfd_registry_t *reg = ACH_SHM_POLLFD(shm);
+    if( 0 == __atomic_load_n( &reg->cnt, __ATOMIC_ACQUIRE ) ) return;
+
+    pthread_once( &pollfd_once, pollfd_sock_init );
+    if( pollfd_sock < 0 ) return;
+
+    int errno_save = errno;
+    size_t i;
+    for( i = 0; i < ACH_POLLFD_MAX; i++ ) {
+        uint64_t slot = __atomic_load_n( &reg->slot[i], __ATOMIC_ACQUIRE );
+        if( 0 == slot ) continue;
+        struct sockaddr_un addr;
+        socklen_t len = pollfd_addr( &addr, slot );
+        if( sendto( pollfd_sock, "", 1, MSG_DONTWAIT | MSG_NOSIGNAL,
+                    (struct sockaddr*)&addr, len ) < 0 &&
+            (ECONNREFUSED == errno || ENOENT == errno) &&
+            __atomic_compare_exchange_n( &reg->slot[i], &slot, 0, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+        {
+            __atomic_sub_fetch( &reg->cnt, 1, __ATOMIC_RELEASE );
+        }
+    }
+    errno = errno_save;
+}
+#endif
+
+/** Notifies pollable descriptors of a new frame */
+static void
+pollfd_notify( ach_header_t *shm ) {
+#ifdef ACH_HAVE_POLLFD
+    if( shm->flags & ACH_HEADER_POLLFD ) pollfd_signal( shm );
+#else
+    (void)shm;
+#endif
+}
+
+static uint64_t
+stats_now( void ) {
+    return clock_ns( ACH_STATS_CLOCK );
+}
+
+/** Adds n to a publisher counter.
+
+    \pre hold write lock, so plain read-modify-write is enough.
+    Samplers read without the lock, hence the atomic store.
+*/
+static inline void
+stats_put_add( uint64_t *counter, uint64_t n ) {
+    __atomic_store_n( counter, *counter + n, __ATOMIC_RELAXED );
+}
+
+/** Notes the time the write lock was taken */
+static void
+stats_locked( ach_header_t *shm ) {
+    if( shm->flags & ACH_HEADER_LOCK_TIMES ) {
+        __atomic_store_n( &ACH_SHM_STATS(shm)->lock_start_ns, stats_now(),
+                          __ATOMIC_RELAXED );
+    }
+}
+
+/** Accounts for how long the write lock was held
+
+    \pre hold write lock
+*/
+static void
+stats_unlocking( ach_header_t *shm ) {
+    if( shm->flags & ACH_HEADER_LOCK_TIMES ) {
+        ach_stats_t *stats = ACH_SHM_STATS(shm);
+        uint64_t held = stats_now() - stats->lock_start_ns;
+        stats_put_add( &stats->lock_ns, held );
+        if( held > stats->lock_max_ns ) {
+            __atomic_store_n( &stats->lock_max_ns, held, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+/** Counts a frame evicted before any get returned it
+
+    \pre hold write lock
+*/
+static inline void
+stats_evicted( ach_header_t *shm, uint64_t seq_num ) {
+    if( shm->flags & ACH_HEADER_STATS ) {
+        ach_stats_t *stats = ACH_SHM_STATS(shm);
+        if( seq_num > __atomic_load_n( &stats->read_seq, __ATOMIC_RELAXED ) ) {
+            stats_put_add( &stats->overwritten, 1 );
+        }
+    }
+}
+
+/** Notes that a get returned frames through seq_num.
+
+    Only the first get of each frame writes, so subscribers keeping up
+    with the publisher share the line instead of bouncing it.  Their
+    own counts go in the reader table, see reader_got().
+*/
+static void
+stats_read( ach_header_t *shm, uint64_t seq_num ) {
+    if( ! (shm->flags & ACH_HEADER_STATS) ) return;
+    ach_stats_t *stats = ACH_SHM_STATS(shm);
+    uint64_t read_seq = __atomic_load_n( &stats->read_seq, __ATOMIC_RELAXED );
+    while( seq_num > read_seq &&
+           ! __atomic_compare_exchange_n( &stats->read_seq, &read_seq, seq_num, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {}
+}
+
+/** Start time of process pid in clock ticks since boot, from field 22
+    of /proc/<pid>/stat, or 0 if it can't be read */
+static uint64_t
+proc_start( pid_t pid ) {
+#ifdef __linux__
+    char path[32], buf[512];
+    snprintf( path, sizeof(path), "/proc/%d/stat", (int)pid );
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return 0;
+    ssize_t n = read( fd, buf, sizeof(buf) - 1 );
+    close( fd );
+    if( n <= 0 ) return 0;
+    buf[n] = '\0';
+    /* the command name may hold spaces, so count from its ')' */
+    char *p = strrchr( buf, ')' );
+    int field;
+    for( field = 2; field < 22 && p; field++ ) p = strchr( p + 1, ' ' );
+    return p ? strtoull( p + 1, NULL, 10 ) : 0;
+#else
+    (void)pid;
+    return 0;
+#endif
+}
+
+/** Owner word of this process, see ACH_OWNER_PID().  Multi-put
+ * channels record it on every put, so it is read once per process. */
+static uint64_t self_owner;
+
+/** Bumped in the child on fork(), so a forked copy of the single
+ * writer's handle knows it is not the writer */
+static unsigned writer_epoch = 1;
+static pthread_once_t writer_once = PTHREAD_ONCE_INIT;
+
+static void
+writer_forked( void ) {
+    writer_epoch++;
+    self_owner = 0;
+}
+
+static void
+writer_init( void ) {
+    pthread_atfork( NULL, NULL, writer_forked );
+}
+
+/** Owner word for this process, see ACH_OWNER_PID() */
+static uint64_t
+owner_self( void ) {
+    pthread_once( &writer_once, writer_init );
+    uint64_t self = __atomic_load_n( &self_owner, __ATOMIC_RELAXED );
+    if( 0 == self ) {
+        pid_t pid = getpid();
+        int errno_save = errno;
+        uint64_t start = proc_start( pid );
+        errno = errno_save;
+        self = (start << 32) | (uint32_t)pid;
+        __atomic_store_n( &self_owner, self, __ATOMIC_RELAXED );
+    }
+    return self;
+}
+
+int
+ach_owner_dead( uint64_t owner ) {
+    const pid_t pid = ACH_OWNER_PID( owner );
+    const uint32_t start = (uint32_t)(owner >> 32);
+    int errno_save = errno;
+    int dead = ( -1 == kill( pid, 0 ) && ESRCH == errno );
+    /* or someone else has the pid now */
+    if( ! dead && start ) {
+        uint64_t now = proc_start( pid );
+        dead = now && (uint32_t)now != start;
+    }
+    errno = errno_save;
+    return dead;
+}
+
+/** Takes a slot in the reader table for chan: a free one if there is
+    one, else one left by a process that died without closing.  With
+    the table full, chan just goes without. */
+static void
+reader_claim( ach_channel_t *chan ) {
+    ach_reader_t *table = ACH_SHM_READERS(chan->shm);
+    const uint64_t self = owner_self();
+    int pass;
+    for( pass = 0; pass < 2; pass++ ) {
+        size_t i;
+        for( i = 0; i < ACH_READERS_MAX; i++ ) {
+            uint64_t owner = __atomic_load_n( &table[i].owner, __ATOMIC_RELAXED );
+            if( pass ? (0 == owner || ! ach_owner_dead(owner)) : (0 != owner) ) continue;
+            if( __atomic_compare_exchange_n( &table[i].owner, &owner, self, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+            {
+                __atomic_store_n( &table[i].seq_num, chan->seq_num, __ATOMIC_RELAXED );
+                __atomic_store_n( &table[i].got, 0, __ATOMIC_RELAXED );
+                __atomic_store_n( &table[i].missed, 0, __ATOMIC_RELAXED );
+                __atomic_store_n( &table[i].bytes, 0, __ATOMIC_RELAXED );
+                chan->reader = i;
+                return;
+            }
+        }
+    }
+}
+
+/** Frees chan's slot in the reader table */
+static void
+reader_release( ach_channel_t *chan ) {
+    if( SIZE_MAX == chan->reader ) return;
+    __atomic_store_n( &ACH_SHM_READERS(chan->shm)[chan->reader].owner, 0, __ATOMIC_RELEASE );
+    chan->reader = SIZE_MAX;
+}
+
+/** Adds n to a counter of chan's own reader slot, which only chan
+    writes */
+static inline void
+reader_add( uint64_t *counter, uint64_t n ) {
+    __atomic_store_n( counter, *counter + n, __ATOMIC_RELAXED );
+}
+
+/** Counts frames that chan got without moving its place, as
+    ach_get_seq() does */
+static void
+reader_count( ach_channel_t *chan, size_t frames, size_t bytes ) {
+    if( SIZE_MAX == chan->reader ) return;
+    ach_reader_t *rd = ACH_SHM_READERS(chan->shm) + chan->reader;
+    reader_add( &rd->got, frames );
+    reader_add( &rd->bytes, bytes );
+}
+
+/** Publishes that chan got frames through seq_num.
+
+    \pre chan->seq_num is still the last frame of the previous get
+*/
+static void
+reader_got( ach_channel_t *chan, uint64_t seq_num, size_t frames, size_t bytes ) {
+    if( SIZE_MAX == chan->reader ) return;
+    ach_reader_t *rd = ACH_SHM_READERS(chan->shm) + chan->reader;
+    reader_count( chan, frames, bytes );
+    if( seq_num > chan->seq_num + frames ) {
+        reader_add( &rd->missed, seq_num - chan->seq_num - frames );
+    }
+    __atomic_store_n( &rd->seq_num, seq_num, __ATOMIC_RELAXED );
+}
+
+/** Moves the counts of old's reader slot to next's, when a handle
+    follows its channel through ach_resize() */
+static void
+reader_carry( ach_channel_t *next, const ach_channel_t *old ) {
+    if( SIZE_MAX == next->reader || SIZE_MAX == old->reader ) return;
+    const ach_reader_t *from = ACH_SHM_READERS(old->shm) + old->reader;
+    ach_reader_t *to = ACH_SHM_READERS(next->shm) + next->reader;
+    __atomic_store_n( &to->got, from->got, __ATOMIC_RELAXED );
+    __atomic_store_n( &to->missed, from->missed, __ATOMIC_RELAXED );
+    __atomic_store_n( &to->bytes, from->bytes, __ATOMIC_RELAXED );
+}
+
+/** Publishes chan's place after it skips ahead without a get */
+static void
+reader_seek( ach_channel_t *chan ) {
+    if( SIZE_MAX == chan->reader ) return;
+    __atomic_store_n( &ACH_SHM_READERS(chan->shm)[chan->reader].seq_num,
+                      chan->seq_num, __ATOMIC_RELAXED );
+}
+
 static enum ach_status
 check_lock( int lock_result, ach_channel_t *chan, int is_cond_check ) {
     switch( lock_result ) {
@@ -269,8 +1218,18 @@ check_lock( int lock_result, ach_channel_t *chan, int is_cond_check ) {
 
 static enum ach_status
 chan_lock( ach_channel_t *chan ) {
+    TRACE( ACH_TRACE_LOCKS, TRACE_ACQUIRE, chan->shm, 0 );
     int i = pthread_mutex_lock( & chan->shm->sync.mutex );
-    return check_lock( i, chan, 0 );
+    enum ach_status r = check_lock( i, chan, 0 );
+    if( ACH_OK == r ) TRACE( ACH_TRACE_LOCKS, TRACE_LOCK, chan->shm, 0 );
+    return r;
+}
+
+/** Releases the mutex taken with chan_lock() */
+static int
+chan_unlock( ach_header_t *shm ) {
+    TRACE( ACH_TRACE_LOCKS, TRACE_UNLOCK, shm, 0 );
+    return pthread_mutex_unlock( &shm->sync.mutex );
 }
 
 static enum ach_status rdlock(ach_channel_t *chan, int wait,
@@ -284,96 +1243,56 @@ static enum ach_status rdlock(ach_channel_t *chan, int wait,
 
   while (ACH_BUG == r) {
     if (chan->cancel) { /* check operation cancelled */
-      pthread_mutex_unlock(&shm->sync.mutex);
+      chan_unlock(shm);
       r = ACH_CANCELED;
     } else if (!wait)
       r = ACH_OK; /* check no wait */
-    else if (chan->seq_num != shm->last_seq)
+    else if (chan->seq_num != ACH_SHM_HOT(shm, last_seq))
       r = ACH_OK; /* check if got a frame */
-    /* else condition wait */
-    else {
-      int i = abstime ? pthread_cond_timedwait(&shm->sync.cond,
-                                               &shm->sync.mutex, abstime)
-                      : pthread_cond_wait(&shm->sync.cond, &shm->sync.mutex);
-      enum ach_status c = check_lock(i, chan, 1);
+    else if (resized(shm)) { /* no more frames will come here */
+      chan_unlock(shm);
+      r = ACH_RESIZED;
+    } else if (shm->flags & ACH_HEADER_FUTEX) {
+      /* futex wait, without the mutex */
+      chan_unlock(shm);
+      enum ach_status c = futex_wait(chan, abstime);
+      if (ACH_OK == c) c = chan_lock(chan);
       if (ACH_OK != c) r = c;
-      /* check r and condition next iteration */
     }
-  }
-
-  return r;
-}
-
-static enum ach_status rdlock_loud(ach_channel_t *chan, int wait,
-                                   const struct timespec *abstime) {
-  fprintf(stdout, "\n6.1 ");
-  fflush(stdout);
-  ach_header_t *shm = chan->shm;
-  {
-    fprintf(stdout, "6.2 ");
-    fflush(stdout);
-    enum ach_status r = chan_lock(chan);
-    fprintf(stdout, "6.3 ");
-    fflush(stdout);
-    if (ACH_OK != r) return r;
-  }
-  fprintf(stdout, "6.4 ");
-  fflush(stdout);
-  enum ach_status r = ACH_BUG;
-
-  while (ACH_BUG == r) {
-    if (chan->cancel) { /* check operation cancelled */
-      fprintf(stdout, "6.401 ");
-      fflush(stdout);
-      pthread_mutex_unlock(&shm->sync.mutex);
-      fprintf(stdout, "6.402 ");
-      fflush(stdout);
-      r = ACH_CANCELED;
-    } else if (!wait) {
-      fprintf(stdout, "6.411 ");
-      fflush(stdout);
-      r = ACH_OK; /* check no wait */
-    } else if (chan->seq_num != shm->last_seq) {
-      fprintf(stdout, "6.421 ");
-      fflush(stdout);
-      r = ACH_OK; /* check if got a frame */
-      /* else condition wait */
-    } else {
-      fprintf(stdout, "6.431 ");
-      fflush(stdout);
-      int i;
-      if (abstime) {
-        fprintf(stdout, "6.43101 ");
-        fflush(stdout);
-        struct timespec curr;
-        clock_gettime(CLOCK_MONOTONIC, &curr);
-        fprintf(stdout, "(curr: %lds:%ldns, abs: %lds:%ldns) ", curr.tv_sec,
-                curr.tv_nsec, abstime->tv_sec, abstime->tv_nsec);
-        fflush(stdout);
-        i = pthread_cond_timedwait(&shm->sync.cond, &shm->sync.mutex, abstime);
-      } else {
-        fprintf(stdout, "6.43111 ");
-        fflush(stdout);
-        i = pthread_cond_wait(&shm->sync.cond, &shm->sync.mutex);
+    /* else condition wait */
+    else {
+      /* Single-writer puts don't take the mutex unless someone
+       * waits, so count ourselves before a last look at last_seq:
+       * either we see the new frame or the put sees us. */
+      __atomic_add_fetch(&ACH_SHM_HOT(shm, cond_waiters), 1, __ATOMIC_SEQ_CST);
+      if (chan->seq_num == __atomic_load_n(&ACH_SHM_HOT(shm, last_seq),
+                                           __ATOMIC_SEQ_CST)) {
+        ach_stats_t *stats =
+            (shm->flags & ACH_HEADER_STATS) ? ACH_SHM_STATS(shm) : NULL;
+        if (stats) __atomic_add_fetch(&stats->waiters, 1, __ATOMIC_RELAXED);
+        /* the wait releases the mutex, and retakes it on wakeup */
+        TRACE(ACH_TRACE_LOCKS, TRACE_UNLOCK, shm, 0);
+        TRACE(ACH_TRACE_WAITS, TRACE_WAIT_BEGIN, shm, TRACE_WAIT_COND);
+        int i = abstime ? pthread_cond_timedwait(&shm->sync.cond,
+                                                 &shm->sync.mutex, abstime)
+                        : pthread_cond_wait(&shm->sync.cond, &shm->sync.mutex);
+        if (stats) __atomic_sub_fetch(&stats->waiters, 1, __ATOMIC_RELAXED);
+        enum ach_status c = check_lock(i, chan, 1);
+        TRACE(ACH_TRACE_WAITS, TRACE_WAIT_END, shm, c);
+        if (ACH_OK == c) TRACE(ACH_TRACE_LOCKS, TRACE_LOCK, shm, 1);
+        if (ACH_OK != c) r = c;
       }
-      fprintf(stdout, "6.432 ");
-      fflush(stdout);
-      enum ach_status c = check_lock(i, chan, 1);
-      fprintf(stdout, "6.433 ");
-      fflush(stdout);
-      if (ACH_OK != c) r = c;
+      __atomic_sub_fetch(&ACH_SHM_HOT(shm, cond_waiters), 1, __ATOMIC_SEQ_CST);
       /* check r and condition next iteration */
     }
   }
 
-  fprintf(stdout, "6.5 ");
-  fflush(stdout);
   return r;
 }
 
 static enum ach_status unrdlock( ach_header_t *shm ) {
     assert( 0 == shm->sync.dirty );
-    if ( pthread_mutex_unlock( & shm->sync.mutex ) )
+    if ( chan_unlock( shm ) )
         return ACH_FAILED_SYSCALL;
     else return ACH_OK;
 }
@@ -383,78 +1302,297 @@ static enum ach_status wrlock( ach_channel_t *chan ) {
     enum ach_status r = chan_lock(chan);
     if( ACH_OK != r ) return r;
 
+    /* puts must go to the new channel */
+    if( resized( chan->shm ) ) {
+        chan_unlock( chan->shm );
+        return ACH_RESIZED;
+    }
+
     assert( 0 == chan->shm->sync.dirty );
 
     chan->shm->sync.dirty = 1;
+    stats_locked( chan->shm );
 
     return r;
 }
 
 static ach_status_t unwrlock( ach_header_t *shm ) {
+    stats_unlocking( shm );
+
     /* mark clean */
     assert( 1 == shm->sync.dirty );
     shm->sync.dirty = 0;
 
     /* unlock */
-    if( pthread_mutex_unlock( & shm->sync.mutex ) )
+    if( chan_unlock( shm ) )
         return ACH_FAILED_SYSCALL;
 
-    /* broadcast to wake up waiting readers */
+    pollfd_notify( shm );
+
+    /* wake up waiting readers */
+    if( shm->flags & ACH_HEADER_FUTEX )
+        return futex_wake( shm );
+
     if( pthread_cond_broadcast( & shm->sync.cond ) )
         return ACH_FAILED_SYSCALL;
 
-    return ACH_OK;
+    return wake_any( shm );
 }
 
-static ach_status_t unwrlock_loud( ach_header_t *shm ) {
-    /* mark clean */
-    fprintf(stdout, "\n19.1 "); fflush(stdout);
-    assert( 1 == shm->sync.dirty );
-    shm->sync.dirty = 0;
+/** Whether the put that reserved frame seq_num of an
+    ACH_HEADER_MULTI_PUT channel died before publishing it.
 
-    /* unlock */
-    fprintf(stdout, "19.2 "); fflush(stdout);
-    int r = pthread_mutex_unlock( & shm->sync.mutex );
-    if( r ) {
-        fprintf(stdout, "19.3 "); fflush(stdout);
-        return ACH_FAILED_SYSCALL;
+    A put that died before recording itself in the entry can't be
+    told from one that is about to, and is taken to be alive.
+*/
+static bool
+reserver_dead( ach_header_t *shm, uint64_t seq_num ) {
+    ach_index_owner_t *res = ACH_SHM_INDEX_OWNER_AT(shm, (seq_num - 1) % shm->index_cnt);
+    if( seq_num != __atomic_load_n( &res->seq_num, __ATOMIC_ACQUIRE ) ) return false;
+    uint64_t owner = __atomic_load_n( &res->owner, __ATOMIC_RELAXED );
+    /* a later put only takes the entry over once seq_num is out */
+    return ach_owner_dead( owner ) &&
+        __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE ) < seq_num;
+}
+
+/** Whether a put to a channel whose puts skip the lock died part way
+    through.  The entries it invalidated are never published, so gets
+    that need them would retry forever. */
+static bool
+put_died( ach_header_t *shm ) {
+    ach_header_hot_t *hot = ACH_SHM_HOT_BLOCK(shm);
+    const uint64_t last = __atomic_load_n( &hot->last_seq, __ATOMIC_ACQUIRE );
+    if( __atomic_load_n( &hot->reserve_seq, __ATOMIC_ACQUIRE ) == last ) return false;
+    if( shm->flags & ACH_HEADER_MULTI_PUT ) return reserver_dead( shm, last + 1 );
+
+    const uint64_t owner = __atomic_load_n( &hot->writer_owner, __ATOMIC_ACQUIRE );
+    return owner && ach_owner_dead( owner ) &&
+        __atomic_load_n( &hot->last_seq, __ATOMIC_ACQUIRE ) == last;
+}
+
+/** Ends a get that could not finish without the lock on a channel
+    whose puts skip the lock.  The read lock can't keep such puts out,
+    so only wait on the condition variable with it, then start over.
+
+    \return ACH_AGAIN to start over, ACH_CORRUPT if a put died part
+    way, or an error from waiting.
+*/
+static enum ach_status
+wait_unlocked( ach_channel_t *chan, bool wait, const struct timespec *abstime ) {
+    if( put_died( chan->shm ) ) return ACH_CORRUPT;
+    if( wait && !(chan->shm->flags & ACH_HEADER_FUTEX) ) {
+        enum ach_status r = rdlock( chan, 1, abstime );
+        if( ACH_OK != r ) return r;
+        r = unrdlock( chan->shm );
+        if( ACH_OK != r ) return r;
     }
+    return ACH_AGAIN;
+}
 
-    /* broadcast to wake up waiting readers */
-    fprintf(stdout, "19.4 "); fflush(stdout);
-    r = pthread_cond_broadcast( & shm->sync.cond );
-    if( r ) {
-        fprintf(stdout, "19.5 "); fflush(stdout);
-        return ACH_FAILED_SYSCALL;
+/** Claims the puts of an ACH_HEADER_SINGLE_WRITER channel for chan,
+    if no one holds them or their holder died.
+
+    \return ACH_OK, ACH_EACCES if another handle holds the claim, or
+    ACH_CORRUPT if the holder died in the middle of a put.
+*/
+static enum ach_status
+writer_claim( ach_channel_t *chan ) {
+    pthread_once( &writer_once, writer_init );
+    ach_header_t *shm = chan->shm;
+    ach_header_hot_t *hot = ACH_SHM_HOT_BLOCK(shm);
+    const uint64_t self = owner_self();
+
+    uint64_t owner = __atomic_load_n( &hot->writer_owner, __ATOMIC_ACQUIRE );
+    if( owner ) {
+        if( self == owner || ! ach_owner_dead(owner) ) return ACH_EACCES;
+        /* a put was in progress when the holder died */
+        if( __atomic_load_n( &hot->reserve_seq, __ATOMIC_RELAXED ) !=
+            __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_RELAXED ) )
+        {
+            return ACH_CORRUPT;
+        }
+    }
+    if( ! __atomic_compare_exchange_n( &hot->writer_owner, &owner, self, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+    {
+        return ACH_EACCES;
+    }
+    chan->writer = (int)writer_epoch;
+    return ACH_OK;
+}
+
+/** Gives up chan's claim on the puts of an ACH_HEADER_SINGLE_WRITER
+    channel */
+static void
+writer_release( ach_channel_t *chan ) {
+    if( (int)writer_epoch != chan->writer ) return;
+    __atomic_store_n( &ACH_SHM_HOT_BLOCK(chan->shm)->writer_owner, 0, __ATOMIC_RELEASE );
+    chan->writer = 0;
+}
+
+/** Begins a put: takes the write lock, or for an
+    ACH_HEADER_SINGLE_WRITER channel, checks that chan holds the claim.
+
+    Single-writer puts publish with the same ordered stores as locked
+    ones, which lock-free gets already check against, so nothing else
+    is needed to keep readers consistent.
+*/
+static enum ach_status
+put_lock( ach_channel_t *chan ) {
+    ach_header_t *shm = chan->shm;
+    if( ! (shm->flags & ACH_HEADER_SINGLE_WRITER) ) return wrlock( chan );
+
+    if( (int)writer_epoch != chan->writer ) {
+        enum ach_status r = writer_claim( chan );
+        if( ACH_OK != r ) return r;
     }
+    if( resized( shm ) ) return ACH_RESIZED;
 
-    fprintf(stdout, "19.6 "); fflush(stdout);
+    /* note the put in progress, in case we die during it */
+    __atomic_store_n( &ACH_SHM_HOT_BLOCK(shm)->reserve_seq,
+                      ACH_SHM_HOT(shm, last_seq) + 1, __ATOMIC_RELAXED );
+    stats_locked( shm );
     return ACH_OK;
 }
 
+/** Ends a put begun with put_lock() and wakes waiting readers */
+static enum ach_status
+put_unlock( ach_channel_t *chan ) {
+    ach_header_t *shm = chan->shm;
+    if( ! (shm->flags & ACH_HEADER_SINGLE_WRITER) ) return unwrlock( shm );
+
+    stats_unlocking( shm );
+    __atomic_store_n( &ACH_SHM_HOT_BLOCK(shm)->reserve_seq,
+                      ACH_SHM_HOT(shm, last_seq), __ATOMIC_RELAXED );
+
+    pollfd_notify( shm );
+    if( shm->flags & ACH_HEADER_FUTEX )
+        return futex_wake( shm );
+
+    /* Readers count themselves in cond_waiters before they last
+     * check last_seq, so with no one counted, no one can miss the
+     * frame we published. */
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &ACH_SHM_HOT(shm, cond_waiters), __ATOMIC_RELAXED ) ) {
+        /* Readers check last_seq and sleep on the condition variable
+         * under the mutex, so once we have held it, each one either
+         * saw the new frame or is waiting for the broadcast. */
+        enum ach_status r = chan_lock( chan );
+        if( ACH_OK != r ) return r;
+        if( chan_unlock( shm ) )
+            return ACH_FAILED_SYSCALL;
+        if( pthread_cond_broadcast( &shm->sync.cond ) )
+            return ACH_FAILED_SYSCALL;
+    }
+
+    return wake_any( shm );
+}
+
 
 void ach_create_attr_init( ach_create_attr_t *attr ) {
     memset( attr, 0, sizeof( ach_create_attr_t ) );
 }
 
-enum ach_status
-ach_create( const char *channel_name,
-            size_t frame_cnt, size_t frame_size,
-            ach_create_attr_t *attr) {
+/** Creates a channel, in the shm file shm_name rather than the
+    channel's own if shm_name is not NULL. */
+static enum ach_status
+create_channel( const char *channel_name, const char *shm_name,
+                size_t frame_cnt, size_t frame_size,
+                ach_create_attr_t *attr ) {
     ach_header_t *shm;
     int fd;
     size_t len;
+    const clockid_t clock = (attr && attr->set_clock) ? attr->clock : ACH_DEFAULT_CLOCK;
+    const bool use_futex = attr && attr->futex;
+    const bool use_pollfd = attr && attr->pollfd;
+    const bool use_stats = !(attr && attr->no_stats);
+    const int huge_pages = attr ? attr->huge_pages : ACH_HUGE_NONE;
+    const int layout = attr ? attr->layout : ACH_LAYOUT_DEFAULT;
+    const bool use_fixed = attr && attr->fixed_size;
+    const bool use_times = attr && attr->timestamps;
+    const bool use_memfd = attr && attr->memfd;
+    const bool use_readers = attr && attr->readers;
+    const bool use_multi_put = attr && attr->multi_put;
+    const bool use_single_writer = attr && attr->single_writer;
+    const bool use_mirror = attr && attr->mirror;
+    const bool use_lock_times = attr && attr->lock_times;
+    /* stay readable by older libraries unless asked not to */
+    const bool use_v2 = (ACH_LAYOUT_2 == layout) ||
+        (ACH_LAYOUT_DEFAULT == layout &&
+         (use_times || use_multi_put || use_single_writer || use_mirror));
+    int use_hugetlb = (ACH_HUGE_TLB == huge_pages);
+    size_t map_len;
+
+#ifndef ACH_HAVE_POLLFD
+    if( use_pollfd ) return ACH_EINVAL;
+#endif
+#ifndef ACH_HAVE_MEMFD
+    if( use_memfd ) return ACH_EINVAL;
+#endif
+    if( huge_pages < ACH_HUGE_NONE || huge_pages > ACH_HUGE_TLB ||
+        (use_hugetlb && attr->map_anon) ||
+        layout < ACH_LAYOUT_DEFAULT || layout > ACH_LAYOUT_2 ||
+        (use_fixed && 0 == frame_cnt) ||
+        (use_times && !use_v2) ||
+        (use_lock_times && !use_stats) ||
+        (use_memfd && attr->map_anon) ||
+        (use_multi_put && !(use_fixed && use_futex && use_v2)) ||
+        (use_single_writer && (use_multi_put || !use_v2)) ||
+        (use_mirror && (!use_v2 || use_fixed || use_hugetlb || attr->map_anon)) )
+        return ACH_EINVAL;
+
+    if( use_futex ) {
+#ifdef ACH_HAVE_FUTEX
+        /* futexes only time out against these clocks */
+        if( CLOCK_MONOTONIC != clock && CLOCK_REALTIME != clock )
+            return ACH_EINVAL;
+#else
+        return ACH_EINVAL;
+#endif
+    }
+
     /* fixme: truncate */
+    /* layout 2 starts each frame on a cache line */
+    size_t data_size = frame_cnt * (use_v2 ? ACH_ALIGN64(frame_size) : frame_size);
+    size_t data_offset = 0;
+    size_t body_len;   /* through the data guard */
+
     /* open shm */
     {
-        len = sizeof( ach_header_t) +
-            frame_cnt*sizeof( ach_index_t ) +
-            frame_cnt*frame_size +
-            3*sizeof(uint64_t);
+        if( use_mirror ) {
+            /* the data array is mapped twice, so it takes whole pages */
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            data_offset = ACH_ALIGN64( sizeof(ach_header_t) + sizeof(uint64_t) ) +
+                sizeof(ach_header_hot_t) + frame_cnt*64 + 64;
+            data_offset = (data_offset + page - 1) / page * page;
+            data_size = (data_size + page - 1) / page * page;
+            body_len = data_offset + 2*data_size + sizeof(uint64_t);
+        } else if( use_v2 ) {
+            /* header and guard, then ach_header_hot_t, index entries
+             * and the index guard each on their own cache lines */
+            body_len = ACH_ALIGN64( sizeof(ach_header_t) + sizeof(uint64_t) ) +
+                sizeof(ach_header_hot_t) +
+                frame_cnt*64 + 64 +
+                data_size + sizeof(uint64_t);
+        } else {
+            body_len = sizeof( ach_header_t) +
+                frame_cnt*sizeof( ach_index_t ) +
+                data_size +
+                3*sizeof(uint64_t);
+        }
+        len = body_len;
+        /* optional sections, laid out as ACH_SHM_POLLFD and ACH_SHM_STATS */
+        if( use_pollfd || use_stats || use_readers ) len = ACH_ALIGN64( len );
+        if( use_pollfd ) len += ACH_ALIGN64( sizeof(ach_pollfd_registry_t) );
+        if( use_stats ) len += sizeof(ach_stats_t);
+        if( use_readers ) len = ACH_ALIGN64( len ) + ACH_READERS_MAX * sizeof(ach_reader_t);
+        map_len = len;
 
         if( attr && attr->map_anon ) {
-            /* anonymous (heap) */
-            shm = (ach_header_t *) malloc( len );
+            /* anonymous (heap), aligned for the cache line layout */
+            void *p;
+            if( posix_memalign( &p, 64, len ) ) return ACH_FAILED_SYSCALL;
+            shm = (ach_header_t *) p;
             fd = -1;
         }else {
             int oflag = O_EXCL | O_CREAT;
@@ -464,16 +1602,33 @@ ach_create( const char *channel_name,
             if( attr ) {
                 if( attr->truncate ) oflag &= ~O_EXCL;
             }
-            if( (fd = fd_for_channel_name( channel_name, oflag )) < 0 ) {
+            if( use_memfd ) {
+                /* nameless, freed with the last descriptor and mapping */
+                if( (fd = memfd_for_channel_name( channel_name, use_hugetlb )) < 0 ) {
+                    return check_errno();
+                }
+            } else if( shm_name ) {
+                if( (fd = fd_for_shmfile( shm_name, oflag, &use_hugetlb )) < 0 ) {
+                    return check_errno();
+                }
+            } else if( (fd = fd_for_channel_name( channel_name, oflag, &use_hugetlb )) < 0 ) {
                 return check_errno();;
             }
+            if( use_hugetlb ) {
+                /* hugetlbfs only maps whole huge pages */
+                size_t align = map_align( fd );
+                map_len = (len + align - 1) / align * align;
+            }
+
+            /* the second copy of the data is not in the file */
+            const size_t file_len = use_mirror ? map_len - data_size : map_len;
 
             { /* make file proper size */
                 /* FreeBSD needs ftruncate before mmap, Linux can do either order */
                 int r;
                 int i = 0;
                 do {
-                    r = ftruncate( fd, (off_t) len );
+                    r = ftruncate( fd, (off_t) file_len );
                 }while(-1 == r && EINTR == errno && i++ < ACH_INTR_RETRY);
                 if( -1 == r ) {
                     DEBUG_PERROR( "ftruncate");
@@ -482,18 +1637,30 @@ ach_create( const char *channel_name,
             }
 
             /* mmap */
-            if( (shm = (ach_header_t *)mmap( NULL, len, PROT_READ|PROT_WRITE,
-                                             MAP_SHARED, fd, 0) )
-                == MAP_FAILED ) {
+            if( use_mirror ) {
+                shm = (ach_header_t *)map_mirror( fd, file_len, data_offset, data_size );
+            } else {
+                shm = (ach_header_t *)mmap( NULL, map_len, PROT_READ|PROT_WRITE,
+                                            MAP_SHARED, fd, 0 );
+            }
+            if( MAP_FAILED == shm ) {
                 DEBUG_PERROR("mmap");
-                DEBUGF("mmap failed %s, len: %"PRIuPTR", fd: %d\n", strerror(errno), len, fd);
+                DEBUGF("mmap failed %s, len: %"PRIuPTR", fd: %d\n", strerror(errno), map_len, fd);
                 return ACH_FAILED_SYSCALL;
             }
+            /* before the memset faults everything in */
+            if( ACH_HUGE_TRANSPARENT == huge_pages ) advise_huge( shm, map_len );
 
         }
 
-        memset( shm, 0, len );
-        shm->len = len;
+        memset( shm, 0, map_len );
+        shm->len = use_mirror ? map_len - data_size : map_len;
+        /* selects the layout for the macros below */
+        shm->magic = use_v2 ? ACH_SHM_MAGIC_NUM_V2 : ACH_SHM_MAGIC_NUM;
+        if( use_mirror ) {
+            shm->flags |= ACH_HEADER_MIRROR;
+            shm->data_offset = data_offset;
+        }
     }
 
     { /* initialize synchronization */
@@ -514,16 +1681,9 @@ ach_create( const char *channel_name,
                 }
             }
             /* Clock */
-            if( attr && attr->set_clock ) {
-                if( (r = pthread_condattr_setclock(&cond_attr, attr->clock)) ) {
-                    DEBUG_PERROR("pthread_condattr_setclock");
-                    return ACH_FAILED_SYSCALL;
-                }
-            } else {
-                if( (r = pthread_condattr_setclock(&cond_attr, ACH_DEFAULT_CLOCK)) ) {
-                    DEBUG_PERROR("pthread_condattr_setclock");
-                    return ACH_FAILED_SYSCALL;
-                }
+            if( (r = pthread_condattr_setclock(&cond_attr, clock)) ) {
+                DEBUG_PERROR("pthread_condattr_setclock");
+                return ACH_FAILED_SYSCALL;
             }
 
             if( (r = pthread_cond_init(&shm->sync.cond, &cond_attr)) ) {
@@ -589,30 +1749,67 @@ ach_create( const char *channel_name,
     strncpy( shm->name, channel_name, ACH_CHAN_NAME_MAX );
     /* initialize counts */
     shm->index_cnt = frame_cnt;
-    shm->index_head = 0;
-    shm->index_free = frame_cnt;
-    shm->data_head = 0;
-    shm->data_free = frame_cnt * frame_size;
-    shm->data_size = frame_cnt * frame_size;
-    assert( sizeof( ach_header_t ) +
-            shm->index_free * sizeof( ach_index_t ) +
-            shm->data_free + 3*sizeof(uint64_t) ==  len );
+    ACH_SHM_HOT(shm, index_head) = 0;
+    ACH_SHM_HOT(shm, index_free) = frame_cnt;
+    ACH_SHM_HOT(shm, data_head) = 0;
+    ACH_SHM_HOT(shm, data_free) = data_size;
+    shm->data_size = data_size;
+    shm->clock = clock;
+    if( use_futex ) shm->flags |= ACH_HEADER_FUTEX;
+    if( use_pollfd ) shm->flags |= ACH_HEADER_POLLFD;
+    if( ACH_HUGE_TRANSPARENT == huge_pages ) shm->flags |= ACH_HEADER_THP;
+    if( use_hugetlb ) shm->flags |= ACH_HEADER_HUGETLB;
+    if( attr && attr->populate ) shm->flags |= ACH_HEADER_POPULATE;
+    if( attr && attr->lock_memory ) shm->flags |= ACH_HEADER_MLOCK;
+    if( use_stats ) shm->flags |= ACH_HEADER_STATS;
+    if( use_lock_times ) shm->flags |= ACH_HEADER_LOCK_TIMES;
+    if( use_readers ) shm->flags |= ACH_HEADER_READERS;
+    if( use_multi_put ) shm->flags |= ACH_HEADER_MULTI_PUT;
+    if( use_single_writer ) shm->flags |= ACH_HEADER_SINGLE_WRITER;
+    if( use_fixed ) {
+        shm->flags |= ACH_HEADER_FIXED;
+        shm->slot_size = data_size / frame_cnt;
+    }
+    if( use_multi_put ) {
+        /* reservations follow the times in each index entry's cache line */
+        assert( sizeof(ach_index_time_t) + sizeof(ach_index_owner_t) <=
+                ACH_SHM_INDEX_STRIDE(shm) );
+    }
+    if( use_times ) {
+        /* the times fit in each layout 2 index entry's cache line */
+        assert( sizeof(ach_index_time_t) <= ACH_SHM_INDEX_STRIDE(shm) );
+        shm->flags |= ACH_HEADER_TIMES;
+    }
+
+    assert( (uint8_t*)(ACH_SHM_GUARD_DATA(shm) + 1) == (uint8_t*)shm + body_len );
+    if( use_readers ) {
+        assert( (uint8_t*)(ACH_SHM_READERS(shm) + ACH_READERS_MAX) == (uint8_t*)shm + len );
+    } else if( use_stats ) {
+        assert( (uint8_t*)(ACH_SHM_STATS(shm) + 1) == (uint8_t*)shm + len );
+    } else if( use_pollfd ) {
+        assert( ACH_SHM_TAIL_OFFSET(shm) +
+                ACH_ALIGN64(sizeof(ach_pollfd_registry_t)) == len );
+    }
 
     *ACH_SHM_GUARD_HEADER(shm) = ACH_SHM_GUARD_HEADER_NUM;
     *ACH_SHM_GUARD_INDEX(shm) = ACH_SHM_GUARD_INDEX_NUM;
     *ACH_SHM_GUARD_DATA(shm) = ACH_SHM_GUARD_DATA_NUM;
-    shm->magic = ACH_SHM_MAGIC_NUM;
 
     if( attr && attr->map_anon ) {
         attr->shm = shm;
     } else {
         int r;
         /* remove mapping */
-        r = munmap(shm, len);
+        r = munmap(shm, map_len);
         if( 0 != r ){
             DEBUG_PERROR("munmap");
             return ACH_FAILED_SYSCALL;
         }
+        /* the memfd is the only way to reach the channel */
+        if( use_memfd ) {
+            attr->fd = fd;
+            return ACH_OK;
+        }
         /* close file */
         int i = 0;
         do {
@@ -627,6 +1824,13 @@ ach_create( const char *channel_name,
     return ACH_OK;
 }
 
+enum ach_status
+ach_create( const char *channel_name,
+            size_t frame_cnt, size_t frame_size,
+            ach_create_attr_t *attr) {
+    return create_channel( channel_name, NULL, frame_cnt, frame_size, attr );
+}
+
 enum ach_status
 ach_open( ach_channel_t *chan, const char *channel_name,
           ach_attr_t *attr ) {
@@ -634,38 +1838,83 @@ ach_open( ach_channel_t *chan, const char *channel_name,
     size_t len;
     int fd = -1;
 
+    if( attr && (attr->wait_policy < ACH_WAIT_BLOCK ||
+                 attr->wait_policy > ACH_WAIT_POLL) )
+        return ACH_EINVAL;
+
     if( attr ) memcpy( &chan->attr, attr, sizeof(chan->attr) );
     else memset( &chan->attr, 0, sizeof(chan->attr) );
 
+#ifdef ACH_HAVE_STREAM_COPY
+    pthread_once( &stream_once, stream_init );
+#endif
+
     if( attr && attr->map_anon ) {
         shm = attr->shm;
-        len = sizeof(ach_header_t) + sizeof(ach_index_t)*shm->index_cnt + shm->data_size;
+        len = shm->len;
     }else {
-        if( ! channel_name_ok( channel_name ) )
-            return ACH_INVALID_NAME;
-        /* open shm */
-        if( ! channel_name_ok( channel_name ) ) return ACH_INVALID_NAME;
-        if( (fd = fd_for_channel_name( channel_name, 0 )) < 0 ) {
-            return check_errno();
+        int huge = 0;
+        if( attr && attr->use_fd ) {
+            /* our own descriptor, for ach_close() */
+            if( (fd = fcntl( attr->fd, F_DUPFD_CLOEXEC, 0 )) < 0 ) {
+                return check_errno();
+            }
+            /* could be a memfd on hugetlbfs */
+            huge = 1;
+        } else {
+            if( ! channel_name_ok( channel_name ) )
+                return ACH_INVALID_NAME;
+            /* open shm */
+            if( (fd = fd_for_channel_name( channel_name, 0, &huge )) < 0 ) {
+                return check_errno();
+            }
         }
-        if( (shm = (ach_header_t*) mmap (NULL, sizeof(ach_header_t),
+        /* hugetlbfs only unmaps whole huge pages */
+        size_t header_len = sizeof(ach_header_t);
+        if( huge ) header_len = map_align( fd );
+        if( (shm = (ach_header_t*) mmap (NULL, header_len,
                                          PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0ul) )
             == MAP_FAILED )
             return ACH_FAILED_SYSCALL;
-        if( ACH_SHM_MAGIC_NUM != shm->magic )
+        if( ACH_SHM_MAGIC_NUM != shm->magic && ACH_SHM_MAGIC_NUM_V2 != shm->magic )
             return ACH_BAD_SHM_FILE;
 
-        /* calculate mmaping size */
-        len = sizeof(ach_header_t) + sizeof(ach_index_t)*shm->index_cnt + shm->data_size;
+        /* mapping size, including any sections after the data */
+        len = ACH_SHM_MAP_LEN( shm );
+        const size_t file_len = shm->len;
+        const uint32_t flags = shm->flags;
+        const size_t data_offset = shm->data_offset;
+        const size_t data_size = shm->data_size;
 
         /* remap */
-        if( -1 ==  munmap( shm, sizeof(ach_header_t) ) )
+        if( -1 ==  munmap( shm, header_len ) )
             return check_errno();
 
-        if( (shm = (ach_header_t*) mmap( NULL, len, PROT_READ|PROT_WRITE,
-                                         MAP_SHARED, fd, 0ul) )
-            == MAP_FAILED )
+        if( flags & ACH_HEADER_MIRROR ) {
+            shm = (ach_header_t*) map_mirror( fd, file_len, data_offset, data_size );
+        } else {
+            shm = (ach_header_t*) mmap( NULL, len, PROT_READ|PROT_WRITE,
+                                        MAP_SHARED, fd, 0ul );
+        }
+        if( MAP_FAILED == shm )
             return check_errno();
+
+        if( flags & ACH_HEADER_THP ) advise_huge( shm, len );
+        if( (attr && attr->populate) || (flags & ACH_HEADER_POPULATE) ) {
+            prefault( shm, len );
+        }
+        if( attr && attr->lock_memory ) {
+            if( mlock( shm, len ) ) {
+                int e = errno;
+                munmap( shm, len );
+                close( fd );
+                errno = e;
+                return ACH_FAILED_SYSCALL;
+            }
+        } else if( flags & ACH_HEADER_MLOCK ) {
+            /* best effort; unprivileged subscribers still get the channel */
+            if( mlock( shm, len ) ) DEBUG_PERROR("mlock");
+        }
     }
 
     /* Check guard bytes */
@@ -681,11 +1930,74 @@ ach_open( ach_channel_t *chan, const char *channel_name,
     chan->seq_num = 0;
     chan->next_index = 1;
     chan->cancel = 0;
+    chan->reader = SIZE_MAX;
+    chan->writer = 0;
+#ifdef ACH_TRACE
+    trace_channel( shm );
+#endif
+    if( (shm->flags & ACH_HEADER_READERS) && !(attr && attr->no_reader) ) {
+        reader_claim( chan );
+    }
+
+    return ACH_OK;
+}
 
+/** Moves chan over to the channel that replaced its own in
+    ach_resize(), keeping its place in the sequence.
+
+    The new channel may itself have been resized by now, so keep going
+    until we reach the current one.
+*/
+static enum ach_status
+follow_resize( ach_channel_t *chan ) {
+    while( chan->shm && resized( chan->shm ) ) {
+        /* memfd channels are never resized, so the name finds it */
+        ach_attr_t attr = chan->attr;
+        attr.use_fd = 0;
+
+        ach_channel_t next;
+        enum ach_status r = ach_open( &next, chan->shm->name, &attr );
+        if( ACH_OK != r ) return r;
+
+        next.seq_num = chan->seq_num;
+        next.next_index = chan->seq_num % next.shm->index_cnt;
+        next.cancel = chan->cancel;
+        reader_seek( &next );
+        reader_carry( &next, chan );
+
+        r = ach_close( chan );
+        if( ACH_OK != r ) {
+            ach_close( &next );
+            return r;
+        }
+        *chan = next;
+    }
     return ACH_OK;
 }
 
 
+/** Copies size bytes of the data array starting at offset into buf,
+ * wrapping around the end of the array if needed (the mirror of an
+ * ACH_HEADER_MIRROR channel does that for us), and streaming if
+ * size is at least stream_size */
+static void
+copy_frame( ach_header_t *shm, size_t offset, size_t size, uint8_t *buf,
+            size_t stream_size ) {
+    uint8_t *data_buf = ACH_SHM_DATA(shm);
+    const bool stream = size >= stream_size;
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_BEGIN, shm, size );
+    if( offset + size < shm->data_size || (shm->flags & ACH_HEADER_MIRROR) ) {
+        /* simple memcpy */
+        copy_bytes( buf, data_buf + offset, size, stream );
+    }else {
+        /* wraparound memcpy */
+        size_t end_cnt = shm->data_size - offset;
+        copy_bytes( buf, data_buf + offset, end_cnt, stream );
+        copy_bytes( buf + end_cnt, data_buf, size - end_cnt, stream );
+    }
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_END, shm, 0 );
+}
+
 /** Copies frame pointed to by index entry at index_offset.
 
     \pre hold read lock on the channel
@@ -699,7 +2011,7 @@ ach_get_from_offset( ach_channel_t *chan, size_t index_offset,
                      char *buf, size_t size, size_t *frame_size ) {
     ach_header_t *shm = chan->shm;
     assert( index_offset < shm->index_cnt );
-    ach_index_t *idx = ACH_SHM_INDEX(shm) + index_offset;
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, index_offset);
     /* assert( idx->size ); */
     assert( idx->seq_num );
     assert( idx->offset < shm->data_size );
@@ -719,218 +2031,1246 @@ ach_get_from_offset( ach_channel_t *chan, size_t index_offset,
         return ACH_OVERFLOW;
     } else {
         /* good to copy */
-        uint8_t *data_buf = ACH_SHM_DATA(shm);
-        if( idx->offset + idx->size < shm->data_size ) {
-            /* simple memcpy */
-            memcpy( (uint8_t*)buf, data_buf + idx->offset, idx->size );
-        }else {
-            /* wraparound memcpy */
-            size_t end_cnt = shm->data_size - idx->offset;
-            memcpy( (uint8_t*)buf, data_buf + idx->offset, end_cnt );
-            memcpy( (uint8_t*)buf + end_cnt, data_buf, idx->size - end_cnt );
-        }
+        copy_frame( shm, idx->offset, idx->size, (uint8_t*)buf, stream_min(chan) );
         *frame_size = idx->size;
+        stats_read( shm, idx->seq_num );
+        reader_got( chan, idx->seq_num, 1, idx->size );
         chan->seq_num = idx->seq_num;
         chan->next_index = (index_offset + 1) % shm->index_cnt;
         return ACH_OK;
     }
 }
 
-enum ach_status
-ach_get( ach_channel_t *chan, void *buf, size_t size,
-         size_t *frame_size,
-         const struct timespec *ACH_RESTRICT abstime,
-         int options ) {
-    ach_header_t *shm = chan->shm;
-    ach_index_t *index_ar = ACH_SHM_INDEX(shm);
+/** Computes the index entry a get should read.
 
-    /* Check guard bytes */
-    {
-        enum ach_status r = check_guards(shm);
-        if( ACH_OK != r ) return r;
+    \pre hold read lock on the channel and the channel has a frame to
+    return
+*/
+static size_t
+read_index_i( ach_channel_t *chan, int options ) {
+    ach_header_t *shm = chan->shm;
+    if( options & ACH_O_LAST ) {
+        /* normal case, get last */
+        return last_index_i(shm);
+    } else if( ACH_SHM_INDEX_AT(shm, chan->next_index)->seq_num == chan->seq_num + 1 ) {
+        /* normal case, get next */
+        return chan->next_index;
+    } else if( chan->seq_num == ACH_SHM_HOT(shm, last_seq) ) {
+        /* exception case, copy last */
+        assert( options & ACH_O_COPY );
+        return last_index_i(shm);
+    } else {
+        /* exception case, copy oldest */
+        return oldest_index_i(shm);
     }
+}
 
-    const bool o_wait = options & ACH_O_WAIT;
+/** Outcome of snapshot_index() */
+enum snapshot {
+    SNAPSHOT_OK,                /**< got a consistent index entry */
+    SNAPSHOT_STALE,             /**< no new frames */
+    SNAPSHOT_RACE               /**< raced a writer, try again */
+};
+
+/** Checks, without waiting on the mutex, whether the last writer
+    died holding it.
+
+    \pre the dirty bit was seen set
+*/
+static bool
+writer_died( ach_channel_t *chan ) {
+    int i = pthread_mutex_trylock( &chan->shm->sync.mutex );
+    if( EBUSY == i ) return false;      /* still writing */
+    /* we hold the mutex, so the dirty bit is settled */
+    enum ach_status r = check_lock( i, chan, 0 );
+    if( ACH_OK == r ) pthread_mutex_unlock( &chan->shm->sync.mutex );
+    return ACH_OK != r;
+}
+
+/** Picks the index entry ach_get() would read and copies it to ent
+    without taking the channel mutex.
+
+    On SNAPSHOT_OK, ent held seq_num at some point after this call
+    started.  The frame data is only intact so long as the entry in
+    shared memory still holds that seq_num.
+*/
+static enum snapshot
+snapshot_index( ach_channel_t *chan, int options,
+                size_t *read_index, ach_index_t *ent ) {
+    ach_header_t *shm = chan->shm;
     const bool o_last = options & ACH_O_LAST;
     const bool o_copy = options & ACH_O_COPY;
 
-    /* take read lock */
+    /* A writer in progress is caught by the seq_num recheck below.
+     * One that died holding the lock is left for the locked path to
+     * report. */
+    if( __atomic_load_n( &shm->sync.dirty, __ATOMIC_ACQUIRE ) &&
+        writer_died( chan ) )
     {
-        enum ach_status r = rdlock( chan, o_wait, abstime );
-        if( ACH_OK != r ) return r;
+        return SNAPSHOT_RACE;
     }
-    assert( chan->seq_num <= shm->last_seq );
 
-    enum ach_status retval = ACH_BUG;
-    bool missed_frame = 0;
-
-    /* get the data */
-    if( (chan->seq_num == shm->last_seq && !o_copy) || 0 == shm->last_seq ) {
+    uint64_t last_seq = __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE );
+    if( (chan->seq_num == last_seq && !o_copy) || 0 == last_seq ) {
         /* no entries */
-        assert(!o_wait);
-        retval = ACH_STALE_FRAMES;
+        return SNAPSHOT_STALE;
+    }
+
+    /* Compute the index to read, same as the locked path */
+    size_t index_head = __atomic_load_n( &ACH_SHM_HOT(shm, index_head), __ATOMIC_ACQUIRE );
+    size_t index_free = __atomic_load_n( &ACH_SHM_HOT(shm, index_free), __ATOMIC_ACQUIRE );
+    size_t i;
+    if( o_last ) {
+        i = (index_head + shm->index_cnt - 1) % shm->index_cnt;
+    } else if( __atomic_load_n( &ACH_SHM_INDEX_AT(shm, chan->next_index)->seq_num, __ATOMIC_ACQUIRE )
+               == chan->seq_num + 1 ) {
+        i = chan->next_index;
+    } else if( chan->seq_num == last_seq ) {
+        i = (index_head + shm->index_cnt - 1) % shm->index_cnt;
     } else {
-        /* Compute the index to read */
+        i = (index_head + index_free) % shm->index_cnt;
+    }
+
+    /* Snapshot the entry */
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, i);
+    ent->seq_num = __atomic_load_n( &idx->seq_num, __ATOMIC_ACQUIRE );
+    ent->offset = idx->offset;
+    ent->size = idx->size;
+    if( 0 == ent->seq_num ||                    /* being replaced */
+        ent->seq_num < chan->seq_num ||         /* raced an eviction */
+        (ent->seq_num == chan->seq_num && !o_copy) ||
+        ent->offset >= shm->data_size ||
+        ent->size > shm->data_size )
+    {
+        return SNAPSHOT_RACE;
+    }
+
+    /* make sure offset and size belong to seq_num */
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( ent->seq_num != __atomic_load_n( &idx->seq_num, __ATOMIC_RELAXED ) ) {
+        return SNAPSHOT_RACE;
+    }
+
+    *read_index = i;
+    return SNAPSHOT_OK;
+}
+
+/** Reads a frame without taking the channel mutex.
+
+    See \ref synchronization.
+
+    \return true if the get was completed, with its status in
+    *result.  false if we kept racing with writers, in which case
+    the caller must retry with the lock held.
+*/
+static bool
+get_optimistic( ach_channel_t *chan, void *buf, size_t size,
+                size_t *frame_size, int options,
+                enum ach_status *result ) {
+    ach_header_t *shm = chan->shm;
+
+    int attempt;
+    for( attempt = 0; attempt < ACH_OPTIMISTIC_RETRY; attempt++ ) {
+        if( attempt ) cpu_relax();
+
         size_t read_index;
-        if( o_last ) {
-            /* normal case, get last */
-            read_index = last_index_i(shm);
-        } else if (!o_last &&
-                   index_ar[chan->next_index].seq_num == chan->seq_num + 1) {
-            /* normal case, get next */
-            read_index = chan->next_index;
-        } else {
-            /* exception case, figure out which frame */
-            if (chan->seq_num == shm->last_seq) {
-                /* copy last */
-                assert(o_copy);
-                read_index = last_index_i(shm);
-            } else {
-                /* copy oldest */
-                read_index = oldest_index_i(shm);
-            }
+        ach_index_t ent;
+        switch( snapshot_index( chan, options, &read_index, &ent ) ) {
+        case SNAPSHOT_OK: break;
+        case SNAPSHOT_STALE:
+            *result = ACH_STALE_FRAMES;
+            return true;
+        case SNAPSHOT_RACE: continue;
         }
 
-        if( index_ar[read_index].seq_num > chan->seq_num + 1 ) { missed_frame = 1; }
+        if( ent.size > size ) {
+            /* buffer overflow */
+            *frame_size = ent.size;
+            *result = ACH_OVERFLOW;
+            return true;
+        }
 
-        /* read from the index */
-        retval = ach_get_from_offset( chan, read_index, (char*)buf, size,
-                                      frame_size );
+        copy_frame( shm, ent.offset, ent.size, (uint8_t*)buf, stream_min(chan) );
 
-        assert( index_ar[read_index].seq_num > 0 );
-    }
+        /* Validate: was the entry invalidated while we copied? */
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if( ent.seq_num != __atomic_load_n( &ACH_SHM_INDEX_AT(shm, read_index)->seq_num,
+                                            __ATOMIC_RELAXED ) )
+        {
+            continue;
+        }
 
-    /* release read lock */
-    ach_status_t r = unrdlock( shm );
-    if( ACH_OK != r ) return r;
+        *result = ( ent.seq_num > chan->seq_num + 1 ) ? ACH_MISSED_FRAME : ACH_OK;
+        *frame_size = ent.size;
+        stats_read( shm, ent.seq_num );
+        reader_got( chan, ent.seq_num, 1, ent.size );
+        chan->seq_num = ent.seq_num;
+        chan->next_index = (read_index + 1) % shm->index_cnt;
+        return true;
+    }
 
-    return (ACH_OK == retval && missed_frame) ? ACH_MISSED_FRAME : retval;
+    return false;
 }
 
-enum ach_status
-ach_get_loud( ach_channel_t *chan, void *buf, size_t size,
+static enum ach_status
+try_get( ach_channel_t *chan, void *buf, size_t size,
          size_t *frame_size,
          const struct timespec *ACH_RESTRICT abstime,
          int options ) {
-    fprintf(stdout, "\n1 "); fflush(stdout);
     ach_header_t *shm = chan->shm;
-    fprintf(stdout, "2 "); fflush(stdout);
-    ach_index_t *index_ar = ACH_SHM_INDEX(shm);
 
     /* Check guard bytes */
     {
-        fprintf(stdout, "3 "); fflush(stdout);
         enum ach_status r = check_guards(shm);
-        fprintf(stdout, "4 "); fflush(stdout);
         if( ACH_OK != r ) return r;
     }
 
-    fprintf(stdout, "5 "); fflush(stdout);
     const bool o_wait = options & ACH_O_WAIT;
-    const bool o_last = options & ACH_O_LAST;
     const bool o_copy = options & ACH_O_COPY;
 
+    if( chan->cancel ) return ACH_CANCELED;
+
+    /* try without the lock */
+    {
+        enum ach_status r;
+        if( get_optimistic( chan, buf, size, frame_size, options, &r ) ) {
+            if( ! (o_wait && ACH_STALE_FRAMES == r) ) {
+                return r;
+            }
+            /* poll if asked to, then sleep on the futex, and retry
+             * still without the lock */
+            r = spin_wait( chan, abstime );
+            if( ACH_STALE_FRAMES == r && (shm->flags & ACH_HEADER_FUTEX) ) {
+                r = futex_wait( chan, abstime );
+            }
+            if( ACH_STALE_FRAMES != r ) {
+                if( ACH_OK != r ) return r;
+                if( get_optimistic( chan, buf, size, frame_size, options, &r ) ) {
+                    return r;
+                }
+            }
+        }
+    }
+
+    /* puts to these channels ignore the lock */
+    if( lock_free_puts( shm ) ) return wait_unlocked( chan, o_wait, abstime );
+
     /* take read lock */
     {
-        fprintf(stdout, "6 "); fflush(stdout);
-        enum ach_status r = rdlock_loud( chan, o_wait, abstime );
-        fprintf(stdout, "7 "); fflush(stdout);
+        enum ach_status r = rdlock( chan, o_wait, abstime );
         if( ACH_OK != r ) return r;
     }
-    fprintf(stdout, "8 "); fflush(stdout);
-    assert( chan->seq_num <= shm->last_seq );
+    assert( chan->seq_num <= ACH_SHM_HOT(shm, last_seq) );
 
-    fprintf(stdout, "9 "); fflush(stdout);
     enum ach_status retval = ACH_BUG;
     bool missed_frame = 0;
 
     /* get the data */
-    if( (chan->seq_num == shm->last_seq && !o_copy) || 0 == shm->last_seq ) {
+    if( (chan->seq_num == ACH_SHM_HOT(shm, last_seq) && !o_copy) || 0 == ACH_SHM_HOT(shm, last_seq) ) {
         /* no entries */
-        fprintf(stdout, "9.01 "); fflush(stdout);
         assert(!o_wait);
-        fprintf(stdout, "9.02 "); fflush(stdout);
         retval = ACH_STALE_FRAMES;
     } else {
-        /* Compute the index to read */
-        fprintf(stdout, "9.11 "); fflush(stdout);
-        size_t read_index;
-        if( o_last ) {
-            /* normal case, get last */
-            fprintf(stdout, "9.1101 "); fflush(stdout);
-            read_index = last_index_i(shm);
-        } else if (!o_last &&
-                   index_ar[chan->next_index].seq_num == chan->seq_num + 1) {
-            /* normal case, get next */
-            fprintf(stdout, "9.1111 "); fflush(stdout);
-            read_index = chan->next_index;
-        } else {
-            /* exception case, figure out which frame */
-            fprintf(stdout, "9.1121 "); fflush(stdout);
-            if (chan->seq_num == shm->last_seq) {
-                /* copy last */
-                fprintf(stdout, "9.112101 "); fflush(stdout);
-                assert(o_copy);
-                fprintf(stdout, "9.112102 "); fflush(stdout);
-                read_index = last_index_i(shm);
-            } else {
-                /* copy oldest */
-                fprintf(stdout, "9.112111 "); fflush(stdout);
-                read_index = oldest_index_i(shm);
-            }
-        }
-        fprintf(stdout, "9.12 "); fflush(stdout);
-        if( index_ar[read_index].seq_num > chan->seq_num + 1 ) { missed_frame = 1; }
+        size_t read_index = read_index_i( chan, options );
+
+        if( ACH_SHM_INDEX_AT(shm, read_index)->seq_num > chan->seq_num + 1 ) { missed_frame = 1; }
 
         /* read from the index */
-        fprintf(stdout, "9.13 "); fflush(stdout);
         retval = ach_get_from_offset( chan, read_index, (char*)buf, size,
                                       frame_size );
 
-        fprintf(stdout, "9.14 "); fflush(stdout);
-        assert( index_ar[read_index].seq_num > 0 );
+        assert( ACH_SHM_INDEX_AT(shm, read_index)->seq_num > 0 );
     }
 
     /* release read lock */
-    fprintf(stdout, "10 "); fflush(stdout);
     ach_status_t r = unrdlock( shm );
-    fprintf(stdout, "11 "); fflush(stdout);
     if( ACH_OK != r ) return r;
 
-    fprintf(stdout, "12 "); fflush(stdout);
     return (ACH_OK == retval && missed_frame) ? ACH_MISSED_FRAME : retval;
 }
 
 enum ach_status
-ach_flush( ach_channel_t *chan ) {
-    ach_header_t *shm = chan->shm;
-    enum ach_status r = rdlock(chan, 0,  NULL);
-    if( ACH_OK != r ) return r;
-
-    chan->seq_num = shm->last_seq;
-    chan->next_index = shm->index_head;
-    return unrdlock(shm);
+ach_get( ach_channel_t *chan, void *buf, size_t size,
+         size_t *frame_size,
+         const struct timespec *ACH_RESTRICT abstime,
+         int options ) {
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK == r ) r = try_get( chan, buf, size, frame_size, abstime, options );
+    } while( ACH_RESIZED == r || ACH_AGAIN == r );
+    return r;
 }
 
+enum ach_status
+ach_get_seq( ach_channel_t *chan, uint64_t seq_num,
+             void *buf, size_t size, size_t *frame_size ) {
+    {
+        enum ach_status r = follow_resize( chan );
+        if( ACH_OK != r ) return r;
+    }
+    ach_header_t *shm = chan->shm;
+
+    if( 0 == seq_num ) return ACH_EINVAL;
+
+    /* Check guard bytes */
+    {
+        enum ach_status r = check_guards(shm);
+        if( ACH_OK != r ) return r;
+    }
+
+    if( chan->cancel ) return ACH_CANCELED;
+
+    /* Sequence numbers are handed out one per index entry, round
+     * robin from entry 0, so seq_num can only ever live in this one
+     * entry.  publish_index() stores the entry before last_seq, so
+     * once last_seq reaches seq_num, any other value in the entry
+     * means the frame was evicted and is gone for good.  No lock or
+     * retry is needed. */
+    if( seq_num > __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE ) ) {
+        return ACH_STALE_FRAMES;
+    }
+
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, (seq_num - 1) % shm->index_cnt);
+    ach_index_t ent;
+    ent.seq_num = __atomic_load_n( &idx->seq_num, __ATOMIC_ACQUIRE );
+    ent.offset = idx->offset;
+    ent.size = idx->size;
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( seq_num != ent.seq_num ||
+        seq_num != __atomic_load_n( &idx->seq_num, __ATOMIC_RELAXED ) )
+    {
+        return ACH_MISSED_FRAME;
+    }
+    assert( ent.offset < shm->data_size );
+
+    if( ent.size > size ) {
+        /* buffer overflow */
+        *frame_size = ent.size;
+        return ACH_OVERFLOW;
+    }
+
+    copy_frame( shm, ent.offset, ent.size, (uint8_t*)buf, stream_min(chan) );
+
+    /* Validate: was the frame evicted while we copied? */
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( seq_num != __atomic_load_n( &idx->seq_num, __ATOMIC_RELAXED ) ) {
+        return ACH_MISSED_FRAME;
+    }
+
+    *frame_size = ent.size;
+    stats_read( shm, seq_num );
+    reader_count( chan, 1, ent.size );
+    return ACH_OK;
+}
+
+/** Reads when frame seq_num was put, in CLOCK_REALTIME if real or
+    else CLOCK_MONOTONIC.
+
+    \return false if the frame is no longer in the channel
+*/
+static bool
+frame_time_ns( ach_header_t *shm, uint64_t seq_num, bool real, uint64_t *ns ) {
+    ach_index_time_t *idx = ACH_SHM_INDEX_TIME_AT(shm, (seq_num - 1) % shm->index_cnt);
+    if( seq_num != __atomic_load_n( &idx->index.seq_num, __ATOMIC_ACQUIRE ) ) return false;
+    *ns = real ? idx->real_ns : idx->mono_ns;
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    return seq_num == __atomic_load_n( &idx->index.seq_num, __ATOMIC_RELAXED );
+}
+
+static void
+frame_time_set( ach_frame_time_t *frame, uint64_t seq_num, uint64_t ns ) {
+    frame->seq_num = seq_num;
+    frame->time.tv_sec = (time_t)(ns / 1000000000u);
+    frame->time.tv_nsec = (long)(ns % 1000000000u);
+}
+
+enum ach_status
+ach_find_time( ach_channel_t *chan, clockid_t clock,
+               const struct timespec *when,
+               ach_frame_time_t *before, ach_frame_time_t *after ) {
+    {
+        enum ach_status r = follow_resize( chan );
+        if( ACH_OK != r ) return r;
+    }
+    ach_header_t *shm = chan->shm;
+
+    if( ! (shm->flags & ACH_HEADER_TIMES) ||
+        (CLOCK_MONOTONIC != clock && CLOCK_REALTIME != clock) )
+    {
+        return ACH_EINVAL;
+    }
+
+    const bool real = (CLOCK_REALTIME == clock);
+    const uint64_t t = timespec_ns( when );
+    memset( before, 0, sizeof(*before) );
+    memset( after, 0, sizeof(*after) );
+
+    uint64_t last_seq = __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE );
+    if( 0 == last_seq ) return ACH_STALE_FRAMES;
+
+    /* Only frames lo+1 through last_seq can still be in the channel.
+     * Their times never decrease, and the evicted ones are always
+     * the oldest, so binary search for the newest frame that is
+     * either evicted or put at or before t.  Frame lo is evicted or
+     * doesn't exist, and frame hi is after t or doesn't exist. */
+    uint64_t lo = (last_seq > shm->index_cnt) ? last_seq - shm->index_cnt : 0;
+    uint64_t hi = last_seq + 1;
+    uint64_t lo_ns = 0, hi_ns = 0;
+    bool lo_found = 0;
+    while( hi - lo > 1 ) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t ns;
+        if( ! frame_time_ns( shm, mid, real, &ns ) ) {
+            lo = mid;
+            lo_found = 0;
+        } else if( ns <= t ) {
+            lo = mid;
+            lo_ns = ns;
+            lo_found = 1;
+        } else {
+            hi = mid;
+            hi_ns = ns;
+        }
+    }
+
+    if( lo_found ) frame_time_set( before, lo, lo_ns );
+    if( hi <= last_seq ) frame_time_set( after, hi, hi_ns );
+
+    return (lo_found || hi <= last_seq) ? ACH_OK : ACH_STALE_FRAMES;
+}
+
+enum ach_status
+ach_get_time( ach_channel_t *chan, clockid_t clock,
+              const struct timespec *when, int match,
+              void *buf, size_t size, size_t *frame_size,
+              ach_frame_time_t *frame ) {
+    if( match < ACH_TIME_NEAREST || match > ACH_TIME_AFTER ) return ACH_EINVAL;
+
+    enum ach_status r = ACH_MISSED_FRAME;
+    int attempt;
+    for( attempt = 0; attempt < ACH_OPTIMISTIC_RETRY; attempt++ ) {
+        ach_frame_time_t before, after;
+        r = ach_find_time( chan, clock, when, &before, &after );
+        if( ACH_OK != r ) return r;
+
+        const ach_frame_time_t *pick;
+        switch( match ) {
+        case ACH_TIME_BEFORE: pick = &before; break;
+        case ACH_TIME_AFTER: pick = &after; break;
+        default:
+            if( 0 == before.seq_num ) {
+                pick = &after;
+            } else if( 0 == after.seq_num ) {
+                pick = &before;
+            } else {
+                uint64_t t = timespec_ns( when );
+                pick = ( timespec_ns(&after.time) - t < t - timespec_ns(&before.time) )
+                    ? &after : &before;
+            }
+        }
+        if( 0 == pick->seq_num ) return ACH_STALE_FRAMES;
+
+        r = ach_get_seq( chan, pick->seq_num, buf, size, frame_size );
+        if( ACH_MISSED_FRAME != r ) {
+            if( frame ) *frame = *pick;
+            return r;
+        }
+        /* evicted after we found it, look again */
+    }
+
+    return r;
+}
+
+/** Copies frames into buf for ach_get_many(), beginning with the
+    snapshotted index entry ent at read_index and continuing through
+    consecutive newer frames.  Does not update the channel.
+
+    \pre ent->size <= size
+
+    \return number of frames copied, or 0 if a writer replaced them
+    while we copied.
+*/
+static size_t
+copy_many( ach_channel_t *chan, size_t read_index, const ach_index_t *ent,
+           uint8_t *buf, size_t size,
+           ach_frame_desc_t *frames, size_t max_frames, int options ) {
+    ach_header_t *shm = chan->shm;
+    ach_index_t e = *ent;
+    size_t n = 0, used = 0, i = read_index;
+
+    for(;;) {
+        copy_frame( shm, e.offset, e.size, buf + used, stream_min(chan) );
+        frames[n].offset = used;
+        frames[n].size = e.size;
+        frames[n].seq_num = e.seq_num;
+        used += e.size;
+        n++;
+        if( n == max_frames || (options & ACH_O_LAST) ) break;
+
+        /* continue if the next entry holds the following frame */
+        i = (i + 1) % shm->index_cnt;
+        e.seq_num = __atomic_load_n( &ACH_SHM_INDEX_AT(shm, i)->seq_num, __ATOMIC_ACQUIRE );
+        if( e.seq_num != frames[n-1].seq_num + 1 ) break;
+        e.offset = ACH_SHM_INDEX_AT(shm, i)->offset;
+        e.size = ACH_SHM_INDEX_AT(shm, i)->size;
+        if( e.offset >= shm->data_size ||
+            e.size > shm->data_size ||
+            e.size > size - used )
+        {
+            break;
+        }
+    }
+
+    /* Validate: was any entry invalidated while we copied? */
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    for( i = 0; i < n; i++ ) {
+        size_t j = (read_index + i) % shm->index_cnt;
+        if( frames[i].seq_num != __atomic_load_n( &ACH_SHM_INDEX_AT(shm, j)->seq_num, __ATOMIC_RELAXED ) ) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+/** Copies frames for ach_get_many() starting from the snapshotted
+    index entry ent and advances the channel past them.
+
+    \return false if a writer replaced the frames while we copied
+*/
+static bool
+take_many( ach_channel_t *chan, size_t read_index, const ach_index_t *ent,
+           void *buf, size_t size,
+           ach_frame_desc_t *frames, size_t max_frames, size_t *frame_cnt,
+           int options, enum ach_status *result ) {
+    if( ent->size > size ) {
+        /* buffer overflow */
+        frames[0].offset = 0;
+        frames[0].size = ent->size;
+        frames[0].seq_num = ent->seq_num;
+        *result = ACH_OVERFLOW;
+        return true;
+    }
+
+    size_t n = copy_many( chan, read_index, ent, (uint8_t*)buf, size,
+                          frames, max_frames, options );
+    if( 0 == n ) return false;
+
+    *result = ( ent->seq_num > chan->seq_num + 1 ) ? ACH_MISSED_FRAME : ACH_OK;
+    *frame_cnt = n;
+    stats_read( chan->shm, frames[n-1].seq_num );
+    reader_got( chan, frames[n-1].seq_num, n,
+                frames[n-1].offset + frames[n-1].size );
+    chan->seq_num = frames[n-1].seq_num;
+    chan->next_index = (read_index + n) % chan->shm->index_cnt;
+    return true;
+}
+
+/** Copies frames for ach_get_many() without taking the channel
+    mutex.
+
+    \return as for get_optimistic()
+*/
+static bool
+get_many_optimistic( ach_channel_t *chan, void *buf, size_t size,
+                     ach_frame_desc_t *frames, size_t max_frames,
+                     size_t *frame_cnt, int options,
+                     enum ach_status *result ) {
+    int attempt;
+    for( attempt = 0; attempt < ACH_OPTIMISTIC_RETRY; attempt++ ) {
+        if( attempt ) cpu_relax();
+
+        size_t read_index;
+        ach_index_t ent;
+        switch( snapshot_index( chan, options, &read_index, &ent ) ) {
+        case SNAPSHOT_OK:
+            if( take_many( chan, read_index, &ent, buf, size,
+                           frames, max_frames, frame_cnt, options, result ) )
+            {
+                return true;
+            }
+            continue;
+        case SNAPSHOT_STALE:
+            *result = ACH_STALE_FRAMES;
+            return true;
+        case SNAPSHOT_RACE: continue;
+        }
+    }
+    return false;
+}
+
+static enum ach_status
+try_get_many( ach_channel_t *chan, void *buf, size_t size,
+              ach_frame_desc_t *frames, size_t max_frames, size_t *frame_cnt,
+              const struct timespec *ACH_RESTRICT abstime,
+              int options ) {
+    ach_header_t *shm = chan->shm;
+
+    *frame_cnt = 0;
+    if( 0 == max_frames ) return ACH_EINVAL;
+
+    /* Check guard bytes */
+    {
+        enum ach_status r = check_guards(shm);
+        if( ACH_OK != r ) return r;
+    }
+
+    const bool o_wait = options & ACH_O_WAIT;
+    const bool o_copy = options & ACH_O_COPY;
+
+    if( chan->cancel ) return ACH_CANCELED;
+
+    /* try without the lock */
+    {
+        enum ach_status r;
+        if( get_many_optimistic( chan, buf, size, frames, max_frames,
+                                 frame_cnt, options, &r ) ) {
+            if( ! (o_wait && ACH_STALE_FRAMES == r) ) {
+                return r;
+            }
+            /* poll if asked to, then sleep on the futex, and retry
+             * still without the lock */
+            r = spin_wait( chan, abstime );
+            if( ACH_STALE_FRAMES == r && (shm->flags & ACH_HEADER_FUTEX) ) {
+                r = futex_wait( chan, abstime );
+            }
+            if( ACH_STALE_FRAMES != r ) {
+                if( ACH_OK != r ) return r;
+                if( get_many_optimistic( chan, buf, size, frames, max_frames,
+                                         frame_cnt, options, &r ) ) {
+                    return r;
+                }
+            }
+        }
+    }
+
+    /* puts to these channels ignore the lock */
+    if( lock_free_puts( shm ) ) return wait_unlocked( chan, o_wait, abstime );
+
+    /* take read lock */
+    {
+        enum ach_status r = rdlock( chan, o_wait, abstime );
+        if( ACH_OK != r ) return r;
+    }
+
+    enum ach_status retval = ACH_BUG;
+    if( (chan->seq_num == ACH_SHM_HOT(shm, last_seq) && !o_copy) || 0 == ACH_SHM_HOT(shm, last_seq) ) {
+        /* no entries */
+        assert(!o_wait);
+        retval = ACH_STALE_FRAMES;
+    } else {
+        size_t read_index = read_index_i( chan, options );
+        ach_index_t ent = *ACH_SHM_INDEX_AT(shm, read_index);
+        /* nobody can write while we hold the lock */
+        bool done = take_many( chan, read_index, &ent, buf, size,
+                               frames, max_frames, frame_cnt, options,
+                               &retval );
+        assert( done );
+        (void)done;
+    }
+
+    /* release read lock */
+    ach_status_t r = unrdlock( shm );
+    if( ACH_OK != r ) return r;
+
+    return retval;
+}
+
+enum ach_status
+ach_get_many( ach_channel_t *chan, void *buf, size_t size,
+              ach_frame_desc_t *frames, size_t max_frames, size_t *frame_cnt,
+              const struct timespec *ACH_RESTRICT abstime,
+              int options ) {
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK == r ) r = try_get_many( chan, buf, size, frames, max_frames,
+                                            frame_cnt, abstime, options );
+    } while( ACH_RESIZED == r || ACH_AGAIN == r );
+    return r;
+}
+
+/** Copies the newest frames, up to max_frames of them, for
+    ach_get_window().
+
+    Entries are read as for the lock-free gets, so this also works
+    with the read lock held.  Since frames are evicted oldest first,
+    both from the index and from the data array, the copy is intact
+    if the oldest copied frame is still in the channel afterwards.
+
+    \return false if a writer replaced the frames while we copied.
+*/
+static bool
+copy_window( ach_channel_t *chan, uint8_t *buf, size_t size,
+             ach_frame_desc_t *frames, size_t max_frames,
+             size_t *frame_cnt, enum ach_status *result ) {
+    ach_header_t *shm = chan->shm;
+    uint64_t last_seq = __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE );
+    if( 0 == last_seq ) {
+        *result = ACH_STALE_FRAMES;
+        return true;
+    }
+
+    /* Walk back from the newest frame until we have max_frames, run
+     * out of room, or reach an evicted one.  frames[] is filled
+     * newest first for now. */
+    size_t n = 0, used = 0;
+    uint64_t s;
+    for( s = last_seq; s > 0 && n < max_frames && n < shm->index_cnt; s-- ) {
+        ach_index_t *idx = ACH_SHM_INDEX_AT(shm, (s - 1) % shm->index_cnt);
+        if( s != __atomic_load_n( &idx->seq_num, __ATOMIC_ACQUIRE ) ) break;
+        size_t offset = idx->offset;
+        size_t len = idx->size;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if( s != __atomic_load_n( &idx->seq_num, __ATOMIC_RELAXED ) ) break;
+        if( used + len > size ) {
+            if( 0 == n ) {
+                /* not even the newest fits */
+                frames[0].size = len;
+                *result = ACH_OVERFLOW;
+                return true;
+            }
+            break;
+        }
+        frames[n].offset = offset; /* in the data array, for now */
+        frames[n].size = len;
+        frames[n].seq_num = s;
+        used += len;
+        n++;
+    }
+    /* the newest frame was evicted, so a writer is ahead of us */
+    if( 0 == n ) return false;
+
+    /* reverse to oldest first and copy */
+    size_t i;
+    for( i = 0; i < n / 2; i++ ) {
+        ach_frame_desc_t tmp = frames[i];
+        frames[i] = frames[n - 1 - i];
+        frames[n - 1 - i] = tmp;
+    }
+    used = 0;
+    for( i = 0; i < n; i++ ) {
+        copy_frame( shm, frames[i].offset, frames[i].size, buf + used, stream_min(chan) );
+        frames[i].offset = used;
+        used += frames[i].size;
+    }
+
+    /* Validate: was the oldest frame evicted while we copied?
+     * Multi_put puts may evict out of order, so there check all. */
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    size_t check = (shm->flags & ACH_HEADER_MULTI_PUT) ? n : 1;
+    for( i = 0; i < check; i++ ) {
+        if( frames[i].seq_num !=
+            __atomic_load_n( &ACH_SHM_INDEX_AT(shm, (frames[i].seq_num - 1) % shm->index_cnt)->seq_num,
+                             __ATOMIC_RELAXED ) )
+        {
+            return false;
+        }
+    }
+
+    *frame_cnt = n;
+    *result = ACH_OK;
+    stats_read( shm, frames[n-1].seq_num );
+    reader_count( chan, n, used );
+    return true;
+}
+
+static enum ach_status
+try_get_window( ach_channel_t *chan, void *buf, size_t size,
+                ach_frame_desc_t *frames, size_t max_frames,
+                size_t *frame_cnt ) {
+    ach_header_t *shm = chan->shm;
+
+    *frame_cnt = 0;
+    if( 0 == max_frames ) return ACH_EINVAL;
+
+    /* Check guard bytes */
+    {
+        enum ach_status r = check_guards(shm);
+        if( ACH_OK != r ) return r;
+    }
+
+    if( chan->cancel ) return ACH_CANCELED;
+
+    /* try without the lock */
+    enum ach_status retval = ACH_BUG;
+    int attempt;
+    for( attempt = 0; attempt < ACH_OPTIMISTIC_RETRY; attempt++ ) {
+        if( attempt ) cpu_relax();
+        if( copy_window( chan, (uint8_t*)buf, size, frames, max_frames,
+                         frame_cnt, &retval ) ) {
+            return retval;
+        }
+    }
+
+    /* puts to these channels ignore the lock */
+    if( lock_free_puts( shm ) ) return wait_unlocked( chan, 0, NULL );
+
+    /* take read lock */
+    {
+        enum ach_status r = rdlock( chan, 0, NULL );
+        if( ACH_OK != r ) return r;
+    }
+
+    /* nobody can write while we hold the lock */
+    bool done = copy_window( chan, (uint8_t*)buf, size, frames, max_frames,
+                             frame_cnt, &retval );
+    assert( done );
+    (void)done;
+
+    /* release read lock */
+    ach_status_t r = unrdlock( shm );
+    if( ACH_OK != r ) return r;
+
+    return retval;
+}
+
+enum ach_status
+ach_get_window( ach_channel_t *chan, void *buf, size_t size,
+                ach_frame_desc_t *frames, size_t max_frames,
+                size_t *frame_cnt ) {
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK == r ) r = try_get_window( chan, buf, size, frames, max_frames, frame_cnt );
+    } while( ACH_RESIZED == r || ACH_AGAIN == r );
+    return r;
+}
+
+/** Points view at the frame of the snapshotted index entry ent and
+    advances the channel past it. */
+static enum ach_status
+fill_view( ach_channel_t *chan, ach_view_t *view,
+           size_t read_index, const ach_index_t *ent ) {
+    ach_header_t *shm = chan->shm;
+    uint8_t *data_buf = ACH_SHM_DATA(shm);
+    enum ach_status r = ( ent->seq_num > chan->seq_num + 1 ) ? ACH_MISSED_FRAME : ACH_OK;
+
+    view->seg[0] = data_buf + ent->offset;
+    if( ent->offset + ent->size <= shm->data_size ||
+        (shm->flags & ACH_HEADER_MIRROR) )
+    {
+        view->seg_size[0] = ent->size;
+        view->seg[1] = NULL;
+        view->seg_size[1] = 0;
+    } else {
+        /* wraparound */
+        view->seg_size[0] = shm->data_size - ent->offset;
+        view->seg[1] = data_buf;
+        view->seg_size[1] = ent->size - view->seg_size[0];
+    }
+    view->frame_size = ent->size;
+    view->seq_num = ent->seq_num;
+    view->index_offset = read_index;
+
+    stats_read( shm, ent->seq_num );
+    reader_got( chan, ent->seq_num, 1, ent->size );
+    chan->seq_num = ent->seq_num;
+    chan->next_index = (read_index + 1) % shm->index_cnt;
+    return r;
+}
+
+/** Finds a frame for ach_get_view() without taking the channel
+    mutex.
+
+    \return as for get_optimistic()
+*/
+static bool
+get_view_optimistic( ach_channel_t *chan, ach_view_t *view, int options,
+                     enum ach_status *result ) {
+    int attempt;
+    for( attempt = 0; attempt < ACH_OPTIMISTIC_RETRY; attempt++ ) {
+        if( attempt ) cpu_relax();
+
+        size_t read_index;
+        ach_index_t ent;
+        switch( snapshot_index( chan, options, &read_index, &ent ) ) {
+        case SNAPSHOT_OK:
+            *result = fill_view( chan, view, read_index, &ent );
+            return true;
+        case SNAPSHOT_STALE:
+            *result = ACH_STALE_FRAMES;
+            return true;
+        case SNAPSHOT_RACE: continue;
+        }
+    }
+    return false;
+}
+
+static enum ach_status
+try_get_view( ach_channel_t *chan, ach_view_t *view,
+              const struct timespec *ACH_RESTRICT abstime,
+              int options ) {
+    ach_header_t *shm = chan->shm;
+
+    /* Check guard bytes */
+    {
+        enum ach_status r = check_guards(shm);
+        if( ACH_OK != r ) return r;
+    }
+
+    const bool o_wait = options & ACH_O_WAIT;
+    const bool o_copy = options & ACH_O_COPY;
+
+    if( chan->cancel ) return ACH_CANCELED;
+
+    /* try without the lock */
+    {
+        enum ach_status r;
+        if( get_view_optimistic( chan, view, options, &r ) ) {
+            if( ! (o_wait && ACH_STALE_FRAMES == r) ) {
+                return r;
+            }
+            /* poll if asked to, then sleep on the futex, and retry
+             * still without the lock */
+            r = spin_wait( chan, abstime );
+            if( ACH_STALE_FRAMES == r && (shm->flags & ACH_HEADER_FUTEX) ) {
+                r = futex_wait( chan, abstime );
+            }
+            if( ACH_STALE_FRAMES != r ) {
+                if( ACH_OK != r ) return r;
+                if( get_view_optimistic( chan, view, options, &r ) ) {
+                    return r;
+                }
+            }
+        }
+    }
+
+    /* puts to these channels ignore the lock */
+    if( lock_free_puts( shm ) ) return wait_unlocked( chan, o_wait, abstime );
+
+    /* take read lock */
+    {
+        enum ach_status r = rdlock( chan, o_wait, abstime );
+        if( ACH_OK != r ) return r;
+    }
+
+    enum ach_status retval;
+    if( (chan->seq_num == ACH_SHM_HOT(shm, last_seq) && !o_copy) || 0 == ACH_SHM_HOT(shm, last_seq) ) {
+        /* no entries */
+        assert(!o_wait);
+        retval = ACH_STALE_FRAMES;
+    } else {
+        size_t read_index = read_index_i( chan, options );
+        ach_index_t ent = *ACH_SHM_INDEX_AT(shm, read_index);
+        retval = fill_view( chan, view, read_index, &ent );
+    }
+
+    /* release read lock */
+    ach_status_t r = unrdlock( shm );
+    if( ACH_OK != r ) return r;
+
+    return retval;
+}
+
+enum ach_status
+ach_get_view( ach_channel_t *chan, ach_view_t *view,
+              const struct timespec *ACH_RESTRICT abstime,
+              int options ) {
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK == r ) r = try_get_view( chan, view, abstime, options );
+    } while( ACH_RESIZED == r || ACH_AGAIN == r );
+    return r;
+}
+
+enum ach_status
+ach_view_validate( const ach_channel_t *chan, const ach_view_t *view ) {
+    ach_header_t *shm = chan->shm;
+    if( view->index_offset >= shm->index_cnt ) return ACH_EINVAL;
+
+    /* Publishers zero the entry's seq_num before touching the data,
+     * so order our reads of the data before this load. */
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    uint64_t seq_num = __atomic_load_n( &ACH_SHM_INDEX_AT(shm, view->index_offset)->seq_num,
+                                        __ATOMIC_RELAXED );
+    return ( seq_num == view->seq_num ) ? ACH_OK : ACH_OVERWRITTEN;
+}
+
+enum ach_status
+ach_view_release( ach_channel_t *chan, ach_view_t *view ) {
+    enum ach_status r = ach_view_validate( chan, view );
+    memset( view, 0, sizeof(*view) );
+    view->index_offset = SIZE_MAX;
+    return r;
+}
+
+enum ach_status
+ach_get_loud( ach_channel_t *chan, void *buf, size_t size,
+         size_t *frame_size,
+         const struct timespec *ACH_RESTRICT abstime,
+         int options ) {
+    return ach_get( chan, buf, size, frame_size, abstime, options );
+}
+
+enum ach_status
+ach_flush( ach_channel_t *chan ) {
+    enum ach_status r = follow_resize( chan );
+    if( ACH_OK != r ) return r;
+
+    ach_header_t *shm = chan->shm;
+    r = rdlock(chan, 0,  NULL);
+    if( ACH_OK != r ) return r;
+
+    chan->seq_num = ACH_SHM_HOT(shm, last_seq);
+    chan->next_index = ACH_SHM_HOT(shm, index_head);
+    reader_seek( chan );
+    return unrdlock(shm);
+}
+
+
+static void free_index(ach_header_t *shm, size_t i ) {
+
+    assert( ACH_SHM_INDEX_AT(shm, i)->seq_num ); /* only free used indices */
+    assert( ACH_SHM_INDEX_AT(shm, i)->size );    /* must have some data */
+    assert( ACH_SHM_HOT(shm, index_free) < shm->index_cnt ); /* must be some used index */
+
+    stats_evicted( shm, ACH_SHM_INDEX_AT(shm, i)->seq_num );
+
+    /* invalidate for lock-free readers before anything else */
+    __atomic_store_n( &ACH_SHM_INDEX_AT(shm, i)->seq_num, 0, __ATOMIC_RELAXED );
+    ACH_SHM_HOT(shm, index_free) ++;
+    if( ACH_SHM_HOT(shm, index_free) == shm->index_cnt ) {
+        /* channel is empty */
+        ACH_SHM_HOT(shm, data_free) = shm->data_size;
+    } else {
+        /* Free everything up to the next oldest frame.  This also
+         * reclaims any bytes ach_put_reserve() skipped at the end of
+         * the data array. */
+        size_t next_offset = ACH_SHM_INDEX_AT(shm, (i + 1) % shm->index_cnt)->offset;
+        ACH_SHM_HOT(shm, data_free) = (next_offset + shm->data_size - ACH_SHM_HOT(shm, data_head)) % shm->data_size;
+    }
+    memset( ACH_SHM_INDEX_AT(shm, i), 0, sizeof( ach_index_t ) );
+}
+
+/** Frees the index entry at index_head and enough of the oldest
+    frames to leave len free data bytes starting at data_head.
+
+    \pre hold write lock
+*/
+static void
+evict( ach_header_t *shm, size_t len ) {
+    const size_t was_free = ACH_SHM_HOT(shm, index_free);
+
+    /* clear entry used by index */
+    if( 0 == ACH_SHM_HOT(shm, index_free) ) { free_index(shm,ACH_SHM_HOT(shm, index_head)); }
+    else { assert(0== ACH_SHM_INDEX_AT(shm, ACH_SHM_HOT(shm, index_head))->seq_num);}
+
+    assert( ACH_SHM_HOT(shm, index_free) > 0 );
+
+    /* clear overlapping entries */
+    size_t i;
+    for(i = (ACH_SHM_HOT(shm, index_head) + ACH_SHM_HOT(shm, index_free)) % shm->index_cnt;
+        ACH_SHM_HOT(shm, data_free) < len && ACH_SHM_HOT(shm, index_free) < shm->index_cnt;
+        i = (i + 1) % shm->index_cnt) {
+        assert( i != ACH_SHM_HOT(shm, index_head) );
+        free_index(shm,i);
+    }
+
+    if( ACH_SHM_HOT(shm, index_free) != was_free ) {
+        TRACE( ACH_TRACE_EVICTS, TRACE_EVICT, shm, ACH_SHM_HOT(shm, index_free) - was_free );
+    }
+}
+
+/** Frees the slot at index_head of an ACH_HEADER_FIXED channel, if
+    it holds the oldest frame.
+
+    \pre hold write lock
+*/
+static void
+evict_slot( ach_header_t *shm ) {
+    if( ACH_SHM_HOT(shm, index_free) ) return;
+
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, ACH_SHM_HOT(shm, index_head));
+    TRACE( ACH_TRACE_EVICTS, TRACE_EVICT, shm, 1 );
+    stats_evicted( shm, idx->seq_num );
+    __atomic_store_n( &idx->seq_num, 0, __ATOMIC_RELAXED );
+    ACH_SHM_HOT(shm, index_free) = 1;
+    ACH_SHM_HOT(shm, data_free) = shm->slot_size;
+}
+
+/** Makes the frame at idx visible to readers.
+
+    \pre the frame data has been copied into the data array
+*/
+static void
+publish_index( ach_header_t *shm, ach_index_t *idx, size_t len ) {
+    uint64_t seq_num = ACH_SHM_HOT(shm, last_seq) + 1;
+    idx->size = len;
+    idx->offset = ACH_SHM_HOT(shm, data_head);
+    if( shm->flags & ACH_HEADER_TIMES ) {
+        ((ach_index_time_t*)idx)->mono_ns = clock_ns( CLOCK_MONOTONIC );
+        ((ach_index_time_t*)idx)->real_ns = clock_ns( CLOCK_REALTIME );
+    }
+    __atomic_store_n( &idx->seq_num, seq_num, __ATOMIC_RELEASE );
+
+    size_t space = (shm->flags & ACH_HEADER_FIXED) ? shm->slot_size
+        : ACH_SHM_FRAME_SPACE(shm, len);
+    ACH_SHM_HOT(shm, data_head) = (ACH_SHM_HOT(shm, data_head) + space) % shm->data_size;
+    ACH_SHM_HOT(shm, data_free) -= space;
+    __atomic_store_n( &ACH_SHM_HOT(shm, index_head), (ACH_SHM_HOT(shm, index_head) + 1) % shm->index_cnt,
+                      __ATOMIC_RELAXED );
+    __atomic_store_n( &ACH_SHM_HOT(shm, index_free), ACH_SHM_HOT(shm, index_free) - 1, __ATOMIC_RELAXED );
+    __atomic_store_n( &ACH_SHM_HOT(shm, last_seq), seq_num, __ATOMIC_RELEASE );
+
+    if( shm->flags & ACH_HEADER_STATS ) {
+        ach_stats_t *stats = ACH_SHM_STATS(shm);
+        stats_put_add( &stats->put_cnt, 1 );
+        stats_put_add( &stats->put_bytes, len );
+        __atomic_store_n( &stats->last_put_ns, clock_ns( ACH_STATS_PUT_CLOCK ),
+                          __ATOMIC_RELAXED );
+    }
+}
+
+enum ach_status
+ach_put( ach_channel_t *chan, const void *buf, size_t len ) {
+    if( NULL == buf ) return ACH_EINVAL;
+    struct iovec iov;
+    iov.iov_base = (void*)buf;
+    iov.iov_len = len;
+    return ach_putv( chan, &iov, 1 );
+}
+
+/** Puts into the next slot of an ACH_HEADER_FIXED channel: at most
+    one frame to evict, and no wraparound. */
+static enum ach_status
+put_fixed( ach_channel_t *chan, const struct iovec *iov, int iovcnt, size_t len ) {
+    ach_header_t *shm = chan->shm;
+    if( len > shm->slot_size ) return ACH_OVERFLOW;
+
+    {
+        enum ach_status r = put_lock( chan );
+        if( ACH_OK != r ) return r;
+    }
+
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, ACH_SHM_HOT(shm, index_head));
+    evict_slot( shm );
+
+    /* order the invalidated entry before the data we overwrite */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
 
-static void free_index(ach_header_t *shm, size_t i ) {
-    ach_index_t *index_ar = ACH_SHM_INDEX(shm);
-
-    assert( index_ar[i].seq_num ); /* only free used indices */
-    assert( index_ar[i].size );    /* must have some data */
-    assert( shm->index_free < shm->index_cnt ); /* must be some used index */
+    uint8_t *dst = ACH_SHM_DATA(shm) + ACH_SHM_HOT(shm, data_head);
+    const bool stream = len >= stream_min( chan );
+    int i;
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_BEGIN, shm, len );
+    for( i = 0; i < iovcnt; i++ ) {
+        copy_bytes( dst, iov[i].iov_base, iov[i].iov_len, stream );
+        dst += iov[i].iov_len;
+    }
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_END, shm, 0 );
 
-    shm->data_free += index_ar[i].size;
-    shm->index_free ++;
-    memset( &index_ar[i], 0, sizeof( ach_index_t ) );
+    publish_index( shm, idx, len );
+    return put_unlock( chan );
 }
 
-enum ach_status
-ach_put( ach_channel_t *chan, const void *buf, size_t len ) {
-    if( 0 == len || NULL == buf || NULL == chan->shm ) {
+/** Waits for puts to an ACH_HEADER_MULTI_PUT channel to publish
+    through seq_num.
+
+    Spins for a while, then sleeps on the futex, which every publish
+    bumps, so that a put we wait on can have the CPU even if it runs
+    at a lower priority.
+
+    \return ACH_OK, or ACH_CORRUPT if a put ahead of us died before
+    publishing, which stops the channel for good.
+*/
+static enum ach_status
+wait_published( ach_header_t *shm, uint64_t seq_num ) {
+    unsigned i;
+    for( i = 0; ; i++ ) {
+        uint64_t last = __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE );
+        if( last >= seq_num ) return ACH_OK;
+        if( i < ACH_PUT_SPIN ) {
+            cpu_relax();
+            continue;
+        }
+        /* puts publish in order, so the next one holds up the rest */
+        if( reserver_dead( shm, last + 1 ) ) return ACH_CORRUPT;
+#ifdef ACH_HAVE_FUTEX
+        const struct timespec check = {0, ACH_PUT_CHECK_NS};
+        __atomic_add_fetch( &ACH_SHM_HOT(shm, futex_waiters), 1, __ATOMIC_SEQ_CST );
+        uint32_t val = __atomic_load_n( &ACH_SHM_HOT(shm, futex), __ATOMIC_SEQ_CST );
+        /* sleeps only if nothing was published since we read val */
+        if( last == __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE ) ) {
+            futex( &ACH_SHM_HOT(shm, futex), FUTEX_WAIT, val, &check );
+        }
+        __atomic_sub_fetch( &ACH_SHM_HOT(shm, futex_waiters), 1, __ATOMIC_SEQ_CST );
+#else
+        sched_yield();
+#endif
+    }
+}
+
+/** Puts into an ACH_HEADER_MULTI_PUT channel.
+
+    Frame s always goes in slot (s-1) % index_cnt, so taking the next
+    sequence number reserves the index entry and data both.  Copies
+    run in parallel with other publishers, and only publishing waits
+    for the puts ahead of us.
+*/
+static enum ach_status
+put_multi( ach_channel_t *chan, const struct iovec *iov, int iovcnt, size_t len ) {
+    ach_header_t *shm = chan->shm;
+    if( len > shm->slot_size ) return ACH_OVERFLOW;
+
+    uint64_t seq_num = __atomic_add_fetch( &ACH_SHM_HOT_BLOCK(shm)->reserve_seq, 1,
+                                           __ATOMIC_RELAXED );
+    size_t i = (seq_num - 1) % shm->index_cnt;
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, i);
+
+    /* the frame we replace must be out first, in case more puts are
+     * in flight than there are slots */
+    enum ach_status r;
+    uint64_t evicted = 0;
+    if( seq_num > shm->index_cnt ) {
+        evicted = seq_num - shm->index_cnt;
+        if( ACH_OK != (r = wait_published( shm, evicted )) ) return r;
+    }
+    /* so puts behind us can tell if we die before publishing */
+    ach_index_owner_t *res = ACH_SHM_INDEX_OWNER_AT(shm, i);
+    __atomic_store_n( &res->owner, owner_self(), __ATOMIC_RELAXED );
+    __atomic_store_n( &res->seq_num, seq_num, __ATOMIC_RELEASE );
+    __atomic_store_n( &idx->seq_num, 0, __ATOMIC_RELAXED );
+
+    /* order the invalidated entry before the data we overwrite */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    uint8_t *dst = ACH_SHM_DATA(shm) + i * shm->slot_size;
+    const bool stream = len >= stream_min( chan );
+    int k;
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_BEGIN, shm, len );
+    for( k = 0; k < iovcnt; k++ ) {
+        copy_bytes( dst, iov[k].iov_base, iov[k].iov_len, stream );
+        dst += iov[k].iov_len;
+    }
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_END, shm, 0 );
+
+    /* publish in order; until then, the rest of the header is ours */
+    if( ACH_OK != (r = wait_published( shm, seq_num - 1 )) ) return r;
+    stats_locked( shm );
+    evict_slot( shm );
+    if( evicted ) stats_evicted( shm, evicted );
+    publish_index( shm, idx, len );
+
+    pollfd_notify( shm );
+    return futex_wake( shm );
+}
+
+static enum ach_status
+try_putv( ach_channel_t *chan, const struct iovec *iov, int iovcnt ) {
+    if( iovcnt < 0 || NULL == chan->shm ) {
         return ACH_EINVAL;
     }
 
+    size_t len = 0;
+    int i;
+    for( i = 0; i < iovcnt; i++ ) {
+        if( NULL == iov[i].iov_base && iov[i].iov_len ) return ACH_EINVAL;
+        len += iov[i].iov_len;
+        if( len < iov[i].iov_len ) return ACH_OVERFLOW;
+    }
+    if( 0 == len ) return ACH_EINVAL;
+
     ach_header_t *shm = chan->shm;
 
     /* Check guard bytes */
@@ -939,179 +3279,194 @@ ach_put( ach_channel_t *chan, const void *buf, size_t len ) {
         if( ACH_OK != r ) return r;
     }
 
-    if( shm->data_size < len ) {
+    if( shm->flags & ACH_HEADER_MULTI_PUT ) {
+        return put_multi( chan, iov, iovcnt, len );
+    }
+    if( shm->flags & ACH_HEADER_FIXED ) {
+        return put_fixed( chan, iov, iovcnt, len );
+    }
+
+    size_t space = ACH_SHM_FRAME_SPACE(shm, len);
+    if( shm->data_size < space ) {
         return ACH_OVERFLOW;
     }
 
-    ach_index_t *index_ar = ACH_SHM_INDEX(shm);
     uint8_t *data_ar = ACH_SHM_DATA(shm);
 
-    if( len > shm->data_size ) return ACH_OVERFLOW;
-
     /* take write lock */
-    wrlock( chan );
-
-    /* find next index entry */
-    ach_index_t *idx = index_ar + shm->index_head;
-
-    /* clear entry used by index */
-    if( 0 == shm->index_free ) { free_index(shm,shm->index_head); }
-    else { assert(0== index_ar[shm->index_head].seq_num);}
-
-    assert( shm->index_free > 0 );
-
-    /* clear overlapping entries */
-    size_t i;
-    for(i = (shm->index_head + shm->index_free) % shm->index_cnt;
-        shm->data_free < len;
-        i = (i + 1) % shm->index_cnt) {
-        assert( i != shm->index_head );
-        free_index(shm,i);
+    {
+        enum ach_status r = put_lock( chan );
+        if( ACH_OK != r ) return r;
     }
 
-    assert( shm->data_free >= len );
-
-    /* copy buffer */
-    if( shm->data_size - shm->data_head >= len ) {
-        /* simply copy */
-        memcpy( data_ar + shm->data_head, buf, len );
-    } else {
-        /* wraparound copy */
-        size_t end_cnt = shm->data_size - shm->data_head;
-        memcpy( data_ar + shm->data_head, buf, end_cnt);
-        memcpy( data_ar, (uint8_t*)buf + end_cnt, len - end_cnt );
+    /* find next index entry */
+    ach_index_t *idx = ACH_SHM_INDEX_AT(shm, ACH_SHM_HOT(shm, index_head));
+
+    /* clear entry used by index and overlapping entries */
+    evict( shm, space );
+
+    assert( ACH_SHM_HOT(shm, data_free) >= space );
+
+    /* order invalidated entries before the data we overwrite */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    /* copy buffers */
+    size_t head = ACH_SHM_HOT(shm, data_head);
+    const bool stream = len >= stream_min( chan );
+    const bool mirror = shm->flags & ACH_HEADER_MIRROR;
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_BEGIN, shm, len );
+    for( i = 0; i < iovcnt; i++ ) {
+        const uint8_t *buf = (const uint8_t*)iov[i].iov_base;
+        size_t cnt = iov[i].iov_len;
+        if( mirror ) {
+            /* writes past the end land at the start */
+            copy_bytes( data_ar + head, buf, cnt, stream );
+            head = (head + cnt) % shm->data_size;
+        } else if( shm->data_size - head >= cnt ) {
+            /* simply copy */
+            copy_bytes( data_ar + head, buf, cnt, stream );
+            head += cnt;
+        } else {
+            /* wraparound copy */
+            size_t end_cnt = shm->data_size - head;
+            copy_bytes( data_ar + head, buf, end_cnt, stream );
+            copy_bytes( data_ar, buf + end_cnt, cnt - end_cnt, stream );
+            head = cnt - end_cnt;
+        }
     }
+    TRACE( ACH_TRACE_COPIES, TRACE_COPY_END, shm, 0 );
 
     /* modify counts */
-    shm->last_seq++;
-    idx->seq_num = shm->last_seq;
-    idx->size = len;
-    idx->offset = shm->data_head;
+    publish_index( shm, idx, len );
 
-    shm->data_head = (shm->data_head + len) % shm->data_size;
-    shm->data_free -= len;
-    shm->index_head = (shm->index_head + 1) % shm->index_cnt;
-    shm->index_free --;
-
-    assert( shm->index_free <= shm->index_cnt );
-    assert( shm->data_free <= shm->data_size );
-    assert( shm->last_seq > 0 );
+    assert( ACH_SHM_HOT(shm, index_free) <= shm->index_cnt );
+    assert( ACH_SHM_HOT(shm, data_free) <= shm->data_size );
+    assert( ACH_SHM_HOT(shm, last_seq) > 0 );
 
     /* release write lock */
-    return unwrlock( shm );
+    return put_unlock( chan );
 
 }
 
 enum ach_status
-ach_put_loud( ach_channel_t *chan, const void *buf, size_t len ) {
-    if( 0 == len || NULL == buf || NULL == chan->shm ) {
-        fprintf(stdout, "\n1 "); fflush(stdout);
+ach_putv( ach_channel_t *chan, const struct iovec *iov, int iovcnt ) {
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK == r ) r = try_putv( chan, iov, iovcnt );
+    } while( ACH_RESIZED == r || ACH_AGAIN == r );
+    return r;
+}
+
+static enum ach_status
+try_put_reserve( ach_channel_t *chan, size_t len, void **buf ) {
+    if( 0 == len || NULL == buf || NULL == chan->shm ||
+        (chan->shm->flags & ACH_HEADER_MULTI_PUT) )
+    {
         return ACH_EINVAL;
     }
 
-    fprintf(stdout, "2 "); fflush(stdout);
     ach_header_t *shm = chan->shm;
 
     /* Check guard bytes */
     {
-        fprintf(stdout, "3 "); fflush(stdout);
         enum ach_status r = check_guards(shm);
-        fprintf(stdout, "4 "); fflush(stdout);
         if( ACH_OK != r ) return r;
     }
 
-    if( shm->data_size < len ) {
-        fprintf(stdout, "5 "); fflush(stdout);
-        return ACH_OVERFLOW;
+    if( shm->flags & ACH_HEADER_FIXED ) {
+        if( len > shm->slot_size ) return ACH_OVERFLOW;
+        enum ach_status r = put_lock( chan );
+        if( ACH_OK != r ) return r;
+        evict_slot( shm );
+        __atomic_thread_fence( __ATOMIC_RELEASE );
+        *buf = ACH_SHM_DATA(shm) + ACH_SHM_HOT(shm, data_head);
+        return ACH_OK;
     }
 
-    fprintf(stdout, "6 "); fflush(stdout);
-    ach_index_t *index_ar = ACH_SHM_INDEX(shm);
-    fprintf(stdout, "7 "); fflush(stdout);
-    uint8_t *data_ar = ACH_SHM_DATA(shm);
+    size_t space = ACH_SHM_FRAME_SPACE(shm, len);
+    if( space > shm->data_size ) return ACH_OVERFLOW;
 
-    if( len > shm->data_size ) {
-        fprintf(stdout, "8 "); fflush(stdout);
-        return ACH_OVERFLOW;
+    /* take write lock */
+    {
+        enum ach_status r = put_lock( chan );
+        if( ACH_OK != r ) return r;
     }
 
-    /* take write lock */
-    fprintf(stdout, "9 "); fflush(stdout);
-    wrlock( chan );
+    /* The frame must be contiguous.  If it would wrap around, we also
+     * need the bytes at the end of the array, which will be skipped,
+     * unless the mirror makes it contiguous anyway. */
+    size_t tail = shm->data_size - ACH_SHM_HOT(shm, data_head);
+    if( shm->flags & ACH_HEADER_MIRROR ) tail = SIZE_MAX;
+    evict( shm, (tail < len) ? tail + space : space );
+
+    if( ACH_SHM_HOT(shm, index_free) == shm->index_cnt ) {
+        /* channel is empty, start over at the beginning */
+        ACH_SHM_HOT(shm, data_head) = 0;
+        ACH_SHM_HOT(shm, data_free) = shm->data_size;
+    } else if( tail < len ) {
+        /* skip the tail, free_index() reclaims it later */
+        assert( ACH_SHM_HOT(shm, data_free) >= tail + space );
+        ACH_SHM_HOT(shm, data_free) -= tail;
+        ACH_SHM_HOT(shm, data_head) = 0;
+    }
 
-    /* find next index entry */
-    fprintf(stdout, "10 "); fflush(stdout);
-    ach_index_t *idx = index_ar + shm->index_head;
+    assert( ACH_SHM_HOT(shm, data_free) >= space );
+    assert( shm->data_size - ACH_SHM_HOT(shm, data_head) >= space ||
+            (shm->flags & ACH_HEADER_MIRROR) );
 
-    /* clear entry used by index */
-    if( 0 == shm->index_free ) {
-      fprintf(stdout, "10.01 "); fflush(stdout);
-      free_index(shm,shm->index_head);
-    }
-    else {
-      fprintf(stdout, "10.11 "); fflush(stdout);
-      assert(0== index_ar[shm->index_head].seq_num);
-    }
+    /* order invalidated entries before the caller's writes */
+    __atomic_thread_fence( __ATOMIC_RELEASE );
 
-    fprintf(stdout, "11 "); fflush(stdout);
-    assert( shm->index_free > 0 );
+    *buf = ACH_SHM_DATA(shm) + ACH_SHM_HOT(shm, data_head);
+    return ACH_OK;
+}
 
-    /* clear overlapping entries */
-    size_t i;
-    fprintf(stdout, "12 "); fflush(stdout); int print_iter = 1;
-    for(i = (shm->index_head + shm->index_free) % shm->index_cnt;
-        shm->data_free < len;
-        i = (i + 1) % shm->index_cnt) {
-        fprintf(stdout, "12.%03d ", print_iter); print_iter++; fflush(stdout);
-        assert( i != shm->index_head );
-        free_index(shm,i);
-    }
+enum ach_status
+ach_put_reserve( ach_channel_t *chan, size_t len, void **buf ) {
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK == r ) r = try_put_reserve( chan, len, buf );
+    } while( ACH_RESIZED == r || ACH_AGAIN == r );
+    return r;
+}
 
-    fprintf(stdout, "13 "); fflush(stdout);
-    assert( shm->data_free >= len );
+enum ach_status
+ach_put_commit( ach_channel_t *chan, size_t len ) {
+    ach_header_t *shm = chan->shm;
+    assert( shm->sync.dirty || (shm->flags & ACH_HEADER_SINGLE_WRITER) );
 
-    /* copy buffer */
-    if( shm->data_size - shm->data_head >= len ) {
-        /* simply copy */
-        fprintf(stdout, "13.01 "); fflush(stdout);
-        memcpy( data_ar + shm->data_head, buf, len );
-    } else {
-        /* wraparound copy */
-        fprintf(stdout, "13.11 "); fflush(stdout);
-        size_t end_cnt = shm->data_size - shm->data_head;
-        fprintf(stdout, "13.12 "); fflush(stdout);
-        memcpy( data_ar + shm->data_head, buf, end_cnt);
-        fprintf(stdout, "13.13 "); fflush(stdout);
-        memcpy( data_ar, (uint8_t*)buf + end_cnt, len - end_cnt );
+    if( 0 == len ||
+        ((shm->flags & ACH_HEADER_FIXED) && len > shm->slot_size) ||
+        ACH_SHM_FRAME_SPACE(shm, len) > ACH_SHM_HOT(shm, data_free) ||
+        (len > shm->data_size - ACH_SHM_HOT(shm, data_head) &&
+         !(shm->flags & ACH_HEADER_MIRROR)) )
+    {
+        /* not what was reserved, drop the frame */
+        enum ach_status r = put_unlock( chan );
+        return (ACH_OK == r) ? ACH_EINVAL : r;
     }
 
-    /* modify counts */
-    fprintf(stdout, "14 "); fflush(stdout);
-    shm->last_seq++;
-    idx->seq_num = shm->last_seq;
-    idx->size = len;
-    idx->offset = shm->data_head;
-
-    fprintf(stdout, "15 "); fflush(stdout);
-    shm->data_head = (shm->data_head + len) % shm->data_size;
-    shm->data_free -= len;
-    shm->index_head = (shm->index_head + 1) % shm->index_cnt;
-    shm->index_free --;
+    publish_index( shm, ACH_SHM_INDEX_AT(shm, ACH_SHM_HOT(shm, index_head)), len );
 
-    fprintf(stdout, "16 "); fflush(stdout);
-    assert( shm->index_free <= shm->index_cnt );
-    fprintf(stdout, "17 "); fflush(stdout);
-    assert( shm->data_free <= shm->data_size );
-    fprintf(stdout, "18 "); fflush(stdout);
-    assert( shm->last_seq > 0 );
+    assert( ACH_SHM_HOT(shm, index_free) <= shm->index_cnt );
+    assert( ACH_SHM_HOT(shm, data_free) <= shm->data_size );
+    assert( ACH_SHM_HOT(shm, last_seq) > 0 );
 
     /* release write lock */
-    fprintf(stdout, "19 "); fflush(stdout);
-    enum ach_status ret = unwrlock_loud( shm );
+    return put_unlock( chan );
+}
 
-    fprintf(stdout, "20 "); fflush(stdout);
-    return ret;
+enum ach_status
+ach_put_abort( ach_channel_t *chan ) {
+    assert( chan->shm->sync.dirty || (chan->shm->flags & ACH_HEADER_SINGLE_WRITER) );
+    return put_unlock( chan );
+}
 
+enum ach_status
+ach_put_loud( ach_channel_t *chan, const void *buf, size_t len ) {
+    return ach_put( chan, buf, len );
 }
 
 enum ach_status
@@ -1125,6 +3480,11 @@ ach_close( ach_channel_t *chan ) {
 
     /* fprintf(stderr, "Closing\n"); */
     /* note the close in the channel */
+    reader_release( chan );
+    writer_release( chan );
+#ifdef ACH_TRACE
+    trace_unchannel( chan->shm );
+#endif
     if( chan->attr.map_anon ) {
         /* FIXME: what to do here?? */
         ;
@@ -1156,22 +3516,172 @@ void ach_dump( ach_header_t *shm ) {
     fprintf(stderr, "Magic: %x\n", shm->magic );
     fprintf(stderr, "len: %"PRIuPTR"\n", shm->len );
     fprintf(stderr, "data_size: %"PRIuPTR"\n", shm->data_size );
-    fprintf(stderr, "data_head: %"PRIuPTR"\n", shm->data_head );
-    fprintf(stderr, "data_free: %"PRIuPTR"\n", shm->data_free );
-    fprintf(stderr, "index_head: %"PRIuPTR"\n", shm->index_head );
-    fprintf(stderr, "index_free: %"PRIuPTR"\n", shm->index_free );
-    fprintf(stderr, "last_seq: %"PRIu64"\n", shm->last_seq );
+    fprintf(stderr, "data_head: %"PRIuPTR"\n", ACH_SHM_HOT(shm, data_head) );
+    fprintf(stderr, "data_free: %"PRIuPTR"\n", ACH_SHM_HOT(shm, data_free) );
+    fprintf(stderr, "index_head: %"PRIuPTR"\n", ACH_SHM_HOT(shm, index_head) );
+    fprintf(stderr, "index_free: %"PRIuPTR"\n", ACH_SHM_HOT(shm, index_free) );
+    fprintf(stderr, "last_seq: %"PRIu64"\n", ACH_SHM_HOT(shm, last_seq) );
+    fprintf(stderr, "generation: %"PRIu64"\n", shm->generation );
+    if( shm->flags & ACH_HEADER_SINGLE_WRITER ) {
+        fprintf(stderr, "writer pid: %d\n",
+                (int)ACH_OWNER_PID( ACH_SHM_HOT_BLOCK(shm)->writer_owner ) );
+    }
+    if( shm->flags & ACH_HEADER_MIRROR ) {
+        fprintf(stderr, "data_offset: %"PRIuPTR" (mirrored)\n", shm->data_offset );
+    }
     fprintf(stderr, "head guard:  %"PRIx64"\n", * ACH_SHM_GUARD_HEADER(shm) );
     fprintf(stderr, "index guard: %"PRIx64"\n", * ACH_SHM_GUARD_INDEX(shm) );
     fprintf(stderr, "data guard:  %"PRIx64"\n", * ACH_SHM_GUARD_DATA(shm) );
 
     fprintf(stderr, "head seq:  %"PRIu64"\n",
-            (ACH_SHM_INDEX(shm) +
-             ((shm->index_head - 1 + shm->index_cnt) % shm->index_cnt)) -> seq_num );
+            ACH_SHM_INDEX_AT(shm, (ACH_SHM_HOT(shm, index_head) - 1 + shm->index_cnt)
+                             % shm->index_cnt)->seq_num );
     fprintf(stderr, "head size:  %"PRIuPTR"\n",
-            (ACH_SHM_INDEX(shm) +
-             ((shm->index_head - 1 + shm->index_cnt) % shm->index_cnt)) -> size );
+            ACH_SHM_INDEX_AT(shm, (ACH_SHM_HOT(shm, index_head) - 1 + shm->index_cnt)
+                             % shm->index_cnt)->size );
+
+}
+
+#ifdef ACH_TRACE
+/** Buffers the output of ach_trace_dump() */
+struct trace_out {
+    int fd;
+    int err;
+    uint64_t events;
+    size_t n;
+    char buf[16384];
+};
+
+static void
+trace_flush( struct trace_out *out ) {
+    size_t i = 0;
+    while( i < out->n && ! out->err ) {
+        ssize_t w = write( out->fd, out->buf + i, out->n - i );
+        if( w < 0 ) {
+            if( EINTR != errno ) out->err = 1;
+        } else {
+            i += (size_t)w;
+        }
+    }
+    out->n = 0;
+}
+
+static void
+trace_printf( struct trace_out *out, const char *fmt, ... ) {
+    /* every event fits in what's left after a flush */
+    if( sizeof(out->buf) - out->n < 512 ) trace_flush( out );
+    va_list ap;
+    va_start( ap, fmt );
+    int k = vsnprintf( out->buf + out->n, sizeof(out->buf) - out->n, fmt, ap );
+    va_end( ap );
+    if( k > 0 ) out->n += (size_t)k;
+}
+
+/** Writes one Chrome trace event.  Chrome pairs each "E" with the
+ * last open "B" of the thread. */
+static void
+trace_event( struct trace_out *out, const struct trace_record *t, const char *cat,
+             const char *name, char ph, const char *args ) {
+    trace_printf( out, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+                  "\"ts\":%"PRIu64".%03u,\"pid\":%d,\"tid\":%u%s%s}",
+                  out->events++ ? ",\n" : "\n",
+                  name, cat, ph, t->ns / 1000, (unsigned)(t->ns % 1000),
+                  (int)getpid(), t->tid,
+                  args ? "," : "", args ? args : "" );
+}
+
+/** Name of the channel last mapped at shm, or "" */
+static const char *
+trace_name( const ach_header_t *shm ) {
+    unsigned i;
+    for( i = 0; i < ACH_TRACE_NAMES; i++ ) {
+        if( trace_names[i].shm == shm ) return trace_names[i].name;
+    }
+    return "";
+}
+#endif /* ACH_TRACE */
 
+enum ach_status
+ach_trace_dump( int fd ) {
+#ifdef ACH_TRACE
+    static const char *const how[] = { "cond", "futex", "spin" };
+    struct trace_out *out = (struct trace_out*)malloc( sizeof(*out) );
+    if( NULL == out ) return ACH_FAILED_SYSCALL;
+    out->fd = fd;
+    out->err = 0;
+    out->events = 0;
+    out->n = 0;
+
+    const uint64_t head = __atomic_load_n( &trace_head, __ATOMIC_ACQUIRE );
+    const uint64_t base = __atomic_load_n( &trace_base, __ATOMIC_RELAXED );
+    uint64_t i = head > ACH_TRACE_RECORDS ? head - ACH_TRACE_RECORDS : 0;
+    if( i < base ) i = base;
+
+    trace_printf( out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" );
+    pthread_mutex_lock( &trace_names_lock );
+    for( ; i < head; i++ ) {
+        const struct trace_record *p = &trace_ring[i % ACH_TRACE_RECORDS];
+        if( __atomic_load_n( &p->seq, __ATOMIC_ACQUIRE ) != i + 1 ) continue;
+        struct trace_record t = *p;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        /* overwritten while we copied it */
+        if( __atomic_load_n( &p->seq, __ATOMIC_RELAXED ) != i + 1 ) continue;
+
+        const char *cat = trace_name( t.shm );
+        char args[128];
+        switch( t.event ) {
+        case TRACE_ACQUIRE:
+            trace_event( out, &t, cat, "acquire", 'B', NULL );
+            break;
+        case TRACE_LOCK:
+            if( 0 == t.arg ) trace_event( out, &t, cat, "acquire", 'E', NULL );
+            trace_event( out, &t, cat, "locked", 'B', NULL );
+            break;
+        case TRACE_UNLOCK:
+            trace_event( out, &t, cat, "locked", 'E', NULL );
+            break;
+        case TRACE_WAIT_BEGIN:
+            snprintf( args, sizeof(args), "\"args\":{\"how\":\"%s\"}",
+                      t.arg < sizeof(how)/sizeof(how[0]) ? how[t.arg] : "?" );
+            trace_event( out, &t, cat, "wait", 'B', args );
+            break;
+        case TRACE_WAIT_END:
+            snprintf( args, sizeof(args), "\"args\":{\"status\":\"%s\"}",
+                      ach_result_to_string( (enum ach_status)t.arg ) );
+            trace_event( out, &t, cat, "wait", 'E', args );
+            break;
+        case TRACE_COPY_BEGIN:
+            snprintf( args, sizeof(args), "\"args\":{\"bytes\":%"PRIu64"}", t.arg );
+            trace_event( out, &t, cat, "copy", 'B', args );
+            break;
+        case TRACE_COPY_END:
+            trace_event( out, &t, cat, "copy", 'E', NULL );
+            break;
+        case TRACE_EVICT:
+            snprintf( args, sizeof(args), "\"s\":\"t\",\"args\":{\"frames\":%"PRIu64"}", t.arg );
+            trace_event( out, &t, cat, "evict", 'i', args );
+            break;
+        }
+    }
+    pthread_mutex_unlock( &trace_names_lock );
+    trace_printf( out, "\n]}\n" );
+    trace_flush( out );
+
+    enum ach_status r = out->err ? ACH_FAILED_SYSCALL : ACH_OK;
+    free( out );
+    return r;
+#else
+    (void)fd;
+    return ACH_EINVAL;
+#endif
+}
+
+void
+ach_trace_clear( void ) {
+#ifdef ACH_TRACE
+    __atomic_store_n( &trace_base, __atomic_load_n( &trace_head, __ATOMIC_RELAXED ),
+                      __ATOMIC_RELAXED );
+#endif
 }
 
 void ach_attr_init( ach_attr_t *attr ) {
@@ -1184,6 +3694,232 @@ ach_chmod( ach_channel_t *chan, mode_t mode ) {
 }
 
 
+/** Copies the newest frames of old that fit in new, keeping their
+    sequence numbers, and carries over the pollfd registrations and
+    statistics.
+
+    \pre hold the write locks of both channels
+*/
+static void
+migrate( ach_header_t *old, ach_header_t *new ) {
+    const bool fixed = new->flags & ACH_HEADER_FIXED;
+    const uint64_t last = ACH_SHM_HOT(old, last_seq);
+    size_t i;
+
+    /* handles that opened the new channel by name before we locked
+     * it may have put frames already; ours come first */
+    for( i = 0; i < new->index_cnt; i++ ) {
+        ACH_SHM_INDEX_AT(new, i)->seq_num = 0;
+    }
+
+    /* walk back from the newest frame to the oldest one that fits */
+    uint64_t first = last + 1;
+    size_t used = 0;
+    while( first > 1 && last + 1 - first < new->index_cnt ) {
+        const ach_index_t *idx = ACH_SHM_INDEX_AT(old, (first - 2) % old->index_cnt);
+        if( idx->seq_num != first - 1 ) break; /* evicted */
+        size_t space = fixed ? new->slot_size : ACH_SHM_FRAME_SPACE(new, idx->size);
+        if( (fixed && idx->size > new->slot_size) || used + space > new->data_size ) break;
+        used += space;
+        first--;
+    }
+
+    /* frame s goes in entry (s-1) % index_cnt, as if it were put here */
+    size_t offset = 0;
+    uint64_t seq;
+    for( seq = first; seq <= last; seq++ ) {
+        const ach_index_t *from = ACH_SHM_INDEX_AT(old, (seq - 1) % old->index_cnt);
+        i = (seq - 1) % new->index_cnt;
+        ach_index_t *to = ACH_SHM_INDEX_AT(new, i);
+        if( fixed ) offset = i * new->slot_size;
+        copy_frame( old, from->offset, from->size, ACH_SHM_DATA(new) + offset, SIZE_MAX );
+        to->size = from->size;
+        to->offset = offset;
+        to->seq_num = seq;
+        if( new->flags & ACH_HEADER_TIMES ) {
+            ACH_SHM_INDEX_TIME_AT(new, i)->mono_ns = ACH_SHM_INDEX_TIME_AT(old, (seq - 1) % old->index_cnt)->mono_ns;
+            ACH_SHM_INDEX_TIME_AT(new, i)->real_ns = ACH_SHM_INDEX_TIME_AT(old, (seq - 1) % old->index_cnt)->real_ns;
+        }
+        if( ! fixed ) offset += ACH_SHM_FRAME_SPACE(new, from->size);
+    }
+
+    ACH_SHM_HOT(new, index_head) = last % new->index_cnt;
+    ACH_SHM_HOT(new, index_free) = new->index_cnt - (size_t)(last + 1 - first);
+    ACH_SHM_HOT(new, data_head) = fixed ? ACH_SHM_HOT(new, index_head) * new->slot_size
+        : used % new->data_size;
+    ACH_SHM_HOT(new, data_free) = new->data_size - used;
+    ACH_SHM_HOT(new, last_seq) = last;
+
+    /* the subscribers' sockets don't belong to either channel */
+    if( new->flags & ACH_HEADER_POLLFD ) {
+        memcpy( ACH_SHM_POLLFD(new), ACH_SHM_POLLFD(old), sizeof(ach_pollfd_registry_t) );
+    }
+    if( (old->flags & ACH_HEADER_STATS) && (new->flags & ACH_HEADER_STATS) ) {
+        ach_stats_t *stats = ACH_SHM_STATS(new);
+        uint64_t lock_start_ns = stats->lock_start_ns;
+        memcpy( stats, ACH_SHM_STATS(old), sizeof(*stats) );
+        stats->lock_start_ns = lock_start_ns;
+        /* they still count themselves out on the old channel */
+        stats->waiters = 0;
+    }
+}
+
+enum ach_status
+ach_resize( ach_channel_t *chan, size_t frame_cnt, size_t frame_size ) {
+    if( 0 == frame_cnt || 0 == frame_size ) return ACH_EINVAL;
+
+    /* lock the current channel, which someone may have just replaced */
+    enum ach_status r;
+    do {
+        r = follow_resize( chan );
+        if( ACH_OK != r ) return r;
+        if( chan->attr.map_anon || chan->attr.use_fd ) return ACH_EINVAL;
+        r = wrlock( chan );
+    } while( ACH_RESIZED == r );
+    if( ACH_OK != r ) return r;
+
+    ach_header_t *shm = chan->shm;
+    const uint32_t flags = shm->flags;
+    if( flags & ACH_HEADER_MULTI_PUT ) {
+        unwrlock( shm );
+        return ACH_EINVAL;
+    }
+    /* single-writer puts don't stop for the lock, so only the writer
+     * can be sure none is under way */
+    if( (flags & ACH_HEADER_SINGLE_WRITER) && (int)writer_epoch != chan->writer &&
+        ACH_OK != (r = writer_claim( chan )) )
+    {
+        unwrlock( shm );
+        return r;
+    }
+    char name[1+ACH_CHAN_NAME_MAX];
+    memcpy( name, shm->name, sizeof(name) );
+
+    /* same options as the old channel */
+    ach_create_attr_t attr;
+    ach_create_attr_init( &attr );
+    attr.set_clock = 1;
+    attr.clock = shm->clock;
+    attr.futex = !!(flags & ACH_HEADER_FUTEX);
+    attr.pollfd = !!(flags & ACH_HEADER_POLLFD);
+    attr.no_stats = !(flags & ACH_HEADER_STATS);
+    attr.lock_times = !!(flags & ACH_HEADER_LOCK_TIMES);
+    attr.huge_pages = (flags & ACH_HEADER_HUGETLB) ? ACH_HUGE_TLB :
+        (flags & ACH_HEADER_THP) ? ACH_HUGE_TRANSPARENT : ACH_HUGE_NONE;
+    attr.populate = !!(flags & ACH_HEADER_POPULATE);
+    attr.lock_memory = !!(flags & ACH_HEADER_MLOCK);
+    attr.layout = ACH_SHM_IS_V2(shm) ? ACH_LAYOUT_2 : ACH_LAYOUT_1;
+    attr.fixed_size = !!(flags & ACH_HEADER_FIXED);
+    attr.timestamps = !!(flags & ACH_HEADER_TIMES);
+    attr.readers = !!(flags & ACH_HEADER_READERS);
+    attr.single_writer = !!(flags & ACH_HEADER_SINGLE_WRITER);
+    attr.mirror = !!(flags & ACH_HEADER_MIRROR);
+
+    /* refuse before touching anything if the newest frame won't fit */
+    const uint64_t last = ACH_SHM_HOT(shm, last_seq);
+    if( last ) {
+        size_t size = ACH_SHM_INDEX_AT(shm, (last - 1) % shm->index_cnt)->size;
+        size_t space = ACH_SHM_IS_V2(shm) ? ACH_ALIGN64(frame_size) : frame_size;
+        if( attr.fixed_size ? size > space
+            : ACH_SHM_FRAME_SPACE(shm, size) > frame_cnt * space )
+        {
+            unwrlock( shm );
+            return ACH_OVERFLOW;
+        }
+    }
+
+    /* Build the new channel beside the old one and only rename it
+     * over the old file once it holds the frames, so a failure leaves
+     * the old channel where it was.  Channel names never start with
+     * '.', so the temporary file can't belong to another channel.
+     * Resizes of one channel are serialized by its lock, and a file
+     * left by one that died is truncated. */
+    char shm_name[ACH_CHAN_NAME_MAX + 16];
+    char tmp_name[ACH_CHAN_NAME_MAX + 16];
+    char shm_path[ACH_SHMPATH_MAX];
+    char tmp_path[ACH_SHMPATH_MAX];
+    const int huge = !!(flags & ACH_HEADER_HUGETLB);
+    if( ACH_OK != (r = shmfile_for_channel_name( name, shm_name, sizeof(shm_name) )) ) {
+        unwrlock( shm );
+        return r;
+    }
+    snprintf( tmp_name, sizeof(tmp_name), "%s.%s", ACH_CHAN_NAME_PREFIX, name );
+    shmpath_for_shmfile( shm_name, huge, shm_path, sizeof(shm_path) );
+    shmpath_for_shmfile( tmp_name, huge, tmp_path, sizeof(tmp_path) );
+
+    attr.truncate = 1;
+    if( ACH_OK != (r = create_channel( name, tmp_name, frame_cnt, frame_size, &attr )) ) {
+        unlink( tmp_path );
+        unwrlock( shm );
+        return r;
+    }
+
+    ach_channel_t next;
+    {
+        int tmp_huge = huge;
+        int fd = fd_for_shmfile( tmp_name, 0, &tmp_huge );
+        if( fd < 0 ) {
+            r = check_errno();
+            unlink( tmp_path );
+            unwrlock( shm );
+            return r;
+        }
+        ach_attr_t open_attr = chan->attr;
+        open_attr.use_fd = 1;
+        open_attr.fd = fd;
+        r = ach_open( &next, name, &open_attr );
+        close( fd );
+        if( ACH_OK != r ) {
+            unlink( tmp_path );
+            unwrlock( shm );
+            return r;
+        }
+        /* it will be found by name once renamed */
+        next.attr.use_fd = 0;
+    }
+    if( ACH_OK != (r = wrlock( &next )) ) {
+        ach_close( &next );
+        unlink( tmp_path );
+        unwrlock( shm );
+        return r;
+    }
+
+    migrate( shm, next.shm );
+    next.shm->generation = shm->generation + 1;
+    if( flags & ACH_HEADER_SINGLE_WRITER ) {
+        /* carry our claim over */
+        ACH_SHM_HOT_BLOCK(next.shm)->reserve_seq = ACH_SHM_HOT(next.shm, last_seq);
+        ACH_SHM_HOT_BLOCK(next.shm)->writer_owner = ACH_SHM_HOT_BLOCK(shm)->writer_owner;
+        next.writer = chan->writer;
+    }
+
+    /* new opens now find the new channel */
+    if( 0 != rename( tmp_path, shm_path ) ) {
+        r = check_errno();
+        unwrlock( next.shm );
+        ach_close( &next );
+        unlink( tmp_path );
+        unwrlock( shm );
+        return r;
+    }
+    r = unwrlock( next.shm );
+
+    /* waiters wake on the unlock, see the flag, and follow */
+    __atomic_or_fetch( &shm->flags, ACH_HEADER_RESIZED, __ATOMIC_RELEASE );
+    enum ach_status r_old = unwrlock( shm );
+    if( ACH_OK == r ) r = r_old;
+
+    next.seq_num = chan->seq_num;
+    next.next_index = chan->seq_num % next.shm->index_cnt;
+    next.cancel = chan->cancel;
+    reader_seek( &next );
+    r_old = ach_close( chan );
+    if( ACH_OK == r ) r = r_old;
+    *chan = next;
+
+    return r;
+}
+
 enum ach_status
 ach_unlink( const char *name ) {
     char shm_name[ACH_CHAN_NAME_MAX + 16];
@@ -1191,6 +3927,12 @@ ach_unlink( const char *name ) {
     if( ACH_OK == r ) {
         /*r = shm_unlink(name); */
         int i = shm_unlink(shm_name);
+        if( 0 != i && ENOENT == errno ) {
+            /* maybe on hugetlbfs */
+            char huge_name[ACH_HUGEFILE_MAX];
+            hugefile_for_channel_name( shm_name, huge_name, sizeof(huge_name) );
+            i = unlink( huge_name );
+        }
         if( 0 == i ) {
             return  ACH_OK;
         } else {
@@ -1202,6 +3944,267 @@ ach_unlink( const char *name ) {
 }
 
 
+enum ach_status
+ach_channel_send( int sock, const ach_channel_t *chan ) {
+#ifdef __linux__
+    /* heap channels have nothing to send */
+    if( chan->fd < 0 ) return ACH_EINVAL;
+
+    char byte = 0;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+    memset( &ctl, 0, sizeof(ctl) );
+    struct msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy( CMSG_DATA(cmsg), &chan->fd, sizeof(int) );
+
+    ssize_t r;
+    int i = 0;
+    do {
+        r = sendmsg( sock, &msg, MSG_NOSIGNAL );
+    }while( -1 == r && EINTR == errno && i++ < ACH_INTR_RETRY );
+    return (1 == r) ? ACH_OK : check_errno();
+#else
+    (void)sock; (void)chan;
+    return ACH_EINVAL;
+#endif
+}
+
+enum ach_status
+ach_channel_recv( int sock, ach_channel_t *chan, ach_attr_t *attr ) {
+#ifdef __linux__
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } ctl;
+    struct msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    ssize_t r;
+    int i = 0;
+    do {
+        r = recvmsg( sock, &msg, MSG_CMSG_CLOEXEC );
+    }while( -1 == r && EINTR == errno && i++ < ACH_INTR_RETRY );
+    if( 0 == r ) return ACH_CLOSED;
+    if( r < 0 ) return check_errno();
+
+    int fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+    if( cmsg && SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type &&
+        CMSG_LEN(sizeof(int)) == cmsg->cmsg_len )
+    {
+        memcpy( &fd, CMSG_DATA(cmsg), sizeof(int) );
+    }
+    if( fd < 0 ) return ACH_BAD_SHM_FILE;
+
+    ach_attr_t fd_attr;
+    if( attr ) fd_attr = *attr;
+    else ach_attr_init( &fd_attr );
+    fd_attr.use_fd = 1;
+    fd_attr.fd = fd;
+    enum ach_status s = ach_open( chan, NULL, &fd_attr );
+    /* ach_open() keeps its own descriptor */
+    close( fd );
+    return s;
+#else
+    (void)sock; (void)chan; (void)attr;
+    return ACH_EINVAL;
+#endif
+}
+
+#if defined(ACH_HAVE_FUTEX) && defined(SYS_futex_waitv)
+static long
+futex_waitv( struct futex_waitv *waiters, size_t n,
+             const struct timespec *abstime, clockid_t clock ) {
+    return syscall( SYS_futex_waitv, waiters, (unsigned)n, 0, abstime, clock );
+}
+#endif
+
+enum ach_status
+ach_wait_any( ach_channel_t *const *chans, size_t n, int *ready,
+              const struct timespec *ACH_RESTRICT abstime ) {
+#if defined(ACH_HAVE_FUTEX) && defined(SYS_futex_waitv)
+    if( 0 == n || n > FUTEX_WAITV_MAX ) return ACH_EINVAL;
+
+    size_t i;
+    for( i = 0; i < n; i++ ) {
+        enum ach_status r = follow_resize( chans[i] );
+        if( ACH_OK != r ) return r;
+    }
+
+    /* futexes only time out against these clocks, and one of them
+     * for the whole wait */
+    clockid_t clock = chans[0]->shm->clock;
+    if( abstime ) {
+        if( CLOCK_MONOTONIC != clock && CLOCK_REALTIME != clock ) return ACH_EINVAL;
+        for( i = 1; i < n; i++ ) {
+            if( chans[i]->shm->clock != clock ) return ACH_EINVAL;
+        }
+    }
+
+    struct futex_waitv waiters[n];
+    memset( waiters, 0, sizeof(waiters) );
+    for( i = 0; i < n; i++ ) {
+        waiters[i].uaddr = (uintptr_t)&ACH_SHM_HOT(chans[i]->shm, futex);
+        waiters[i].flags = FUTEX_32;
+        __atomic_add_fetch( &ACH_SHM_HOT(chans[i]->shm, futex_waiters), 1, __ATOMIC_SEQ_CST );
+    }
+
+    /* Same as futex_wait(), over every channel at once.  Puts bump
+     * the futex even on channels that wait on the condition
+     * variable. */
+    enum ach_status r = ACH_OK;
+    for(;;) {
+        size_t ready_cnt = 0;
+        bool canceled = 0;
+        for( i = 0; i < n; i++ ) {
+            ach_header_t *shm = chans[i]->shm;
+            waiters[i].val = __atomic_load_n( &ACH_SHM_HOT(shm, futex), __ATOMIC_SEQ_CST );
+            canceled = canceled || chans[i]->cancel;
+            /* a get on a resized channel follows it */
+            ready[i] = ( chans[i]->seq_num !=
+                         __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE ) ||
+                         resized( shm ) );
+            ready_cnt += (size_t)ready[i];
+        }
+        if( canceled ) {
+            r = ACH_CANCELED;
+            break;
+        } else if( ready_cnt ) {
+            break;
+        }
+        /* sleeps only if nothing has been put since we read the vals */
+        if( -1 == futex_waitv( waiters, n, abstime, clock ) ) {
+            if( ETIMEDOUT == errno ) {
+                r = ACH_TIMEOUT;
+                break;
+            } else if( EAGAIN != errno && EINTR != errno ) {
+                r = ACH_FAILED_SYSCALL;
+                break;
+            }
+        }
+    }
+
+    for( i = 0; i < n; i++ ) {
+        __atomic_sub_fetch( &ACH_SHM_HOT(chans[i]->shm, futex_waiters), 1, __ATOMIC_SEQ_CST );
+    }
+    return r;
+#else
+    (void)chans; (void)n; (void)ready; (void)abstime;
+    return ACH_EINVAL;
+#endif
+}
+
+enum ach_status
+ach_pollfd_open( ach_channel_t *chan, int *fd ) {
+#ifdef ACH_HAVE_POLLFD
+    {
+        enum ach_status r = follow_resize( chan );
+        if( ACH_OK != r ) return r;
+    }
+    ach_header_t *shm = chan->shm;
+    if( ! (shm->flags & ACH_HEADER_POLLFD) ) return ACH_EINVAL;
+    ach_pollfd_registry_t *reg = ACH_SHM_POLLFD(shm);
+
+    int s = socket( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if( s < 0 ) return ACH_FAILED_SYSCALL;
+
+    uint64_t slot = ((uint64_t)(uint32_t)getpid() << 32) | (uint32_t)s;
+    struct sockaddr_un addr;
+    socklen_t len = pollfd_addr( &addr, slot );
+    if( bind( s, (struct sockaddr*)&addr, len ) ) {
+        close(s);
+        return ACH_FAILED_SYSCALL;
+    }
+
+    /* claim a free slot */
+    size_t i;
+    for( i = 0; i < ACH_POLLFD_MAX; i++ ) {
+        uint64_t expected = 0;
+        if( __atomic_compare_exchange_n( &reg->slot[i], &expected, slot, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+        {
+            __atomic_add_fetch( &reg->cnt, 1, __ATOMIC_RELEASE );
+            *fd = s;
+            return ACH_OK;
+        }
+    }
+    close(s);
+    return ACH_OVERFLOW;
+#else
+    (void)chan; (void)fd;
+    return ACH_EINVAL;
+#endif
+}
+
+enum ach_status
+ach_pollfd_clear( int fd ) {
+#ifdef ACH_HAVE_POLLFD
+    char buf[64];
+    for(;;) {
+        if( recv( fd, buf, sizeof(buf), MSG_DONTWAIT ) >= 0 ) continue;
+        else if( EINTR == errno ) continue;
+        else if( EAGAIN == errno || EWOULDBLOCK == errno ) return ACH_OK;
+        else return ACH_FAILED_SYSCALL;
+    }
+#else
+    (void)fd;
+    return ACH_EINVAL;
+#endif
+}
+
+enum ach_status
+ach_pollfd_close( ach_channel_t *chan, int fd ) {
+#ifdef ACH_HAVE_POLLFD
+    {
+        enum ach_status r = follow_resize( chan );
+        if( ACH_OK != r ) return r;
+    }
+    ach_header_t *shm = chan->shm;
+    if( ! (shm->flags & ACH_HEADER_POLLFD) ) return ACH_EINVAL;
+    ach_pollfd_registry_t *reg = ACH_SHM_POLLFD(shm);
+
+    uint64_t slot = ((uint64_t)(uint32_t)getpid() << 32) | (uint32_t)fd;
+    size_t i;
+    for( i = 0; i < ACH_POLLFD_MAX; i++ ) {
+        uint64_t expected = slot;
+        if( __atomic_compare_exchange_n( &reg->slot[i], &expected, 0, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+        {
+            __atomic_sub_fetch( &reg->cnt, 1, __ATOMIC_RELEASE );
+            break;
+        }
+    }
+    /* a put may already have freed the slot, still close the socket */
+    if( close(fd) ) return ACH_FAILED_SYSCALL;
+    return ACH_OK;
+#else
+    (void)chan; (void)fd;
+    return ACH_EINVAL;
+#endif
+}
+
 void
 ach_cancel_attr_init( ach_cancel_attr_t *attr ) {
     memset(attr, 0, sizeof(*attr));
@@ -1213,19 +4216,27 @@ enum ach_status
 ach_cancel( ach_channel_t *chan, const ach_cancel_attr_t *attr ) {
     if( NULL == attr ) attr = &default_cancel_attr;
 
-    if( attr->async_unsafe ) {
+    if( chan->shm->flags & ACH_HEADER_FUTEX ) {
+        /* Bumping the futex is async-signal-safe, and waiters
+         * re-check cancel whenever it changes. */
+        chan->cancel = 1;
+        return futex_wake( chan->shm );
+    } else if( attr->async_unsafe ) {
         /* Don't be async safe, i.e., called from another thread */
         enum ach_status r = chan_lock(chan);
         if( ACH_OK != r ) return r;
         chan->cancel = 1;
-        if( pthread_mutex_unlock( &chan->shm->sync.mutex ) ) return ACH_FAILED_SYSCALL;
+        if( chan_unlock( chan->shm ) ) return ACH_FAILED_SYSCALL;
         if( pthread_cond_broadcast( &chan->shm->sync.cond ) )  {
             return ACH_FAILED_SYSCALL;
         }
-        return ACH_OK;
+        return wake_any( chan->shm );
     } else {
         /* Async safe, i.e., called from from a signal handler */
         chan->cancel = 1; /* Set cancel from the parent */
+        /* ach_wait_any() doesn't need the child */
+        enum ach_status r = wake_any( chan->shm );
+        if( ACH_OK != r ) return r;
         pid_t pid = fork();
         if( 0 == pid ) { /* child */
             /* Now we can touch the synchronization variables in
@@ -1251,7 +4262,7 @@ ach_cancel( ach_channel_t *chan, const ach_cancel_attr_t *attr ) {
              * inside ach_get() must be waiting on the condition
              * variable */
             /* Unlock Mutex */
-            if( pthread_mutex_unlock( &chan->shm->sync.mutex ) ) {
+            if( chan_unlock( chan->shm ) ) {
                 DEBUG_PERROR("ach_cancel pthread_mutex_unlock()");
                 exit(EXIT_FAILURE);
             }
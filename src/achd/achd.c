@@ -404,6 +404,8 @@ void achd_serve() {
     conn.pipeframe_size =
         cx.channel.shm->data_size / cx.channel.shm->index_cnt;
     conn.pipeframe = ach_pipe_alloc( conn.pipeframe_size );
+    conn.batch_size = cx.channel.shm->data_size;
+    conn.batch = (uint8_t*)malloc( conn.batch_size );
 
     /* start i/o */
     conn.vtab->handler( &conn );
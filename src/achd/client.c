@@ -128,6 +128,8 @@ void achd_client() {
     conn.pipeframe_size =
         cx.channel.shm->data_size / cx.channel.shm->index_cnt;
     conn.pipeframe = ach_pipe_alloc( conn.pipeframe_size );
+    conn.batch_size = cx.channel.shm->data_size;
+    conn.batch = (uint8_t*)malloc( conn.batch_size );
 
     /* TODO: If we lose and then re-establish a connections, frames
      * may be missed or duplicated.
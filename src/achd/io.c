@@ -61,6 +61,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <limits.h>
+#include <sys/uio.h>
 
 #include "ach.h"
 #include "achutil.h"
@@ -90,6 +92,39 @@ ssize_t achd_write(int fd, const void *buf, size_t cnt ) {
     return (ssize_t)cnt;
 }
 
+ssize_t achd_writev(int fd, const struct iovec *iov, int iovcnt ) {
+    size_t n = 0;
+    size_t w = 0;
+    for(;;) {
+        /* skip what was written */
+        while( iovcnt > 0 && w >= iov->iov_len ) {
+            w -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if( w ) {
+            /* finish a partially written buffer */
+            ssize_t r = achd_write( fd, (uint8_t*)iov->iov_base + w, iov->iov_len - w );
+            if( r < 0 ) return r;
+            n += (size_t)r;
+            w = 0;
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        if( 0 == iovcnt || cx.sig_received ) break;
+
+        ssize_t r = writev( fd, iov, (iovcnt < IOV_MAX) ? iovcnt : IOV_MAX );
+        if( r > 0 ) {
+            n += (size_t)r;
+            w = (size_t)r;
+        }
+        else if (r < 0 && EINTR == errno && !cx.sig_received) continue;
+        else return r;
+    }
+    return (ssize_t)n;
+}
+
 int achd_getc(int fd) {
     char c;
     ssize_t r = achd_read(fd, &c, 1);
@@ -63,6 +63,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <poll.h>
+#include <sys/uio.h>
 
 #include "ach.h"
 #include "achutil.h"
@@ -74,7 +75,7 @@ struct udp_cx {
     struct sockaddr_in addr;
 };
 
-static void get_frame( struct achd_conn *conn );
+static void get_frames( struct achd_conn *conn );
 static void put_frame( struct achd_conn *conn );
 
 
@@ -84,10 +85,13 @@ static void put_frame( struct achd_conn *conn );
 #define MTU_ETH 1500
 
 
-static void get_frame( struct achd_conn *conn ) {
+/* Receive the next batch of frames into conn->batch */
+static void get_frames( struct achd_conn *conn ) {
     int done = 0;
     unsigned long period_ns = conn->send_hdr.period_ns ? conn->send_hdr.period_ns : conn->recv_hdr.period_ns;
     int last = conn->send_hdr.get_last || conn->recv_hdr.get_last;
+    /* when rate limited, send the backlog one frame per period */
+    size_t max_frames = period_ns ? 1 : ACHD_BATCH_FRAMES;
 
     /* maybe delay */
     if( period_ns &&
@@ -97,22 +101,22 @@ static void get_frame( struct achd_conn *conn ) {
     }
 
     do {
-        size_t frame_size = 0;
-        ach_status_t r  = ach_get( &cx.channel, conn->pipeframe->data, conn->pipeframe_size, &frame_size,  NULL,
-                                   ACH_O_WAIT | (last ? ACH_O_LAST : 0) );
+        ach_status_t r  = ach_get_many( &cx.channel, conn->batch, conn->batch_size,
+                                        conn->batch_frames, max_frames, &conn->batch_cnt, NULL,
+                                        ACH_O_WAIT | (last ? ACH_O_LAST : 0) );
         /* check return code */
         switch(r) {
         case ACH_OVERFLOW:
-            ACH_LOG( LOG_NOTICE, "buffer too small, resizing to %" PRIuPTR "\n", frame_size);
+            ACH_LOG( LOG_NOTICE, "buffer too small, resizing to %" PRIuPTR "\n",
+                     conn->batch_frames[0].size );
             /* enlarge buffer and retry on overflow */
-            assert(frame_size > conn->pipeframe_size );
-            conn->pipeframe_size = frame_size;
-            free(conn->pipeframe);
-            conn->pipeframe = ach_pipe_alloc( conn->pipeframe_size );
+            assert(conn->batch_frames[0].size > conn->batch_size );
+            conn->batch_size = conn->batch_frames[0].size;
+            free(conn->batch);
+            conn->batch = (uint8_t*)malloc( conn->batch_size );
             break;
         case ACH_OK:
         case ACH_MISSED_FRAME:
-            ach_pipe_set_size( conn->pipeframe, frame_size );
             done = 1;
             clock_gettime( ACH_DEFAULT_CLOCK, &conn->ts_last );
         case ACH_CANCELED:
@@ -207,16 +211,29 @@ void achd_push_tcp( struct achd_conn *conn ) {
         /* } */
 
         /* read the data */
-        get_frame(conn);
+        get_frames(conn);
 
         if( cx.sig_received ) break;
 
-        /* stream send */
+        /* stream send, all frames of the batch at once */
+        ach_pipe_frame_t header[ACHD_BATCH_FRAMES];
+        struct iovec iov[2*ACHD_BATCH_FRAMES];
+        size_t i, size = 0;
+        for( i = 0; i < conn->batch_cnt; i ++ ) {
+            memcpy( header[i].magic, "achpipe", 8 );
+            ach_pipe_set_size( &header[i], conn->batch_frames[i].size );
+            iov[2*i].iov_base = &header[i];
+            iov[2*i].iov_len = sizeof(ach_pipe_frame_t) - 1;
+            iov[2*i+1].iov_base = conn->batch + conn->batch_frames[i].offset;
+            iov[2*i+1].iov_len = conn->batch_frames[i].size;
+            size += iov[2*i].iov_len + iov[2*i+1].iov_len;
+        }
+
         int sent_frame = 0;
         do {
-            size_t size = sizeof(ach_pipe_frame_t) - 1 + ach_pipe_get_size(conn->pipeframe);
-            ACH_LOG( LOG_DEBUG, "Writing frame, %" PRIuPTR " bytes total\n", size);
-            ssize_t r = achd_write( conn->out, conn->pipeframe, size );
+            ACH_LOG( LOG_DEBUG, "Writing %" PRIuPTR " frames, %" PRIuPTR " bytes total\n",
+                     conn->batch_cnt, size);
+            ssize_t r = achd_writev( conn->out, iov, (int)(2*conn->batch_cnt) );
             if( r < 0 || (size_t)r != size ) {
                 ACH_LOG( LOG_ERR, "Couldn't write frame\n");
                 if( cx.reconnect ) achd_reconnect(conn);
@@ -352,54 +369,57 @@ void achd_push_udp( struct achd_conn *conn ) {
                              .events = POLLIN } };
     while( !cx.sig_received ) {
         /* read the data */
-        get_frame(conn);
+        get_frames(conn);
 
         if( cx.sig_received ) break;
 
-        /* Check size */
-        size_t cnt = ach_pipe_get_size( conn->pipeframe );
-        if( cnt > MTU_UDP ) {
-            if( ! warned_mtu_udp ) {
-                ACH_LOG( LOG_ERR, "Cannot send %" PRIuPTR " bytes via UDP\n", cnt );
-                warned_mtu_udp = 1;
+        size_t i;
+        for( i = 0; i < conn->batch_cnt && !cx.sig_received; i ++ ) {
+            /* Check size */
+            size_t cnt = conn->batch_frames[i].size;
+            if( cnt > MTU_UDP ) {
+                if( ! warned_mtu_udp ) {
+                    ACH_LOG( LOG_ERR, "Cannot send %" PRIuPTR " bytes via UDP\n", cnt );
+                    warned_mtu_udp = 1;
+                }
+                continue;
+            } else if ( cnt + HEADER_BYTES_UDP + HEADER_BYTES_IPV4 > MTU_ETH &&
+                        ! warned_mtu_eth ) {
+                ACH_LOG( LOG_WARNING, "Size %" PRIuPTR " exceeds typical ethernet MTU\n",
+                         cnt + HEADER_BYTES_UDP + HEADER_BYTES_IPV4 );
+                warned_mtu_eth = 1;
             }
-            continue;
-        } else if ( cnt + HEADER_BYTES_UDP + HEADER_BYTES_IPV4 > MTU_ETH &&
-                    ! warned_mtu_eth ) {
-            ACH_LOG( LOG_WARNING, "Size %" PRIuPTR " exceeds typical ethernet MTU\n",
-                     cnt + HEADER_BYTES_UDP + HEADER_BYTES_IPV4 );
-            warned_mtu_eth = 1;
-        }
 
-        /* Poll fds */
-        /* TODO: does O_NONBLOCK make sense? */
-        pfd[0].revents = 0;
-        while( ! (pfd[0].revents & POLLOUT) ) {
-            int r = udp_poll( pfd );
-            if( r < 0 ) {
-                if( cx.reconnect ) {
-                    achd_reconnect(conn);
-                    udp_peer( conn, &addr_udp );
-                } else return;
-            } else if( cx.sig_received ) {
-                return;
-            } else if ( ! (pfd[0].revents & POLLOUT) ) {
-                ACH_LOG(LOG_ERR, "No output possible after poll\n");
+            /* Poll fds */
+            /* TODO: does O_NONBLOCK make sense? */
+            pfd[0].revents = 0;
+            while( ! (pfd[0].revents & POLLOUT) ) {
+                int r = udp_poll( pfd );
+                if( r < 0 ) {
+                    if( cx.reconnect ) {
+                        achd_reconnect(conn);
+                        udp_peer( conn, &addr_udp );
+                    } else return;
+                } else if( cx.sig_received ) {
+                    return;
+                } else if ( ! (pfd[0].revents & POLLOUT) ) {
+                    ACH_LOG(LOG_ERR, "No output possible after poll\n");
+                }
             }
-        }
 
 
-        /* UDP Send */
-        ssize_t r = -1;
-        ACH_LOG( LOG_DEBUG, "Sending %"PRIuPTR" UDP bytes\n", cnt );
-        do {
-            r = sendto( conn->aux, conn->pipeframe->data, cnt, 0,
-                        (struct sockaddr*) &addr_udp, sizeof(addr_udp) );
-        } while( r < 0 && !cx.sig_received && EINTR == errno );
+            /* UDP Send */
+            ssize_t r = -1;
+            ACH_LOG( LOG_DEBUG, "Sending %"PRIuPTR" UDP bytes\n", cnt );
+            do {
+                r = sendto( conn->aux, conn->batch + conn->batch_frames[i].offset, cnt, 0,
+                            (struct sockaddr*) &addr_udp, sizeof(addr_udp) );
+            } while( r < 0 && !cx.sig_received && EINTR == errno );
 
-        if( r < 0 || (size_t)r != cnt ) {
-            cx.error( ACH_FAILED_SYSCALL, "Couldn't send UDP message to %s:%d, %s (%d)\n",
-                      inet_ntoa(addr_udp.sin_addr), ntohs(addr_udp.sin_port), strerror(errno), errno );
+            if( r < 0 || (size_t)r != cnt ) {
+                cx.error( ACH_FAILED_SYSCALL, "Couldn't send UDP message to %s:%d, %s (%d)\n",
+                          inet_ntoa(addr_udp.sin_addr), ntohs(addr_udp.sin_port), strerror(errno), errno );
+            }
         }
     }
 }
@@ -70,6 +70,10 @@ static struct log_desc {
     FILE *fout;
 } *log_desc = NULL;
 static size_t n_log = 0;
+
+/* Most frames to take from a channel at once */
+#define LOG_BATCH 64
+
 static double opt_freq = 0;
 static int opt_last = 0;
 static int opt_gzip = 0;
@@ -116,34 +120,43 @@ static void *worker( void *arg ) {
                  desc->name, strerror(errno) );
     }
 
-    size_t max = 512;
-    ach_pipe_frame_t *frame = ach_pipe_alloc( max );
+    /* The backlog can't exceed the channel's data size */
+    size_t max = desc->chan.shm->data_size;
+    uint8_t *buf = (uint8_t*)malloc( max );
+    ach_frame_desc_t frames[LOG_BATCH];
+    ach_pipe_frame_t *header = ach_pipe_alloc( 0 );
+    const size_t header_size = sizeof(ach_pipe_frame_t) - 1;
 
     /* get frames */
     int canceled = 0;
     while( ! canceled ) {
         /* push the data */
-        size_t frame_size;
-        ach_status_t r = ach_get( &desc->chan, frame->data, max, &frame_size,  NULL,
-                                  ACH_O_WAIT | ((opt_last ) ? ACH_O_LAST : 0) );
+        size_t frame_cnt;
+        ach_status_t r = ach_get_many( &desc->chan, buf, max,
+                                       frames, LOG_BATCH, &frame_cnt, NULL,
+                                       ACH_O_WAIT | ((opt_last ) ? ACH_O_LAST : 0) );
         switch(r) {
         case ACH_OVERFLOW:
             /* enlarge buffer and retry on overflow */
-            assert(frame_size > max );
-            max = frame_size;
-            free(frame);
-            frame = ach_pipe_alloc( max );
+            assert(frames[0].size > max );
+            max = frames[0].size;
+            free(buf);
+            buf = (uint8_t*)malloc( max );
             continue;
         case ACH_MISSED_FRAME:
         case ACH_OK:
         {
-            ach_pipe_set_size( frame, frame_size );
-            size_t size = sizeof(ach_pipe_frame_t) - 1 + frame_size;
-            size_t s = fwrite( frame, 1, size, desc->fout );
-            if( s != size ) {
-                ACH_LOG( LOG_ERR, "Could not write frame to %s, %"PRIuPTR" written instead of %"PRIuPTR"\n",
-                         desc->name, s, size );
-                canceled = 1;
+            size_t i;
+            for( i = 0; i < frame_cnt && !canceled; i ++ ) {
+                ach_pipe_set_size( header, frames[i].size );
+                if( header_size != fwrite( header, 1, header_size, desc->fout ) ||
+                    frames[i].size != fwrite( buf + frames[i].offset, 1,
+                                              frames[i].size, desc->fout ) )
+                {
+                    ACH_LOG( LOG_ERR, "Could not write frame to %s: %s\n",
+                             desc->name, strerror(errno) );
+                    canceled = 1;
+                }
             }
         }
         break;
@@ -157,6 +170,8 @@ static void *worker( void *arg ) {
             break;
         }
     }
+    free( header );
+    free( buf );
 
     /* sync */
     if( fflush(desc->fout) ) {
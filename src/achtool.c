@@ -62,13 +62,32 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ach.h"
 #include "achutil.h"
 #include "achd.h"
 
 size_t opt_msg_cnt = ACH_DEFAULT_FRAME_COUNT;
+int opt_msg_cnt_set = 0;
 int opt_truncate = 0;
+int opt_pollfd = 0;
+int opt_huge = ACH_HUGE_NONE;
+int opt_populate = 0;
+int opt_lock = 0;
+int opt_layout = ACH_LAYOUT_DEFAULT;
+int opt_fixed = 0;
+int opt_times = 0;
+int opt_readers = 0;
+int opt_multi_put = 0;
+int opt_single_writer = 0;
+int opt_mirror = 0;
+int opt_lock_times = 0;
 size_t opt_msg_size = ACH_DEFAULT_FRAME_SIZE;
+int opt_msg_size_set = 0;
 char *opt_chan_name = NULL;
 int opt_verbosity = 0;
 int opt_1 = 0;
@@ -94,9 +113,12 @@ static int parse_mode( const char *arg ) {
 /* Commands */
 int cmd_file(void);
 int cmd_dump(void);
+int cmd_stat(void);
+int cmd_top(void);
 int cmd_unlink(void);
 int cmd_create(void);
 int cmd_chmod(void);
+int cmd_resize(void);
 
 void cleanup() {
     if(opt_chan_name) free(opt_chan_name);
@@ -126,6 +148,12 @@ static void posarg(int i, const char *arg) {
             set_cmd( cmd_dump );
         } else if( 0 == strcasecmp(arg, "file") ) {
             set_cmd( cmd_file );
+        } else if( 0 == strcasecmp(arg, "stat") ) {
+            set_cmd( cmd_stat );
+        } else if( 0 == strcasecmp(arg, "top") ) {
+            set_cmd( cmd_top );
+        } else if( 0 == strcasecmp(arg, "resize") ) {
+            set_cmd( cmd_resize );
         } else {
             goto INVALID;
         }
@@ -170,7 +198,7 @@ int main( int argc, char **argv ) {
     /* Parse Options */
     int c, i = 0;
     opterr = 0;
-    while( (c = getopt( argc, argv, "C:U:D:F:vn:m:o:1thH?V")) != -1 ) {
+    while( (c = getopt( argc, argv, "C:U:D:F:vn:m:o:12tpTGPLOfSRMWdlhH?V")) != -1 ) {
         switch(c) {
         case 'C':   /* create   */
             parse_cmd( cmd_create, optarg );
@@ -186,9 +214,11 @@ int main( int argc, char **argv ) {
             break;
         case 'n':   /* msg-size */
             opt_msg_size = (size_t)atoi( optarg );
+            opt_msg_size_set = 1;
             break;
         case 'm':   /* msg-cnt  */
             opt_msg_cnt = (size_t)atoi( optarg );
+            opt_msg_cnt_set = 1;
             break;
         case 'o':   /* mode     */
             opt_mode = parse_mode( optarg );
@@ -196,6 +226,48 @@ int main( int argc, char **argv ) {
         case 't':   /* truncate */
             opt_truncate++;
             break;
+        case 'p':   /* pollfd   */
+            opt_pollfd++;
+            break;
+        case 'T':   /* transparent huge pages */
+            opt_huge = ACH_HUGE_TRANSPARENT;
+            break;
+        case 'G':   /* hugetlbfs */
+            opt_huge = ACH_HUGE_TLB;
+            break;
+        case 'P':   /* prefault */
+            opt_populate++;
+            break;
+        case 'L':   /* mlock    */
+            opt_lock++;
+            break;
+        case 'O':   /* old layout */
+            opt_layout = ACH_LAYOUT_1;
+            break;
+        case 'l':   /* lock times */
+            opt_lock_times++;
+            break;
+        case '2':   /* cache line layout */
+            opt_layout = ACH_LAYOUT_2;
+            break;
+        case 'f':   /* fixed-size frames */
+            opt_fixed++;
+            break;
+        case 'S':   /* timestamps */
+            opt_times++;
+            break;
+        case 'R':   /* reader table */
+            opt_readers++;
+            break;
+        case 'M':   /* lock-free puts */
+            opt_multi_put++;
+            break;
+        case 'W':   /* single writer */
+            opt_single_writer++;
+            break;
+        case 'd':   /* double-mapped data */
+            opt_mirror++;
+            break;
         case 'v':   /* verbose  */
             opt_verbosity++;
             break;
@@ -208,7 +280,7 @@ int main( int argc, char **argv ) {
         case '?':   /* help     */
         case 'h':
         case 'H':
-            puts( "Usage: ach [OPTION...] [mk|rm|chmod|dump|file] [mode] [channel-name]\n"
+            puts( "Usage: ach [OPTION...] [mk|rm|chmod|resize|dump|file|stat|top] [mode] [channel-name]\n"
                   "General tool to interact with ach channels\n"
                   "\n"
                   "Options:\n"
@@ -216,10 +288,43 @@ int main( int argc, char **argv ) {
                   /* "  -U CHANNEL-NAME,          Unlink (delete) a channel\n" */
                   /* "  -D CHANNEL-NAME,          Dump info about channel\n" */
                   "  -1,                       With 'mk', accept an already created channel\n"
+                  "                            With 'top', print one sample and exit\n"
                   /* "  -F CHANNEL-NAME,          Print filename for channel (Linux-only)\n" */
-                  "  -m MSG-COUNT,             Number of messages to buffer\n"
-                  "  -n MSG-SIZE,              Nominal size of a message\n"
+                  "  -m MSG-COUNT,             Number of messages to buffer, for 'mk' and\n"
+                  "                            'resize'\n"
+                  "  -n MSG-SIZE,              Nominal size of a message.  'resize' keeps\n"
+                  "                            the current count or size if not given\n"
                   "  -o OCTAL,                 Mode for created channel\n"
+                  "  -p,                       Let subscribers poll the created channel\n"
+                  "                            (ach_pollfd_open(), Linux-only)\n"
+                  "  -T,                       Back the created channel with transparent\n"
+                  "                            huge pages (Linux-only)\n"
+                  "  -G,                       Create the channel on hugetlbfs, in\n"
+                  "                            " ACH_HUGETLBFS_DIR "\n"
+                  "  -P,                       Prefault the created channel when opened\n"
+                  "  -L,                       Lock the created channel in memory when\n"
+                  "                            opened, if permitted\n"
+                  "  -f,                       Give every message a fixed slot of MSG-SIZE\n"
+                  "                            bytes; larger messages are refused\n"
+                  "  -S,                       Record when each message is put, for\n"
+                  "                            ach_find_time()\n"
+                  "  -R,                       Keep a table of the channel's readers and how\n"
+                  "                            far behind each is, shown by 'stat'\n"
+                  "  -M,                       Let several publishers put to the created\n"
+                  "                            channel at once without locking; implies -f\n"
+                  "  -W,                       Let only one handle put to the created\n"
+                  "                            channel, without locking\n"
+                  "  -d,                       Map the data of the created channel twice,\n"
+                  "                            so no message is split at the end\n"
+                  "  -l,                       Time how long each put to the created channel\n"
+                  "                            holds the lock, shown by 'stat'\n"
+                  "  -2,                       Create the channel with layout 2, which keeps\n"
+                  "                            readers and writers off each other's cache\n"
+                  "                            lines.  Programs built with ach versions\n"
+                  "                            before it cannot open the channel\n"
+                  "  -O,                       Create the channel with the original layout,\n"
+                  "                            which older ach versions can open (default,\n"
+                  "                            unless -S, -M, -W or -d need layout 2)\n"
                   "  -t,                       Truncate and reinit newly create channel.\n"
                   "                            WARNING: this will clobber processes\n"
                   "                            Currently using the channel.\n"
@@ -242,6 +347,12 @@ int main( int argc, char **argv ) {
                   "                            for channel access in order to properly\n"
                   "                            synchronize.\n"
                   "  ach chmod 666 foo         Set permissions of channel 'foo' to '666'\n"
+                  "  ach resize foo -m 64      Grow channel 'foo' to 64 messages of its\n"
+                  "                            current nominal size while it is in use,\n"
+                  "                            keeping the newest messages\n"
+                  "  ach stat foo              Print counters and rates for channel 'foo',\n"
+                  "                            sampled over one second, and its readers\n"
+                  "  ach top                   Continuously show activity of all channels\n"
                   "\n"
                   "Report bugs to <ntd@gatech.edu>"
                 );
@@ -293,6 +404,22 @@ int cmd_create(void) {
         ach_create_attr_t attr;
         ach_create_attr_init(&attr);
         if( opt_truncate ) attr.truncate = 1;
+        if( opt_pollfd ) attr.pollfd = 1;
+        attr.huge_pages = opt_huge;
+        if( opt_populate ) attr.populate = 1;
+        if( opt_lock ) attr.lock_memory = 1;
+        attr.layout = opt_layout;
+        if( opt_fixed ) attr.fixed_size = 1;
+        if( opt_times ) attr.timestamps = 1;
+        if( opt_readers ) attr.readers = 1;
+        if( opt_multi_put ) {
+            attr.multi_put = 1;
+            attr.fixed_size = 1;
+            attr.futex = 1;
+        }
+        if( opt_single_writer ) attr.single_writer = 1;
+        if( opt_mirror ) attr.mirror = 1;
+        if( opt_lock_times ) attr.lock_times = 1;
         i = ach_create( opt_chan_name, opt_msg_cnt, opt_msg_size, &attr );
     }
 
@@ -306,6 +433,40 @@ int cmd_create(void) {
 
     return i;
 }
+int cmd_resize(void) {
+    if( opt_verbosity > 0 ) {
+        fprintf(stderr, "Resizing Channel %s\n", opt_chan_name);
+    }
+    if( opt_msg_cnt < 1 ) {
+        fprintf(stderr, "Message count must be greater than zero, not %"PRIuPTR".\n", opt_msg_cnt);
+        return -1;
+    }
+    if( opt_msg_size < 1 ) {
+        fprintf(stderr, "Message size must be greater than zero, not %"PRIuPTR".\n", opt_msg_size);
+        return -1;
+    }
+    ach_channel_t chan;
+    ach_status_t r = ach_open( &chan, opt_chan_name, NULL );
+    check_status( r, "Error opening ach channel '%s'", opt_chan_name );
+
+    /* keep whichever of count and size was not given */
+    size_t cnt = opt_msg_cnt_set ? opt_msg_cnt : chan.shm->index_cnt;
+    size_t size = opt_msg_size_set ? opt_msg_size
+        : chan.shm->data_size / chan.shm->index_cnt;
+    if( opt_verbosity > 0 ) {
+        fprintf(stderr, "Message Size: %"PRIuPTR"\n", size);
+        fprintf(stderr, "Message Cnt:  %"PRIuPTR"\n", cnt);
+    }
+
+    r = ach_resize( &chan, cnt, size );
+    check_status( r, "Error resizing ach channel '%s'", opt_chan_name );
+
+    r = ach_close( &chan );
+    check_status( r, "Error closing ach channel '%s'", opt_chan_name );
+
+    return r;
+}
+
 int cmd_unlink(void) {
     if( opt_verbosity > 0 ) {
         fprintf(stderr, "Unlinking Channel %s\n", opt_chan_name);
@@ -334,12 +495,350 @@ int cmd_dump(void) {
     return r;
 }
 
+static uint64_t stat_clock_ns( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t stat_now(void) {
+    return stat_clock_ns( ACH_STATS_CLOCK );
+}
+
+/* Copy the counters field by field; the publisher keeps writing them */
+static void stat_sample( const ach_stats_t *src, ach_stats_t *dst ) {
+    const uint64_t *s = (const uint64_t*)src;
+    uint64_t *d = (uint64_t*)dst;
+    size_t i;
+    for( i = 0; i < sizeof(*src) / sizeof(uint64_t); i++ ) {
+        d[i] = __atomic_load_n( &s[i], __ATOMIC_RELAXED );
+    }
+}
+
+/* Gets counted by the handles now in the reader table */
+struct stat_gets {
+    uint64_t got;
+    uint64_t bytes;
+    uint64_t missed;
+};
+
+static void stat_sample_gets( ach_header_t *shm, struct stat_gets *g ) {
+    memset( g, 0, sizeof(*g) );
+    if( ! (shm->flags & ACH_HEADER_READERS) ) return;
+    const ach_reader_t *table = ACH_SHM_READERS(shm);
+    size_t i;
+    for( i = 0; i < ACH_READERS_MAX; i++ ) {
+        if( 0 == __atomic_load_n( &table[i].owner, __ATOMIC_ACQUIRE ) ) continue;
+        g->got += __atomic_load_n( &table[i].got, __ATOMIC_RELAXED );
+        g->bytes += __atomic_load_n( &table[i].bytes, __ATOMIC_RELAXED );
+        g->missed += __atomic_load_n( &table[i].missed, __ATOMIC_RELAXED );
+    }
+}
+
+/* Print each handle in the reader table and how far behind it is */
+static void stat_readers( ach_header_t *shm ) {
+    const ach_reader_t *table = ACH_SHM_READERS(shm);
+    uint64_t last_seq = __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE );
+    printf( "readers:        %-8s %12s %12s %12s %12s\n",
+            "pid", "seq", "lag", "got", "missed" );
+    size_t i;
+    for( i = 0; i < ACH_READERS_MAX; i++ ) {
+        uint64_t owner = __atomic_load_n( &table[i].owner, __ATOMIC_ACQUIRE );
+        if( 0 == owner ) continue;
+        uint64_t seq = __atomic_load_n( &table[i].seq_num, __ATOMIC_RELAXED );
+        printf( "                %-8d %12"PRIu64" %12"PRIu64" %12"PRIu64" %12"PRIu64"%s\n",
+                (int)ACH_OWNER_PID(owner), seq, last_seq > seq ? last_seq - seq : 0,
+                __atomic_load_n( &table[i].got, __ATOMIC_RELAXED ),
+                __atomic_load_n( &table[i].missed, __ATOMIC_RELAXED ),
+                ach_owner_dead(owner) ? " (exited)" : "" );
+    }
+}
+
+int cmd_stat(void) {
+    if( opt_verbosity > 0 ) {
+        fprintf(stderr, "Sampling Channel %s\n", opt_chan_name);
+    }
+    /* watch the readers without becoming one */
+    ach_channel_t chan;
+    ach_attr_t attr;
+    ach_attr_init( &attr );
+    attr.no_reader = 1;
+    ach_status_t r = ach_open( &chan, opt_chan_name, &attr );
+    check_status( r, "Error opening ach channel '%s'", opt_chan_name );
+
+    ach_header_t *shm = chan.shm;
+    if( ! (shm->flags & (ACH_HEADER_STATS | ACH_HEADER_READERS)) ) {
+        fprintf( stderr, "Channel '%s' was created without statistics or a reader table\n",
+                 opt_chan_name );
+        ach_close( &chan );
+        return EXIT_FAILURE;
+    }
+    printf( "channel:        %s\n", opt_chan_name );
+    if( shm->flags & ACH_HEADER_SINGLE_WRITER ) {
+        uint64_t owner = __atomic_load_n( &ACH_SHM_HOT_BLOCK(shm)->writer_owner, __ATOMIC_ACQUIRE );
+        if( owner ) printf( "writer:         %d%s\n", (int)ACH_OWNER_PID(owner),
+                            ach_owner_dead(owner) ? " (exited)" : "" );
+        else printf( "writer:         none\n" );
+    }
+    if( shm->flags & ACH_HEADER_STATS ) {
+        const ach_stats_t *stats = ACH_SHM_STATS(shm);
+
+        ach_stats_t a, b;
+        struct stat_gets ga, gb;
+        uint64_t t0 = stat_now();
+        stat_sample( stats, &a );
+        stat_sample_gets( shm, &ga );
+        {
+            struct timespec ts = {1, 0};
+            while( nanosleep( &ts, &ts ) && EINTR == errno );
+        }
+        uint64_t t1 = stat_now();
+        stat_sample( stats, &b );
+        stat_sample_gets( shm, &gb );
+
+        double dt = (double)(t1 - t0) / 1e9;
+        uint64_t dput = b.put_cnt - a.put_cnt;
+        uint64_t dlock = b.lock_ns - a.lock_ns;
+
+        printf( "put:            %"PRIu64" frames, %"PRIu64" bytes\n", b.put_cnt, b.put_bytes );
+        printf( "put rate:       %.1f frames/s, %.1f bytes/s\n",
+                (double)dput / dt, (double)(b.put_bytes - a.put_bytes) / dt );
+        /* readers keep their own counts, so there are none without
+         * the table, and they leave with the handles that closed */
+        if( shm->flags & ACH_HEADER_READERS ) {
+            printf( "get:            %"PRIu64" frames, %"PRIu64" bytes\n", gb.got, gb.bytes );
+            printf( "get rate:       %.1f frames/s, %.1f bytes/s\n",
+                    (double)(int64_t)(gb.got - ga.got) / dt,
+                    (double)(int64_t)(gb.bytes - ga.bytes) / dt );
+        }
+        printf( "overwritten:    %"PRIu64" (+%"PRIu64")\n",
+                b.overwritten, b.overwritten - a.overwritten );
+        if( shm->flags & ACH_HEADER_READERS ) {
+            printf( "missed:         %"PRIu64" (%+"PRId64")\n",
+                    gb.missed, (int64_t)(gb.missed - ga.missed) );
+        }
+        if( shm->flags & ACH_HEADER_LOCK_TIMES ) {
+            printf( "lock hold avg:  %.3f us\n",
+                    dput ? (double)dlock / (double)dput / 1e3 :
+                    b.put_cnt ? (double)b.lock_ns / (double)b.put_cnt / 1e3 : 0.0 );
+            printf( "lock hold max:  %.3f us\n", (double)b.lock_max_ns / 1e3 );
+        }
+        printf( "waiters:        %"PRIu64"\n",
+                b.waiters + __atomic_load_n( &ACH_SHM_HOT(shm, futex_waiters), __ATOMIC_RELAXED ) );
+        if( b.last_put_ns ) {
+            printf( "last put:       %.3f s ago\n",
+                    (double)(int64_t)(stat_clock_ns( ACH_STATS_PUT_CLOCK ) - b.last_put_ns) / 1e9 );
+        } else {
+            printf( "last put:       never\n" );
+        }
+    }
+    if( shm->flags & ACH_HEADER_READERS ) {
+        stat_readers( shm );
+    }
+
+    r = ach_close( &chan );
+    check_status( r, "Error closing ach channel '%s'", opt_chan_name );
+
+    return r;
+}
+
+/* Last sample of a channel seen by `ach top' */
+struct top_entry {
+    char name[ACH_CHAN_NAME_MAX+1];
+    uint64_t t;
+    uint64_t last_seq;
+    uint64_t put_bytes;
+};
+
+static int top_filter( const struct dirent *ent ) {
+    const size_t n = strlen(ACH_CHAN_NAME_PREFIX + 1);
+    /* skip channels still being built by ach_resize() */
+    return 0 == strncmp( ent->d_name, ACH_CHAN_NAME_PREFIX + 1, n ) &&
+        '.' != ent->d_name[n];
+}
+
+static void top_bytes( char *buf, size_t n, double x ) {
+    const char *unit = " KMGT";
+    while( x >= 1000 && unit[1] ) {
+        x /= 1000;
+        unit++;
+    }
+    if( ' ' == *unit ) snprintf( buf, n, "%.0f", x );
+    else snprintf( buf, n, "%.1f%c", x, *unit );
+}
+
+/* Maps a channel read-only, without touching its locks.  Returns NULL
+ * if the file is not a channel. */
+static ach_header_t *top_map( const char *file, size_t *len ) {
+    int fd = open( file, O_RDONLY );
+    if( fd < 0 ) return NULL;
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if( 0 == fstat( fd, &st ) && (size_t)st.st_size >= sizeof(ach_header_t) ) {
+        *len = (size_t)st.st_size;
+        p = mmap( NULL, *len, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+
+    ach_header_t *shm = (ach_header_t*)p;
+    if( MAP_FAILED != p && (shm->flags & ACH_HEADER_MIRROR) &&
+        shm->len == *len && shm->data_offset + shm->data_size < shm->len )
+    {
+        /* Move the sections after the data to where the macros look,
+         * past the second copy of the data, which we leave out */
+        const size_t file_len = shm->len;
+        const size_t front = shm->data_offset + shm->data_size;
+        const size_t data_size = shm->data_size;
+        munmap( p, *len );
+        *len = file_len + data_size;
+        p = mmap( NULL, *len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+        if( MAP_FAILED != p &&
+            (MAP_FAILED == mmap( p, front, PROT_READ, MAP_SHARED|MAP_FIXED, fd, 0 ) ||
+             MAP_FAILED == mmap( (uint8_t*)p + front + data_size, file_len - front,
+                                 PROT_READ, MAP_SHARED|MAP_FIXED, fd, (off_t)front )) )
+        {
+            munmap( p, *len );
+            p = MAP_FAILED;
+        }
+        shm = (ach_header_t*)p;
+    }
+    close( fd );
+    if( MAP_FAILED == p ) return NULL;
+
+    if( (ACH_SHM_MAGIC_NUM != shm->magic && ACH_SHM_MAGIC_NUM_V2 != shm->magic) ||
+        ACH_SHM_MAP_LEN(shm) > *len ||
+        (uint8_t*)(ACH_SHM_GUARD_DATA(shm) + 1) > (uint8_t*)shm + *len ||
+        ((shm->flags & ACH_HEADER_STATS) &&
+         (uint8_t*)(ACH_SHM_STATS(shm) + 1) > (uint8_t*)shm + *len) )
+    {
+        munmap( p, *len );
+        return NULL;
+    }
+    return shm;
+}
+
+/* Where `ach top' looks for channels */
+static const char *const top_dirs[] = { ACH_SHM_DIR, ACH_HUGETLBFS_DIR };
+
+int cmd_top(void) {
+    struct top_entry *prev = NULL, *cur = NULL;
+    size_t n_prev = 0;
+    int pass;
+
+    /* With -1, the first pass only takes the sample to compare against */
+    for( pass = 0; ; pass++ ) {
+        int show = !opt_1 || pass > 0;
+        if( ! opt_1 ) printf( "\033[H\033[2J" );
+        if( show ) printf( "%-24s %10s %10s %12s %8s %6s %6s %10s\n",
+                "CHANNEL", "FRAMES/S", "BYTES/S", "SEQ", "+SEQ",
+                "DATA%", "INDEX%", "LAST PUT" );
+
+        size_t n_cur = 0;
+        size_t d;
+        cur = NULL;
+        for( d = 0; d < sizeof(top_dirs)/sizeof(top_dirs[0]); d++ ) {
+            struct dirent **ents;
+            int n = scandir( top_dirs[d], &ents, top_filter, alphasort );
+            if( n < 0 ) {
+                /* no hugetlbfs is fine */
+                if( d > 0 ) continue;
+                fprintf( stderr, "Couldn't read %s: %s\n", top_dirs[d], strerror(errno) );
+                return EXIT_FAILURE;
+            }
+            cur = (struct top_entry*)realloc( cur, (n_cur + (size_t)n + 1) * sizeof(*cur) );
+
+            int i;
+            for( i = 0; i < n; i++ ) {
+                char file[sizeof(ACH_HUGETLBFS_DIR) + sizeof("/dev/shm/") + 256];
+                snprintf( file, sizeof(file), "%s/%s", top_dirs[d], ents[i]->d_name );
+                char name[ACH_CHAN_NAME_MAX+1];
+                snprintf( name, sizeof(name), "%s",
+                          ents[i]->d_name + strlen(ACH_CHAN_NAME_PREFIX + 1) );
+                free( ents[i] );
+
+                size_t len;
+                ach_header_t *shm = top_map( file, &len );
+                if( NULL == shm ) continue;
+
+                /* Sample */
+                struct top_entry *e = &cur[n_cur++];
+                snprintf( e->name, sizeof(e->name), "%s", name );
+                e->t = stat_now();
+                e->last_seq = __atomic_load_n( &ACH_SHM_HOT(shm, last_seq), __ATOMIC_ACQUIRE );
+                size_t data_free = __atomic_load_n( &ACH_SHM_HOT(shm, data_free), __ATOMIC_RELAXED );
+                size_t index_free = __atomic_load_n( &ACH_SHM_HOT(shm, index_free), __ATOMIC_RELAXED );
+                int have_stats = shm->flags & ACH_HEADER_STATS;
+                uint64_t last_put_ns = 0;
+                if( have_stats ) {
+                    const ach_stats_t *stats = ACH_SHM_STATS(shm);
+                    e->put_bytes = __atomic_load_n( &stats->put_bytes, __ATOMIC_RELAXED );
+                    last_put_ns = __atomic_load_n( &stats->last_put_ns, __ATOMIC_RELAXED );
+                }
+                double data_fill = 100.0 * (double)(shm->data_size - data_free) /
+                    (double)shm->data_size;
+                double index_fill = 100.0 * (double)(shm->index_cnt - index_free) /
+                    (double)shm->index_cnt;
+                munmap( shm, len );
+
+                /* Compare with the previous sample */
+                const struct top_entry *p = NULL;
+                size_t j;
+                for( j = 0; j < n_prev; j++ ) {
+                    if( 0 == strcmp( prev[j].name, e->name ) ) {
+                        p = &prev[j];
+                        break;
+                    }
+                }
+                char rate[16] = "-", bw[16] = "-", dseq[16] = "-", last[16] = "-";
+                if( p && e->last_seq >= p->last_seq ) {
+                    double dt = (double)(e->t - p->t) / 1e9;
+                    snprintf( dseq, sizeof(dseq), "%"PRIu64, e->last_seq - p->last_seq );
+                    snprintf( rate, sizeof(rate), "%.1f",
+                              (double)(e->last_seq - p->last_seq) / dt );
+                    if( have_stats && e->put_bytes >= p->put_bytes ) {
+                        top_bytes( bw, sizeof(bw), (double)(e->put_bytes - p->put_bytes) / dt );
+                    }
+                }
+                if( last_put_ns ) {
+                    snprintf( last, sizeof(last), "%.1fs",
+                              (double)(int64_t)(stat_clock_ns( ACH_STATS_PUT_CLOCK ) -
+                                                last_put_ns) / 1e9 );
+                } else if( have_stats ) {
+                    snprintf( last, sizeof(last), "never" );
+                }
+
+                if( show ) printf( "%-24s %10s %10s %12"PRIu64" %8s %5.1f%% %5.1f%% %10s\n",
+                        e->name, rate, bw, e->last_seq, dseq,
+                        data_fill, index_fill, last );
+            }
+            free( ents );
+        }
+        fflush( stdout );
+
+        free( prev );
+        prev = cur;
+        n_prev = n_cur;
+
+        if( opt_1 && pass > 0 ) break;
+        sleep( 1 );
+    }
+
+    free( prev );
+    return 0;
+}
 
 int cmd_file(void) {
     if( opt_verbosity > 0 ) {
         fprintf(stderr, "Printing file for %s\n", opt_chan_name);
     }
-    printf("/dev/shm/" ACH_CHAN_NAME_PREFIX "%s\n", opt_chan_name );
+    char huge_file[sizeof(ACH_HUGETLBFS_DIR ACH_CHAN_NAME_PREFIX) + ACH_CHAN_NAME_MAX];
+    snprintf( huge_file, sizeof(huge_file), ACH_HUGETLBFS_DIR ACH_CHAN_NAME_PREFIX "%s",
+              opt_chan_name );
+    if( 0 == access( huge_file, F_OK ) ) {
+        printf( "%s\n", huge_file );
+    } else {
+        printf("/dev/shm/" ACH_CHAN_NAME_PREFIX "%s\n", opt_chan_name );
+    }
     return 0;
 }
 
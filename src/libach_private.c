@@ -89,6 +89,7 @@ const int ach_einval         = ACH_EINVAL;
 const int ach_corrupt        = ACH_CORRUPT;
 const int ach_bad_header     = ACH_BAD_HEADER;
 const int ach_eacces         = ACH_EACCES;
+const int ach_overwritten    = ACH_OVERWRITTEN;
 
 const int ach_o_wait         = ACH_O_WAIT;
 const int ach_o_last         = ACH_O_LAST;
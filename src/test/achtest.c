@@ -50,6 +50,10 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <sched.h>
 #include <pthread.h>
 #include <stdio.h>
@@ -73,6 +77,9 @@ int opt_pub_sleep_us = OPT_PUB_SLEEP_US;
 int opt_n_msgs = OPT_N_MSGS;
 const char *opt_channel_name = OPT_CHAN;
 
+/* attributes for channels created by the tests */
+ach_create_attr_t create_attr;
+
 static void test(ach_status_t r, const char *thing) {
     if( r != ACH_OK ) {
         fprintf(stderr, "%s: %s\n",
@@ -91,144 +98,2108 @@ int test_basic() {
         return -1;
     }
 
-    /* create */
-    r = ach_create(opt_channel_name, 32ul, 64ul, NULL );
+    /* create */
+    r = ach_create(opt_channel_name, 32ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    int s, p;
+    size_t frame_size;
+    struct timespec ts;
+
+    /* open */
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    /* only an explicit layout 2 locks out older libraries */
+    if( (ACH_LAYOUT_2 == create_attr.layout) != ACH_SHM_IS_V2(chan.shm) ) {
+        fprintf(stderr, "basic created the wrong layout\n");
+        exit(-1);
+    }
+
+    /* empty channel means stale */
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 ACH_O_LAST);
+    if( ACH_STALE_FRAMES != r ) {
+        printf("get stale failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 0);
+    if( ACH_STALE_FRAMES != r ) {
+        printf("get stale failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+
+    /* put */
+    p = 42;
+    r = ach_put( &chan, &p, sizeof(p) );
+    test(r, "ach_put");
+
+    /* get */
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 0);
+    test(r, "first ach_get");
+    if(frame_size!= sizeof(s) || s != 42 ) exit(-1);
+
+    /* put 2 */
+    p = 43;
+    r = ach_put( &chan, &p, sizeof(p) );
+    test(r, "ach_put");
+    p = 44;
+    r = ach_put( &chan, &p, sizeof(p) );
+    test(r, "ach_put");
+
+    /* get last */
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 ACH_O_LAST);
+    if( ACH_MISSED_FRAME != r ) {
+        printf("get last failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    if(frame_size != sizeof(s) || s != 44 ) exit(-1);
+
+    /* wait last */
+    p = 45;
+    r = ach_put( &chan, &p, sizeof(p) );
+    test(r, "ach_put");
+    clock_gettime(ACH_DEFAULT_CLOCK, &ts);
+    ts.tv_sec += 30; /* don't yield too long now */
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, &ts,
+                 ACH_O_LAST | ACH_O_WAIT );
+    if( ACH_OK != r ) {
+        printf("get wait failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    if(frame_size != sizeof(s) || s != 45 ) exit(-1);
+
+    /* get last stale */
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 ACH_O_LAST);
+    if( ACH_STALE_FRAMES != r ) {
+        printf("get stale failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* timeout */
+    clock_gettime(ACH_DEFAULT_CLOCK, &ts);
+    ts.tv_sec -= 10;
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, &ts,
+                 ACH_O_LAST | ACH_O_WAIT );
+    if( ACH_TIMEOUT != r ) {
+        printf("get timeout failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* copy last */
+    printf("> copy start\n");
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 ACH_O_LAST | ACH_O_COPY);
+    printf("> copy done\n");
+    if( ACH_OK != r ) {
+        printf("copy_last failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    if( p != s ) {
+        printf("wrong copy last : %d\n", s);
+        exit(-1);
+    }
+
+    /* get copy */
+    /*ach_dump(chan.shm);*/
+    /*printf("chan seq_num: %"PRIu64"\n", chan.seq_num);*/
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 ACH_O_COPY);
+    if( ACH_OK != r ) {
+        printf("copy_last failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* missed frames */
+    size_t i;
+    for( i = 0; i < 100; i ++ ) {
+        r = ach_put( &chan, &p, sizeof(p) );
+        test(r, "ach_put");
+    }
+    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
+                 ACH_O_LAST);
+    if( ACH_MISSED_FRAME != r ) {
+        printf("get missed failed: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* close */
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    /* unlink */
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "basic ok\n");
+    return 0;
+}
+
+
+/* Mix zero-copy, gathered, and regular puts of varying sizes so
+ * frames wrap around the end of the data array. */
+int test_reserve() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    r = ach_create(opt_channel_name, 4ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint8_t out[256], in[256];
+    size_t i, j, frame_size;
+    for( i = 0; i < 1000; i ++ ) {
+        size_t len = 1 + (i * 37) % 200;
+        for( j = 0; j < len; j ++ ) out[j] = (uint8_t)(i + j);
+
+        if( i % 3 ) {
+            void *buf;
+            r = ach_put_reserve( &chan, len + 16, &buf );
+            test(r, "ach_put_reserve");
+            memcpy( buf, out, len );
+            if( i % 7 == 1 ) {
+                r = ach_put_abort( &chan );
+                test(r, "ach_put_abort");
+                continue;
+            }
+            r = ach_put_commit( &chan, len );
+            test(r, "ach_put_commit");
+        } else if( i % 2 ) {
+            /* gather from header, payload, and trailer pieces */
+            struct iovec iov[4];
+            size_t a = len / 3, b = len / 2;
+            iov[0].iov_base = out;         iov[0].iov_len = a;
+            iov[1].iov_base = NULL;        iov[1].iov_len = 0;
+            iov[2].iov_base = out + a;     iov[2].iov_len = b - a;
+            iov[3].iov_base = out + b;     iov[3].iov_len = len - b;
+            r = ach_putv( &chan, iov, 4 );
+            test(r, "ach_putv");
+        } else {
+            r = ach_put( &chan, out, len );
+            test(r, "ach_put");
+        }
+
+        r = ach_get( &chan, in, sizeof(in), &frame_size, NULL, ACH_O_LAST );
+        if( ACH_OK != r && ACH_MISSED_FRAME != r ) {
+            fprintf(stderr, "reserve get failed: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        if( frame_size != len || memcmp(in, out, len) ) {
+            fprintf(stderr, "reserve got bad frame %"PRIuPTR"\n", i);
+            exit(-1);
+        }
+    }
+
+    /* out of range commit drops the frame */
+    {
+        void *buf;
+        r = ach_put_reserve( &chan, 8, &buf );
+        test(r, "ach_put_reserve");
+        r = ach_put_commit( &chan, 0 );
+        if( ACH_EINVAL != r ) {
+            fprintf(stderr, "bad commit: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        r = ach_put_reserve( &chan, 257, &buf );
+        if( ACH_OVERFLOW != r ) {
+            fprintf(stderr, "bad reserve: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+    }
+
+    /* gets that do not wait must not block on an open reservation */
+    {
+        ach_channel_t sub;
+        r = ach_open(&sub, opt_channel_name, NULL);
+        test(r, "ach_open");
+        void *buf;
+        r = ach_put_reserve( &chan, 8, &buf );
+        test(r, "ach_put_reserve");
+        alarm(5);
+        r = ach_get( &sub, in, sizeof(in), &frame_size, NULL, ACH_O_LAST );
+        alarm(0);
+        if( (ACH_OK != r && ACH_MISSED_FRAME != r) || memcmp(in, out, frame_size) ) {
+            fprintf(stderr, "get during reserve: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        r = ach_put_abort( &chan );
+        test(r, "ach_put_abort");
+        r = ach_close(&sub);
+        test(r, "ach_close");
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "reserve ok\n");
+    return 0;
+}
+
+/* Borrow frames in place, including ones that wrap, and check that
+ * overwritten views are caught. */
+int test_view() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    r = ach_create(opt_channel_name, 4ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    ach_view_t view;
+    r = ach_get_view( &chan, &view, NULL, 0 );
+    if( ACH_STALE_FRAMES != r ) {
+        fprintf(stderr, "view of empty channel: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    uint8_t out[256], in[256];
+    size_t i, j;
+    for( i = 0; i < 1000; i ++ ) {
+        size_t len = 1 + (i * 37) % 200;
+        for( j = 0; j < len; j ++ ) out[j] = (uint8_t)(i + j);
+        r = ach_put( &chan, out, len );
+        test(r, "ach_put");
+
+        r = ach_get_view( &chan, &view, NULL, 0 );
+        test(r, "ach_get_view");
+        memcpy( in, view.seg[0], view.seg_size[0] );
+        if( view.seg_size[1] ) {
+            memcpy( in + view.seg_size[0], view.seg[1], view.seg_size[1] );
+        }
+        if( view.frame_size != len ||
+            view.seg_size[0] + view.seg_size[1] != len ||
+            memcmp(in, out, len) )
+        {
+            fprintf(stderr, "view got bad frame %"PRIuPTR"\n", i);
+            exit(-1);
+        }
+        r = ach_view_release( &chan, &view );
+        test(r, "ach_view_release");
+    }
+
+    /* hold a view while the frame is replaced */
+    r = ach_get_view( &chan, &view, NULL, ACH_O_LAST | ACH_O_COPY );
+    test(r, "ach_get_view");
+    for( i = 0; i < 4; i ++ ) {
+        r = ach_put( &chan, out, 8 );
+        test(r, "ach_put");
+        r = ach_view_validate( &chan, &view );
+        if( ACH_OK != r && ACH_OVERWRITTEN != r ) {
+            fprintf(stderr, "bad validate: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+    }
+    r = ach_view_release( &chan, &view );
+    if( ACH_OVERWRITTEN != r ) {
+        fprintf(stderr, "bad release: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "view ok\n");
+    return 0;
+}
+
+/* Drain backlogs of several frames at a time */
+int test_many() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    r = ach_create(opt_channel_name, 8ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint8_t out[256], buf[1024];
+    ach_frame_desc_t frames[16];
+    size_t i, j, k, frame_cnt;
+    uint64_t seq = 0;
+    for( i = 0; i < 200; i ++ ) {
+        /* publish a backlog, wrapping around the data array */
+        size_t n = 1 + i % 10;
+        for( j = 0; j < n; j ++ ) {
+            size_t len = 1 + ((i+j) * 37) % 60;
+            memset( out, (int)(i+j), len );
+            r = ach_put( &chan, out, len );
+            test(r, "ach_put");
+        }
+
+        r = ach_get_many( &chan, buf, sizeof(buf), frames, 16, &frame_cnt, NULL, 0 );
+        if( ! ((n <= 8 && ACH_OK == r) || (n > 8 && ACH_MISSED_FRAME == r)) ) {
+            fprintf(stderr, "ach_get_many: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        if( frame_cnt > n || frame_cnt < 1 || frames[frame_cnt-1].seq_num != seq + n ) {
+            fprintf(stderr, "many got bad frames at %"PRIuPTR"\n", i);
+            exit(-1);
+        }
+        for( k = 0; k < frame_cnt; k ++ ) {
+            j = n - frame_cnt + k;
+            size_t len = 1 + ((i+j) * 37) % 60;
+            memset( out, (int)(i+j), len );
+            if( frames[k].size != len ||
+                memcmp( buf + frames[k].offset, out, len ) )
+            {
+                fprintf(stderr, "many got bad frame %"PRIuPTR", %"PRIuPTR"\n", i, k);
+                exit(-1);
+            }
+        }
+        seq += n;
+
+        r = ach_get_many( &chan, buf, sizeof(buf), frames, 16, &frame_cnt, NULL, 0 );
+        if( ACH_STALE_FRAMES != r || 0 != frame_cnt ) {
+            fprintf(stderr, "many not stale: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+    }
+
+    /* limited by frame count, then by buffer size */
+    for( j = 0; j < 4; j ++ ) {
+        memset( out, (int)j, 32 );
+        r = ach_put( &chan, out, 32 );
+        test(r, "ach_put");
+    }
+    r = ach_get_many( &chan, buf, sizeof(buf), frames, 2, &frame_cnt, NULL, 0 );
+    test(r, "ach_get_many");
+    if( 2 != frame_cnt ) {
+        fprintf(stderr, "many ignored max_frames\n");
+        exit(-1);
+    }
+    r = ach_get_many( &chan, buf, 40, frames, 16, &frame_cnt, NULL, 0 );
+    test(r, "ach_get_many");
+    if( 1 != frame_cnt || buf[0] != 2 ) {
+        fprintf(stderr, "many overran buffer\n");
+        exit(-1);
+    }
+    r = ach_get_many( &chan, buf, 16, frames, 16, &frame_cnt, NULL, 0 );
+    if( ACH_OVERFLOW != r || 32 != frames[0].size ) {
+        fprintf(stderr, "many did not overflow: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* only the newest with ACH_O_LAST */
+    memset( out, 9, 32 );
+    r = ach_put( &chan, out, 32 );
+    test(r, "ach_put");
+    r = ach_get_many( &chan, buf, sizeof(buf), frames, 16, &frame_cnt, NULL, ACH_O_LAST );
+    if( ACH_MISSED_FRAME != r || 1 != frame_cnt || buf[0] != 9 ) {
+        fprintf(stderr, "many bad last: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "many ok\n");
+    return 0;
+}
+
+int test_stats() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    /* gets count themselves in the reader table */
+    ach_create_attr_t attr = create_attr;
+    attr.readers = 1;
+    r = ach_create(opt_channel_name, 4ul, 10ul, &attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+    if( ! (chan.shm->flags & ACH_HEADER_STATS) ) {
+        fprintf(stderr, "stats not enabled by default\n");
+        exit(-1);
+    }
+    const ach_stats_t *stats = ACH_SHM_STATS(chan.shm);
+    const ach_reader_t *reader = ACH_SHM_READERS(chan.shm) + chan.reader;
+
+    uint8_t buf[10] = {0};
+    size_t i, frame_size;
+    for( i = 0; i < 4; i ++ ) {
+        r = ach_put( &chan, buf, sizeof(buf) );
+        test(r, "ach_put");
+    }
+    r = ach_get( &chan, buf, sizeof(buf), &frame_size, NULL, ACH_O_LAST );
+    if( ACH_MISSED_FRAME != r ) {
+        fprintf(stderr, "stats get: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    if( 4 != stats->put_cnt || 40 != stats->put_bytes ||
+        1 != reader->got || 10 != reader->bytes ||
+        3 != reader->missed || 4 != stats->read_seq ||
+        0 == stats->last_put_ns || 0 != stats->lock_ns )
+    {
+        fprintf(stderr, "stats bad counts\n");
+        exit(-1);
+    }
+
+    /* frames 1-4 were read past; 5-10 are evicted unread */
+    for( i = 0; i < 10; i ++ ) {
+        r = ach_put( &chan, buf, sizeof(buf) );
+        test(r, "ach_put");
+    }
+    if( 14 != stats->put_cnt || 6 != stats->overwritten ) {
+        fprintf(stderr, "stats bad overwritten: %"PRIu64"\n", stats->overwritten);
+        exit(-1);
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    /* lock times only when asked for */
+    attr.truncate = 1;
+    attr.lock_times = 1;
+    r = ach_create(opt_channel_name, 4ul, 10ul, &attr );
+    test(r, "ach_create");
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+    stats = ACH_SHM_STATS(chan.shm);
+    for( i = 0; i < 4; i ++ ) {
+        r = ach_put( &chan, buf, sizeof(buf) );
+        test(r, "ach_put");
+    }
+    if( 0 == stats->lock_ns || stats->lock_max_ns > stats->lock_ns ) {
+        fprintf(stderr, "stats bad lock times\n");
+        exit(-1);
+    }
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    /* and without */
+    {
+        attr = create_attr;
+        attr.truncate = 1;
+        attr.no_stats = 1;
+        attr.lock_times = 1;
+        if( ACH_EINVAL != ach_create(opt_channel_name, 4ul, 10ul, &attr ) ) {
+            fprintf(stderr, "lock times created without stats\n");
+            exit(-1);
+        }
+        attr.lock_times = 0;
+        r = ach_create(opt_channel_name, 4ul, 10ul, &attr );
+        test(r, "ach_create");
+        r = ach_open(&chan, opt_channel_name, NULL);
+        test(r, "ach_open");
+        if( chan.shm->flags & ACH_HEADER_STATS ) {
+            fprintf(stderr, "stats not disabled\n");
+            exit(-1);
+        }
+        r = ach_put( &chan, buf, sizeof(buf) );
+        test(r, "ach_put");
+        r = ach_close(&chan);
+        test(r, "ach_close");
+    }
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "stats ok\n");
+    return 0;
+}
+
+int test_fixed() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    ach_create_attr_t attr = create_attr;
+    attr.fixed_size = 1;
+    r = ach_create(opt_channel_name, 4ul, 24ul, &attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint64_t out[3], in[16];  /* in is bigger than a slot */
+    size_t i, frame_size;
+
+    /* slots don't grow */
+    r = ach_put( &chan, in, sizeof(in) );
+    if( ACH_OVERFLOW != r ) {
+        fprintf(stderr, "fixed took big frame: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    for( i = 1; i < 100; i ++ ) {
+        /* shorter frames are fine */
+        size_t len = (i % 3) ? sizeof(out) : sizeof(out[0]);
+        out[0] = out[1] = out[2] = i;
+        r = ach_put( &chan, out, len );
+        test(r, "ach_put");
+        if( i % 7 ) continue;
+
+        /* every 7th put, read back the oldest resident frame */
+        r = ach_get( &chan, in, sizeof(in), &frame_size, NULL, 0 );
+        if( ! (ACH_OK == r || ACH_MISSED_FRAME == r) ) {
+            fprintf(stderr, "fixed get: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        if( in[0] != i - 3 || frame_size != (((i-3) % 3) ? sizeof(out) : sizeof(out[0])) ) {
+            fprintf(stderr, "fixed got %"PRIu64" at %"PRIuPTR"\n", in[0], i);
+            exit(-1);
+        }
+    }
+
+    /* the reserve path uses the same slots */
+    {
+        void *buf;
+        r = ach_put_reserve( &chan, sizeof(in), &buf );
+        if( ACH_OVERFLOW != r ) {
+            fprintf(stderr, "fixed reserved big frame\n");
+            exit(-1);
+        }
+        r = ach_put_reserve( &chan, sizeof(out), &buf );
+        test(r, "ach_put_reserve");
+        if( 0 != (uintptr_t)((uint8_t*)buf - ACH_SHM_DATA(chan.shm)) % chan.shm->slot_size ) {
+            fprintf(stderr, "fixed reserved outside a slot\n");
+            exit(-1);
+        }
+        out[0] = 100;
+        memcpy( buf, out, sizeof(out) );
+        r = ach_put_commit( &chan, sizeof(out) );
+        test(r, "ach_put_commit");
+        r = ach_get( &chan, in, sizeof(in), &frame_size, NULL, ACH_O_LAST );
+        if( ACH_MISSED_FRAME != r || 100 != in[0] ) {
+            fprintf(stderr, "fixed bad last\n");
+            exit(-1);
+        }
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "fixed ok\n");
+    return 0;
+}
+
+int test_seq() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    r = ach_create(opt_channel_name, 8ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint64_t out[16], in[16];
+    size_t frame_size;
+    uint64_t i, n = 50;
+
+    r = ach_get_seq( &chan, 1, in, sizeof(in), &frame_size );
+    if( ACH_STALE_FRAMES != r ) {
+        fprintf(stderr, "seq got from empty channel: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* frames of varying size, so both index and data wrap */
+    for( i = 1; i <= n; i ++ ) {
+        size_t k;
+        for( k = 0; k < 16; k ++ ) out[k] = i;
+        r = ach_put( &chan, out, (1 + i % 16) * sizeof(out[0]) );
+        test(r, "ach_put");
+    }
+
+    /* resident frames are the newest, and contiguous */
+    uint64_t oldest = 0;
+    for( i = 1; i <= n; i ++ ) {
+        memset( in, 0, sizeof(in) );
+        r = ach_get_seq( &chan, i, in, sizeof(in), &frame_size );
+        if( ACH_MISSED_FRAME == r && 0 == oldest ) continue;
+        test(r, "ach_get_seq");
+        if( 0 == oldest ) oldest = i;
+        if( in[0] != i || in[i%16] != i ||
+            frame_size != (1 + i % 16) * sizeof(out[0]) ) {
+            fprintf(stderr, "seq got %"PRIu64" for %"PRIu64"\n", in[0], i);
+            exit(-1);
+        }
+    }
+    if( 0 == oldest || 1 == oldest || n - oldest >= 8 ) {
+        fprintf(stderr, "seq bad oldest resident %"PRIu64"\n", oldest);
+        exit(-1);
+    }
+
+    r = ach_get_seq( &chan, n+1, in, sizeof(in), &frame_size );
+    if( ACH_STALE_FRAMES != r ) {
+        fprintf(stderr, "seq got future frame: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    r = ach_get_seq( &chan, 0, in, sizeof(in), &frame_size );
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "seq got frame 0: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    r = ach_get_seq( &chan, n, in, sizeof(in[0]), &frame_size );
+    if( ACH_OVERFLOW != r || frame_size != (1 + n % 16) * sizeof(out[0]) ) {
+        fprintf(stderr, "seq bad overflow: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* random access leaves the subscriber's place alone */
+    if( 0 != chan.seq_num ) {
+        fprintf(stderr, "seq moved chan.seq_num\n");
+        exit(-1);
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "seq ok\n");
+    return 0;
+}
+
+int test_times() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    ach_create_attr_t attr = create_attr;
+    attr.timestamps = 1;
+    r = ach_create(opt_channel_name, 8ul, 64ul, &attr );
+    if( ACH_LAYOUT_1 == create_attr.layout ) {
+        /* no room in the original index entries */
+        if( ACH_EINVAL != r ) {
+            fprintf(stderr, "times created layout 1: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        fprintf(stderr, "times ok\n");
+        return 0;
+    }
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    ach_frame_time_t before, after;
+    struct timespec t[21], end;
+    uint64_t i, in, n = 20;
+    size_t frame_size;
+
+    clock_gettime( CLOCK_MONOTONIC, &t[0] );
+    r = ach_find_time( &chan, CLOCK_MONOTONIC, &t[0], &before, &after );
+    if( ACH_STALE_FRAMES != r ) {
+        fprintf(stderr, "times found in empty channel: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* frame i is put strictly between t[i] and t[i+1] */
+    for( i = 1; i <= n; i ++ ) {
+        clock_gettime( CLOCK_MONOTONIC, &t[i] );
+        usleep(100);
+        r = ach_put( &chan, &i, sizeof(i) );
+        test(r, "ach_put");
+        usleep(100);
+    }
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    /* frames 13 through 20 are left */
+    for( i = 13; i <= n; i ++ ) {
+        r = ach_find_time( &chan, CLOCK_MONOTONIC, &t[i], &before, &after );
+        test(r, "ach_find_time");
+        if( after.seq_num != i || before.seq_num != ((13 == i) ? 0 : i - 1) ) {
+            fprintf(stderr, "times found %"PRIu64", %"PRIu64" for %"PRIu64"\n",
+                    before.seq_num, after.seq_num, i);
+            exit(-1);
+        }
+
+        r = ach_get_time( &chan, CLOCK_MONOTONIC, &t[i], ACH_TIME_AFTER,
+                          &in, sizeof(in), &frame_size, &after );
+        test(r, "ach_get_time");
+        if( in != i || after.seq_num != i ) {
+            fprintf(stderr, "times got %"PRIu64" after %"PRIu64"\n", in, i);
+            exit(-1);
+        }
+
+        /* nearest to a frame's own time is that frame */
+        r = ach_get_time( &chan, CLOCK_MONOTONIC, &after.time, ACH_TIME_NEAREST,
+                          &in, sizeof(in), &frame_size, NULL );
+        test(r, "ach_get_time");
+        if( in != i ) {
+            fprintf(stderr, "times got %"PRIu64" nearest %"PRIu64"\n", in, i);
+            exit(-1);
+        }
+    }
+
+    /* after everything */
+    r = ach_find_time( &chan, CLOCK_MONOTONIC, &end, &before, &after );
+    test(r, "ach_find_time");
+    if( n != before.seq_num || 0 != after.seq_num ) {
+        fprintf(stderr, "times bad end\n");
+        exit(-1);
+    }
+    r = ach_get_time( &chan, CLOCK_MONOTONIC, &end, ACH_TIME_AFTER,
+                      &in, sizeof(in), &frame_size, NULL );
+    if( ACH_STALE_FRAMES != r ) {
+        fprintf(stderr, "times got after end: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* the realtime clock is recorded too */
+    clock_gettime( CLOCK_REALTIME, &end );
+    r = ach_get_time( &chan, CLOCK_REALTIME, &end, ACH_TIME_BEFORE,
+                      &in, sizeof(in), &frame_size, &before );
+    test(r, "ach_get_time");
+    if( in != n || before.time.tv_sec > end.tv_sec ||
+        before.time.tv_sec < end.tv_sec - 10 ) {
+        fprintf(stderr, "times bad realtime\n");
+        exit(-1);
+    }
+
+    r = ach_get_time( &chan, CLOCK_PROCESS_CPUTIME_ID, &end, ACH_TIME_BEFORE,
+                      &in, sizeof(in), &frame_size, NULL );
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "times searched bad clock: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "times ok\n");
+    return 0;
+}
+
+int test_window() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    r = ach_create(opt_channel_name, 8ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint64_t out[4], buf[64];
+    ach_frame_desc_t frames[16];
+    size_t i, j, cnt;
+
+    r = ach_get_window( &chan, buf, sizeof(buf), frames, 4, &cnt );
+    if( ACH_STALE_FRAMES != r ) {
+        fprintf(stderr, "window got from empty channel: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* frame i holds 1 + i%4 copies of i */
+    for( i = 1; i <= 20; i ++ ) {
+        for( j = 0; j < 4; j ++ ) out[j] = i;
+        r = ach_put( &chan, out, (1 + i % 4) * sizeof(out[0]) );
+        test(r, "ach_put");
+
+        if( 3 != i && 20 != i ) continue;
+
+        /* the newest frames, oldest first */
+        size_t want = (3 == i) ? 3 : 4;
+        r = ach_get_window( &chan, buf, sizeof(buf), frames, 4, &cnt );
+        test(r, "ach_get_window");
+        if( cnt != want ) {
+            fprintf(stderr, "window got %"PRIuPTR" frames\n", cnt);
+            exit(-1);
+        }
+        for( j = 0; j < cnt; j ++ ) {
+            uint64_t seq = i - cnt + 1 + j;
+            uint64_t *p = (uint64_t*)((uint8_t*)buf + frames[j].offset);
+            if( frames[j].seq_num != seq || p[0] != seq ||
+                frames[j].size != (1 + seq % 4) * sizeof(out[0]) ||
+                (j && frames[j].offset != frames[j-1].offset + frames[j-1].size) ) {
+                fprintf(stderr, "window bad frame %"PRIuPTR"\n", j);
+                exit(-1);
+            }
+        }
+    }
+
+    /* no more than the channel holds */
+    r = ach_get_window( &chan, buf, sizeof(buf), frames, 16, &cnt );
+    test(r, "ach_get_window");
+    if( cnt > 8 || cnt < 2 || frames[cnt-1].seq_num != 20 ) {
+        fprintf(stderr, "window got %"PRIuPTR" of everything\n", cnt);
+        exit(-1);
+    }
+
+    /* the newest that fit: 20 is one word and 19 four */
+    r = ach_get_window( &chan, buf, 6*sizeof(buf[0]), frames, 4, &cnt );
+    test(r, "ach_get_window");
+    if( 2 != cnt || 19 != frames[0].seq_num ) {
+        fprintf(stderr, "window got %"PRIuPTR" in a small buffer\n", cnt);
+        exit(-1);
+    }
+    r = ach_put( &chan, out, sizeof(out) );
+    test(r, "ach_put");
+    r = ach_get_window( &chan, buf, sizeof(buf[0]), frames, 4, &cnt );
+    if( ACH_OVERFLOW != r || sizeof(out) != frames[0].size ) {
+        fprintf(stderr, "window bad overflow: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* windows leave the subscriber's place alone */
+    if( 0 != chan.seq_num ) {
+        fprintf(stderr, "window moved chan.seq_num\n");
+        exit(-1);
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "window ok\n");
+    return 0;
+}
+
+/* Spinning and polling waits still time out, and still see frames
+ * put by another process. */
+/* Several publishers put to a multi_put channel at once while a
+ * subscriber checks that frames arrive whole and in sequence. */
+int test_multi_put() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+    ach_create_attr_t attr = create_attr;
+    attr.multi_put = 1;
+    attr.fixed_size = 1;
+    attr.futex = 0;
+    if( ACH_EINVAL != ach_create(opt_channel_name, 8ul, 64ul, &attr ) ) {
+        fprintf(stderr, "multi_put created without a futex\n");
+        exit(-1);
+    }
+    attr.futex = 1;
+    r = ach_create(opt_channel_name, 8ul, 64ul, &attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+    void *reserved;
+    if( ACH_EINVAL != ach_put_reserve( &chan, 8, &reserved ) ||
+        ACH_EINVAL != ach_resize( &chan, 16, 64 ) )
+    {
+        fprintf(stderr, "multi_put allowed reserve or resize\n");
+        exit(-1);
+    }
+
+    enum { N_PUB = 4, N_PUT = 2000 };
+    pid_t pids[N_PUB];
+    int p;
+    for( p = 0; p < N_PUB; p ++ ) {
+        pids[p] = fork();
+        if( 0 == pids[p] ) {
+            ach_channel_t c;
+            if( ACH_OK != ach_open(&c, opt_channel_name, NULL) ) exit(-1);
+            uint64_t i, buf[8];
+            for( i = 1; i <= N_PUT; i ++ ) {
+                size_t j;
+                buf[0] = (uint64_t)p;
+                for( j = 1; j < 8; j ++ ) buf[j] = i;
+                if( ACH_OK != ach_put( &c, buf, sizeof(buf) ) ) exit(-1);
+            }
+            exit(0);
+        }
+    }
+
+    /* each publisher's frames arrive in the order it put them */
+    uint64_t last[N_PUB] = {0}, got = 0, buf[8];
+    for(;;) {
+        size_t frame_size, j;
+        struct timespec abstime;
+        clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+        abstime.tv_sec += 10;
+        uint64_t prev = chan.seq_num;
+        r = ach_get( &chan, buf, sizeof(buf), &frame_size, &abstime, ACH_O_WAIT );
+        if( ACH_OK != r && ACH_MISSED_FRAME != r ) test(r, "ach_get");
+        if( chan.seq_num <= prev || sizeof(buf) != frame_size || buf[0] >= N_PUB ||
+            buf[1] <= last[buf[0]] )
+        {
+            fprintf(stderr, "multi_put bad frame %"PRIu64"\n", chan.seq_num);
+            exit(-1);
+        }
+        for( j = 2; j < 8; j ++ ) {
+            if( buf[j] != buf[1] ) {
+                fprintf(stderr, "multi_put torn frame %"PRIu64"\n", chan.seq_num);
+                exit(-1);
+            }
+        }
+        last[buf[0]] = buf[1];
+        got++;
+        if( N_PUB * N_PUT == chan.seq_num ) break;
+    }
+
+    for( p = 0; p < N_PUB; p ++ ) {
+        int status;
+        waitpid( pids[p], &status, 0 );
+        if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+            fprintf(stderr, "multi_put publisher failed\n");
+            exit(-1);
+        }
+    }
+    for( p = 0; p < N_PUB; p ++ ) {
+        size_t frame_size;
+        r = ach_get_seq( &chan, N_PUB * N_PUT - (uint64_t)p, buf, sizeof(buf), &frame_size );
+        test(r, "ach_get_seq");
+    }
+
+    /* publishers that die holding reservations, here for every
+     * slot, fail later puts rather than hanging them */
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        ach_header_t *shm = chan.shm;
+        size_t k;
+        for( k = 0; k < shm->index_cnt; k ++ ) {
+            uint64_t seq = __atomic_add_fetch( &ACH_SHM_HOT_BLOCK(shm)->reserve_seq, 1,
+                                               __ATOMIC_RELAXED );
+            ach_index_owner_t *res = ACH_SHM_INDEX_OWNER_AT(shm, (seq - 1) % shm->index_cnt);
+            res->owner = (uint64_t)getpid();
+            __atomic_store_n( &res->seq_num, seq, __ATOMIC_RELEASE );
+            ACH_SHM_INDEX_AT(shm, (seq - 1) % shm->index_cnt)->seq_num = 0;
+        }
+        _exit(0);
+    }
+    waitpid( pid, NULL, 0 );
+    alarm(5);
+    r = ach_put( &chan, buf, sizeof(buf) );
+    alarm(0);
+    if( ACH_CORRUPT != r ) {
+        fprintf(stderr, "multi_put past a dead publisher: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    /* and gets of the frames they took over fail rather than spin */
+    {
+        ach_channel_t sub;
+        ach_frame_desc_t desc[4];
+        size_t frame_size, n;
+        r = ach_open(&sub, opt_channel_name, NULL);
+        test(r, "ach_open");
+        alarm(5);
+        ach_status_t r_get = ach_get( &sub, buf, sizeof(buf), &frame_size, NULL, 0 );
+        ach_status_t r_window = ach_get_window( &sub, buf, sizeof(buf), desc, 4, &n );
+        alarm(0);
+        if( ACH_CORRUPT != r_get || ACH_CORRUPT != r_window ) {
+            fprintf(stderr, "multi_put get past a dead publisher: %s, %s\n",
+                    ach_result_to_string(r_get), ach_result_to_string(r_window));
+            exit(-1);
+        }
+        r = ach_close(&sub);
+        test(r, "ach_close");
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "multi_put ok (%"PRIu64" frames seen)\n", got);
+    return 0;
+}
+
+/* Only the handle holding the claim may put, and gets see its
+ * lock-free puts whole and in order */
+int test_single_writer() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+    ach_create_attr_t attr = create_attr;
+    attr.single_writer = 1;
+    attr.layout = ACH_LAYOUT_1;
+    if( ACH_EINVAL != ach_create(opt_channel_name, 8ul, 64ul, &attr ) ) {
+        fprintf(stderr, "single_writer created with the original layout\n");
+        exit(-1);
+    }
+    attr.layout = ACH_LAYOUT_DEFAULT;
+    r = ach_create(opt_channel_name, 8ul, 64ul, &attr );
+    test(r, "ach_create");
+
+    ach_channel_t pub, other;
+    r = ach_open(&pub, opt_channel_name, NULL);
+    test(r, "ach_open");
+    r = ach_open(&other, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint64_t i, buf[8];
+    for( i = 0; i < 8; i ++ ) buf[i] = 1;
+    r = ach_put( &pub, buf, sizeof(buf) );
+    test(r, "ach_put");
+    if( ACH_EACCES != ach_put( &other, buf, sizeof(buf) ) ||
+        ACH_EACCES != ach_resize( &other, 16, 64 ) )
+    {
+        fprintf(stderr, "second handle put to a single_writer channel\n");
+        exit(-1);
+    }
+
+    /* a subscriber waits for every frame, and can't put itself */
+    enum { N_PUT = 2000 };
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        if( ACH_EACCES != ach_put( &pub, buf, sizeof(buf) ) ) exit(-1);
+        while( other.seq_num < N_PUT ) {
+            size_t frame_size, j;
+            struct timespec abstime;
+            clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+            abstime.tv_sec += 10;
+            uint64_t prev = other.seq_num;
+            r = ach_get( &other, buf, sizeof(buf), &frame_size, &abstime, ACH_O_WAIT );
+            if( ACH_OK != r && ACH_MISSED_FRAME != r ) exit(-1);
+            if( other.seq_num <= prev || sizeof(buf) != frame_size ) exit(-1);
+            for( j = 0; j < 8; j ++ ) {
+                if( buf[j] != other.seq_num ) exit(-1);
+            }
+        }
+        exit(0);
+    }
+    for( i = 2; i <= N_PUT; i ++ ) {
+        size_t j;
+        if( 0 == i % 2 ) {
+            void *reserved;
+            r = ach_put_reserve( &pub, sizeof(buf), &reserved );
+            test(r, "ach_put_reserve");
+            for( j = 0; j < 8; j ++ ) ((uint64_t*)reserved)[j] = i;
+            r = ach_put_commit( &pub, sizeof(buf) );
+            test(r, "ach_put_commit");
+        } else {
+            for( j = 0; j < 8; j ++ ) buf[j] = i;
+            r = ach_put( &pub, buf, sizeof(buf) );
+            test(r, "ach_put");
+        }
+        if( 0 == i % 100 ) usleep(1000);
+    }
+    int status;
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+        fprintf(stderr, "single_writer subscriber failed\n");
+        exit(-1);
+    }
+
+    /* with no one waiting, puts leave the mutex alone */
+    if( pthread_mutex_lock( &pub.shm->sync.mutex ) ) {
+        fprintf(stderr, "single_writer mutex lock failed\n");
+        exit(-1);
+    }
+    alarm(5);
+    r = ach_put( &pub, buf, sizeof(buf) );
+    alarm(0);
+    pthread_mutex_unlock( &pub.shm->sync.mutex );
+    test(r, "ach_put");
+
+    /* the writer takes its claim along when it resizes */
+    r = ach_resize( &pub, 16, 64 );
+    test(r, "ach_resize");
+    r = ach_put( &pub, buf, sizeof(buf) );
+    test(r, "ach_put");
+    if( ACH_EACCES != ach_put( &other, buf, sizeof(buf) ) ) {
+        fprintf(stderr, "resize dropped the writer's claim\n");
+        exit(-1);
+    }
+
+    /* closing frees the claim */
+    r = ach_close(&pub);
+    test(r, "ach_close");
+    r = ach_put( &other, buf, sizeof(buf) );
+    test(r, "ach_put");
+    r = ach_close(&other);
+    test(r, "ach_close");
+
+    /* a writer that dies between puts leaves the claim for another,
+     * but one that dies in a put leaves the channel corrupt */
+    int in_put;
+    for( in_put = 0; in_put < 2; in_put ++ ) {
+        pid = fork();
+        if( 0 == pid ) {
+            ach_channel_t c;
+            void *reserved;
+            if( ACH_OK != ach_open(&c, opt_channel_name, NULL) ||
+                ACH_OK != ach_put( &c, buf, sizeof(buf) ) ||
+                (in_put && ACH_OK != ach_put_reserve( &c, sizeof(buf), &reserved )) )
+            {
+                _exit(-1);
+            }
+            _exit(0);
+        }
+        waitpid( pid, &status, 0 );
+        if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+            fprintf(stderr, "single_writer child failed\n");
+            exit(-1);
+        }
+        r = ach_open(&pub, opt_channel_name, NULL);
+        test(r, "ach_open");
+        r = ach_put( &pub, buf, sizeof(buf) );
+        if( (in_put ? ACH_CORRUPT : ACH_OK) != r ) {
+            fprintf(stderr, "put after a dead writer: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+        r = ach_close(&pub);
+        test(r, "ach_close");
+    }
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "single_writer ok\n");
+    return 0;
+}
+
+/* Streaming copies give the same bytes as memcpy(), whatever the
+ * size and alignment, and across the end of the data array */
+int test_stream() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+    r = ach_create(opt_channel_name, 4ul, 4096ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_attr_t attr;
+    ach_attr_init( &attr );
+    attr.stream_min = 1;
+    ach_channel_t pub, sub;
+    r = ach_open(&pub, opt_channel_name, &attr);
+    test(r, "ach_open");
+    r = ach_open(&sub, opt_channel_name, &attr);
+    test(r, "ach_open");
+
+    static uint8_t src[5000], dst[5100];
+    size_t i, len;
+    for( i = 0; i < sizeof(src); i ++ ) src[i] = (uint8_t)(i * 7 + 3);
+    for( len = 1; len < sizeof(src); len += 61 ) {
+        size_t shift = len % 64, frame_size;
+        struct iovec iov[2] = { { src + shift, len / 3 },
+                                { src + shift + len / 3, len - len / 3 } };
+        r = ach_putv( &pub, iov, 2 );
+        test(r, "ach_putv");
+        memset( dst, 0, sizeof(dst) );
+        r = ach_get( &sub, dst + shift, len, &frame_size, NULL, 0 );
+        test(r, "ach_get");
+        if( len != frame_size || memcmp( dst + shift, src + shift, len ) ) {
+            fprintf(stderr, "stream copy of %"PRIuPTR" bytes differs\n", len);
+            exit(-1);
+        }
+    }
+
+    r = ach_close(&pub);
+    test(r, "ach_close");
+    r = ach_close(&sub);
+    test(r, "ach_close");
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "stream ok\n");
+    return 0;
+}
+
+/* Frames that wrap around the end of a mirrored data array stay
+ * contiguous */
+int test_trace() {
+    FILE *f = tmpfile();
+    if( NULL == f ) {
+        perror("tmpfile");
+        exit(-1);
+    }
+#ifdef ACH_TRACE
+    ach_trace_clear();
+    ach_status_t r = test_basic();
+    if( 0 != r ) return r;
+    r = ach_trace_dump( fileno(f) );
+    test(r, "ach_trace_dump");
+    char buf[64] = {0};
+    rewind(f);
+    if( NULL == fgets( buf, sizeof(buf), f ) ||
+        0 != strncmp( buf, "{\"displayTimeUnit\"", 18 ) )
+    {
+        fprintf(stderr, "bad trace dump: %s\n", buf);
+        exit(-1);
+    }
+#else
+    ach_status_t r = ach_trace_dump( fileno(f) );
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "trace dump without ACH_TRACE: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+#endif
+    fclose(f);
+    return 0;
+}
+
+int test_mirror() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    ach_create_attr_t attr = create_attr;
+    attr.mirror = 1;
+    attr.fixed_size = 1;
+    r = ach_create(opt_channel_name, 4ul, 1000ul, &attr );
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "mirror with fixed_size: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    attr.fixed_size = 0;
+    attr.layout = ACH_LAYOUT_1;
+    r = ach_create(opt_channel_name, 4ul, 1000ul, &attr );
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "mirror with layout 1: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    attr.layout = ACH_LAYOUT_2;
+    r = ach_create(opt_channel_name, 4ul, 1000ul, &attr );
+    test(r, "ach_create");
+
+    ach_channel_t pub, sub;
+    r = ach_open(&pub, opt_channel_name, NULL);
+    test(r, "ach_open");
+    r = ach_open(&sub, opt_channel_name, NULL);
+    test(r, "ach_open");
+    ach_header_t *shm = pub.shm;
+    if( !(shm->flags & ACH_HEADER_MIRROR) || shm->data_size % 4096 ) {
+        fprintf(stderr, "bad mirror header\n");
+        exit(-1);
+    }
+
+    static uint8_t out[3000], in[3000];
+    size_t i, j, wrapped = 0;
+    for( i = 0; i < 300; i ++ ) {
+        size_t len = 1 + (i * 397) % sizeof(out);
+        size_t frame_size;
+        for( j = 0; j < len; j ++ ) out[j] = (uint8_t)(i * 3 + j);
+        if( i % 3 ) {
+            struct iovec iov[2] = { { out, len / 2 }, { out + len / 2, len - len / 2 } };
+            r = ach_putv( &pub, iov, 2 );
+            test(r, "ach_putv");
+        } else {
+            void *buf;
+            r = ach_put_reserve( &pub, len, &buf );
+            test(r, "ach_put_reserve");
+            memcpy( buf, out, len );
+            r = ach_put_commit( &pub, len );
+            test(r, "ach_put_commit");
+        }
+
+        ach_view_t view;
+        r = ach_get_view( &sub, &view, NULL, ACH_O_LAST );
+        test(r, "ach_get_view");
+        if( (const uint8_t*)view.seg[0] + len > ACH_SHM_DATA(sub.shm) + sub.shm->data_size ) {
+            wrapped++;
+        }
+        if( view.frame_size != len || view.seg_size[0] != len || view.seg[1] ||
+            memcmp( view.seg[0], out, len ) )
+        {
+            fprintf(stderr, "mirror view got bad frame %"PRIuPTR"\n", i);
+            exit(-1);
+        }
+        r = ach_view_release( &sub, &view );
+        test(r, "ach_view_release");
+
+        memset( in, 0, len );
+        r = ach_get( &sub, in, sizeof(in), &frame_size, NULL, ACH_O_LAST | ACH_O_COPY );
+        test(r, "ach_get");
+        if( frame_size != len || memcmp( in, out, len ) ) {
+            fprintf(stderr, "mirror got bad frame %"PRIuPTR"\n", i);
+            exit(-1);
+        }
+    }
+    if( 0 == wrapped ) {
+        fprintf(stderr, "no mirror frame wrapped\n");
+        exit(-1);
+    }
+
+    /* the new channel keeps the layout */
+    r = ach_resize( &pub, 8, 2000 );
+    test(r, "ach_resize");
+    if( !(pub.shm->flags & ACH_HEADER_MIRROR) ) {
+        fprintf(stderr, "resize dropped the mirror\n");
+        exit(-1);
+    }
+
+    r = ach_close(&pub);
+    test(r, "ach_close");
+    r = ach_close(&sub);
+    test(r, "ach_close");
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "mirror ok\n");
+    return 0;
+}
+
+/* Handles claim slots in the reader table and publish their place */
+int test_readers() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+    ach_create_attr_t attr = create_attr;
+    attr.readers = 1;
+    r = ach_create(opt_channel_name, 8ul, 64ul, &attr );
+    test(r, "ach_create");
+
+    ach_attr_t open_attr;
+    ach_attr_init( &open_attr );
+    open_attr.no_reader = 1;
+    ach_channel_t pub, sub[2];
+    r = ach_open(&pub, opt_channel_name, &open_attr);
+    test(r, "ach_open");
+    int i;
+    for( i = 0; i < 2; i ++ ) {
+        r = ach_open(&sub[i], opt_channel_name, NULL);
+        test(r, "ach_open");
+    }
+    ach_reader_t *table = ACH_SHM_READERS(pub.shm);
+    if( SIZE_MAX != pub.reader || SIZE_MAX == sub[0].reader || SIZE_MAX == sub[1].reader ||
+        sub[0].reader == sub[1].reader ||
+        getpid() != ACH_OWNER_PID(table[sub[0].reader].owner) ||
+        ach_owner_dead(table[sub[0].reader].owner) )
+    {
+        fprintf(stderr, "readers did not claim slots\n");
+        exit(-1);
+    }
+
+    uint64_t j, buf[8];
+    size_t frame_size;
+    for( j = 1; j <= 5; j ++ ) {
+        r = ach_put( &pub, &j, sizeof(j) );
+        test(r, "ach_put");
+    }
+    r = ach_get( &sub[0], buf, sizeof(buf), &frame_size, NULL, ACH_O_LAST );
+    if( ACH_MISSED_FRAME != r ) test(r, "ach_get");
+    r = ach_get( &sub[1], buf, sizeof(buf), &frame_size, NULL, 0 );
+    test(r, "ach_get");
+    ach_reader_t *rd0 = &table[sub[0].reader], *rd1 = &table[sub[1].reader];
+    if( 5 != rd0->seq_num || 1 != rd0->got || 4 != rd0->missed ||
+        1 != rd1->seq_num || 1 != rd1->got || 0 != rd1->missed )
+    {
+        fprintf(stderr, "readers published the wrong place\n");
+        exit(-1);
+    }
+    r = ach_flush( &sub[1] );
+    test(r, "ach_flush");
+    if( 5 != rd1->seq_num ) {
+        fprintf(stderr, "flush not published\n");
+        exit(-1);
+    }
+
+    /* close frees the slot */
+    size_t slot = sub[0].reader;
+    r = ach_close(&sub[0]);
+    test(r, "ach_close");
+    if( 0 != table[slot].owner ) {
+        fprintf(stderr, "close kept its reader slot\n");
+        exit(-1);
+    }
+
+    /* a process that dies holding a slot leaves it for reuse */
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        ach_channel_t c;
+        _exit( ACH_OK == ach_open(&c, opt_channel_name, NULL) ? 0 : -1 );
+    }
+    int status;
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+        fprintf(stderr, "reader child failed\n");
+        exit(-1);
+    }
+    /* so does one whose pid was reused, here by us */
+    {
+        uint64_t self = table[sub[1].reader].owner;
+        if( 0 == (self >> 32) ) {
+            fprintf(stderr, "no start time in reader slot\n");
+            exit(-1);
+        }
+        for( slot = 0; 0 != table[slot].owner; slot++ );
+        table[slot].owner = self ^ ((uint64_t)1 << 32);
+        if( ! ach_owner_dead(table[slot].owner) ) {
+            fprintf(stderr, "reused pid taken for the reader\n");
+            exit(-1);
+        }
+    }
+    static ach_channel_t many[ACH_READERS_MAX];
+    size_t n_claimed = 0;
+    for( i = 0; i < ACH_READERS_MAX; i ++ ) {
+        r = ach_open(&many[i], opt_channel_name, NULL);
+        test(r, "ach_open");
+        if( SIZE_MAX != many[i].reader ) n_claimed++;
+    }
+    /* sub[1] kept its slot, and the dead child's and the reused pid's
+     * were taken over */
+    if( ACH_READERS_MAX - 1 != n_claimed || SIZE_MAX != many[ACH_READERS_MAX-1].reader ) {
+        fprintf(stderr, "claimed %"PRIuPTR" reader slots\n", n_claimed);
+        exit(-1);
+    }
+    for( i = 0; i < ACH_READERS_MAX; i ++ ) {
+        r = ach_close(&many[i]);
+        test(r, "ach_close");
+    }
+
+    r = ach_close(&sub[1]);
+    test(r, "ach_close");
+    r = ach_close(&pub);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "readers ok\n");
+    return 0;
+}
+
+/* Resize while a subscriber waits, then check that every handle
+ * follows and that frames keep their sequence numbers. */
+int test_resize() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+    r = ach_create(opt_channel_name, 4ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_channel_t pub, sub, waiter;
+    r = ach_open(&pub, opt_channel_name, NULL);
+    test(r, "ach_open");
+    r = ach_open(&sub, opt_channel_name, NULL);
+    test(r, "ach_open");
+    r = ach_open(&waiter, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    uint64_t i, buf[32];
+    size_t frame_size;
+    for( i = 1; i <= 6; i ++ ) {
+        r = ach_put( &pub, &i, sizeof(i) );
+        test(r, "ach_put");
+    }
+    r = ach_get( &sub, buf, sizeof(buf), &frame_size, NULL, ACH_O_LAST );
+    if( ACH_MISSED_FRAME != r || 6 != buf[0] ) {
+        fprintf(stderr, "resize: bad last frame: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    r = ach_flush( &waiter );
+    test(r, "ach_flush");
+
+    /* sleeps on the old channel through the resize */
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        struct timespec abstime;
+        clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+        abstime.tv_sec += 10;
+        r = ach_get( &waiter, buf, sizeof(buf), &frame_size, &abstime, ACH_O_WAIT );
+        exit( (ACH_OK == r && 7 == buf[0] && 7 == waiter.seq_num) ? 0 : -1 );
+    }
+    usleep(10000);
+
+    r = ach_resize( &pub, 8, 64 );
+    test(r, "ach_resize");
+    if( 8 != pub.shm->index_cnt || 1 != pub.shm->generation ) {
+        fprintf(stderr, "resize did not grow the channel\n");
+        exit(-1);
+    }
+
+    /* the four frames the old channel held */
+    for( i = 2; i <= 6; i ++ ) {
+        r = ach_get_seq( &pub, i, buf, sizeof(buf), &frame_size );
+        if( (2 == i) ? (ACH_MISSED_FRAME != r) : (ACH_OK != r || buf[0] != i) ) {
+            fprintf(stderr, "resize lost frame %"PRIu64": %s\n", i,
+                    ach_result_to_string(r));
+            exit(-1);
+        }
+    }
+
+    i = 7;
+    r = ach_put( &pub, &i, sizeof(i) );
+    test(r, "ach_put");
+
+    int status;
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+        fprintf(stderr, "resize waiter failed\n");
+        exit(-1);
+    }
+
+    /* the subscriber picks up where it left off */
+    r = ach_get( &sub, buf, sizeof(buf), &frame_size, NULL, 0 );
+    test(r, "ach_get");
+    if( 7 != buf[0] || 8 != sub.shm->index_cnt ) {
+        fprintf(stderr, "subscriber did not follow resize\n");
+        exit(-1);
+    }
+
+    /* shrink from another handle, keeping the two newest */
+    for( i = 8; i <= 12; i ++ ) {
+        r = ach_put( &pub, &i, sizeof(i) );
+        test(r, "ach_put");
+    }
+    r = ach_resize( &sub, 2, 64 );
+    test(r, "ach_resize");
+    i = 13;
+    r = ach_put( &pub, &i, sizeof(i) );
+    test(r, "ach_put");
+    if( 2 != pub.shm->generation ||
+        ACH_MISSED_FRAME != ach_get_seq( &pub, 11, buf, sizeof(buf), &frame_size ) ||
+        ACH_OK != ach_get_seq( &pub, 12, buf, sizeof(buf), &frame_size ) || 12 != buf[0] ||
+        ACH_OK != ach_get_seq( &pub, 13, buf, sizeof(buf), &frame_size ) || 13 != buf[0] )
+    {
+        fprintf(stderr, "shrink kept the wrong frames\n");
+        exit(-1);
+    }
+
+    /* refused when the newest frame would not fit */
+    memset( buf, 0, sizeof(buf) );
+    r = ach_put( &pub, buf, 100 );
+    test(r, "ach_put");
+    r = ach_resize( &pub, 1, 64 );
+    if( ACH_OVERFLOW != r ) {
+        fprintf(stderr, "resize dropped the newest frame: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+    r = ach_put( &pub, &i, sizeof(i) );
+    test(r, "ach_put");
+
+    /* a resize that fails leaves the old channel under its name; a
+     * directory in the way keeps the new one from being created */
+    if( !(pub.shm->flags & ACH_HEADER_HUGETLB) ) {
+        char tmp[256];
+        snprintf( tmp, sizeof(tmp), "%s%s.%s", ACH_SHM_DIR, ACH_CHAN_NAME_PREFIX,
+                  opt_channel_name );
+        if( mkdir( tmp, 0700 ) ) {
+            perror("mkdir");
+            exit(-1);
+        }
+        r = ach_resize( &pub, 16, 64 );
+        rmdir( tmp );
+        if( ACH_OK == r ) {
+            fprintf(stderr, "resize through a directory succeeded\n");
+            exit(-1);
+        }
+        ach_channel_t other;
+        r = ach_open( &other, opt_channel_name, NULL );
+        test(r, "ach_open");
+        r = ach_get( &other, buf, sizeof(buf), &frame_size, NULL, ACH_O_LAST );
+        if( ACH_MISSED_FRAME != r || 13 != buf[0] || 2 != other.shm->generation ) {
+            fprintf(stderr, "failed resize lost the channel: %s\n",
+                    ach_result_to_string(r));
+            exit(-1);
+        }
+        r = ach_close( &other );
+        test(r, "ach_close");
+    }
+
+    r = ach_close(&waiter);
+    test(r, "ach_close");
+    r = ach_close(&sub);
+    test(r, "ach_close");
+    r = ach_close(&pub);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "resize ok\n");
+    return 0;
+}
+
+int test_wait_policy() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+    r = ach_create(opt_channel_name, 4ul, 64ul, &create_attr );
+    test(r, "ach_create");
+
+    ach_attr_t attr;
+    ach_attr_init(&attr);
+    ach_channel_t chan;
+    attr.wait_policy = ACH_WAIT_POLL + 1;
+    r = ach_open(&chan, opt_channel_name, &attr);
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "opened with bad wait policy: %s\n", ach_result_to_string(r));
+        exit(-1);
+    }
+
+    int policy;
+    for( policy = ACH_WAIT_SPIN; policy <= ACH_WAIT_POLL; policy++ ) {
+        attr.wait_policy = policy;
+        attr.spin_ns = 1000;
+        r = ach_open(&chan, opt_channel_name, &attr);
+        test(r, "ach_open");
+        r = ach_flush(&chan);
+        test(r, "ach_flush");
+
+        char buf[8];
+        size_t frame_size;
+        struct timespec abstime;
+        clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+        abstime.tv_nsec += 10 * 1000 * 1000;
+        if( abstime.tv_nsec >= 1000000000 ) {
+            abstime.tv_sec++;
+            abstime.tv_nsec -= 1000000000;
+        }
+        r = ach_get( &chan, buf, sizeof(buf), &frame_size, &abstime, ACH_O_WAIT );
+        if( ACH_TIMEOUT != r ) {
+            fprintf(stderr, "wait policy %d did not time out: %s\n",
+                    policy, ach_result_to_string(r));
+            exit(-1);
+        }
+
+        pid_t pid = fork();
+        if( 0 == pid ) {
+            usleep(10000);
+            ach_channel_t c;
+            if( ACH_OK != ach_open(&c, opt_channel_name, NULL) ||
+                ACH_OK != ach_put(&c, "x", 1) )
+            {
+                exit(-1);
+            }
+            exit(0);
+        }
+
+        clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+        abstime.tv_sec += 10;
+        r = ach_get( &chan, buf, sizeof(buf), &frame_size, &abstime, ACH_O_WAIT );
+        test(r, "ach_get");
+        if( 1 != frame_size || 'x' != buf[0] ) {
+            fprintf(stderr, "wait policy %d got bad frame\n", policy);
+            exit(-1);
+        }
+
+        int status;
+        waitpid( pid, &status, 0 );
+        if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+            fprintf(stderr, "wait policy child failed\n");
+            exit(-1);
+        }
+        r = ach_close(&chan);
+        test(r, "ach_close");
+    }
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "wait_policy ok\n");
+    return 0;
+}
+
+/* Prefaulted, locked, transparent huge page mapping.  These options
+ * only change how the channel is mapped, so frames must go through
+ * as usual. */
+int test_mapping() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    ach_create_attr_t attr = create_attr;
+    attr.huge_pages = ACH_HUGE_TRANSPARENT;
+    attr.populate = 1;
+    attr.lock_memory = 1;
+    r = ach_create(opt_channel_name, 16ul, 4096ul, &attr );
     test(r, "ach_create");
 
+    /* without permission to mlock(), the open still succeeds */
     ach_channel_t chan;
-    int s, p;
-    size_t frame_size;
-    struct timespec ts;
-
-    /* open */
     r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+    const uint32_t want = ACH_HEADER_THP | ACH_HEADER_POPULATE | ACH_HEADER_MLOCK;
+    if( want != (chan.shm->flags & want) ) {
+        fprintf(stderr, "mapping flags not set\n");
+        exit(-1);
+    }
 
-    /* empty channel means stale */
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 ACH_O_LAST);
-    if( ACH_STALE_FRAMES != r ) {
-        printf("get stale failed: %s\n", ach_result_to_string(r));
+    uint8_t out[4096], in[4096];
+    size_t i, frame_size;
+    for( i = 0; i < 40; i ++ ) {
+        memset( out, (int)i, sizeof(out) );
+        r = ach_put( &chan, out, sizeof(out) );
+        test(r, "ach_put");
+        r = ach_get( &chan, in, sizeof(in), &frame_size, NULL, 0 );
+        test(r, "ach_get");
+        if( frame_size != sizeof(out) || memcmp(in, out, sizeof(out)) ) {
+            fprintf(stderr, "mapping bad frame %"PRIuPTR"\n", i);
+            exit(-1);
+        }
+    }
+
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    r = ach_unlink(opt_channel_name);
+    test(r, "ach_unlink");
+
+    fprintf(stderr, "mapping ok\n");
+    return 0;
+}
+
+/* Wait on several channels, one of which gets a frame from another
+ * process */
+int test_wait_any() {
+    enum { N_ANY = 3 };
+    char name[N_ANY][ACH_CHAN_NAME_MAX];
+    ach_channel_t chan[N_ANY];
+    ach_channel_t *chans[N_ANY];
+    ach_status_t r;
+    size_t i;
+    for( i = 0; i < N_ANY; i ++ ) {
+        snprintf( name[i], sizeof(name[i]), "%s-any-%"PRIuPTR, opt_channel_name, i );
+        r = ach_unlink(name[i]);
+        if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+            fprintf(stderr, "ach_unlink failed\n: %s",
+                    ach_result_to_string(r));
+            return -1;
+        }
+        r = ach_create(name[i], 4ul, 64ul, &create_attr );
+        test(r, "ach_create");
+        r = ach_open(&chan[i], name[i], NULL);
+        test(r, "ach_open");
+        chans[i] = &chan[i];
+    }
+
+    /* nothing there yet */
+    int ready[N_ANY];
+    struct timespec abstime;
+    clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+    abstime.tv_nsec += 10 * 1000 * 1000;
+    if( abstime.tv_nsec >= 1000000000 ) {
+        abstime.tv_sec++;
+        abstime.tv_nsec -= 1000000000;
+    }
+    r = ach_wait_any( chans, N_ANY, ready, &abstime );
+    if( ACH_TIMEOUT != r ) {
+        fprintf(stderr, "wait_any did not time out: %s\n", ach_result_to_string(r));
         exit(-1);
     }
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 0);
-    if( ACH_STALE_FRAMES != r ) {
-        printf("get stale failed: %s\n", ach_result_to_string(r));
+
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        usleep(10000);
+        ach_channel_t c;
+        if( ACH_OK != ach_open(&c, name[1], NULL) ||
+            ACH_OK != ach_put(&c, "x", 1) )
+        {
+            exit(-1);
+        }
+        exit(0);
+    }
+
+    clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+    abstime.tv_sec += 10;
+    r = ach_wait_any( chans, N_ANY, ready, &abstime );
+    test(r, "ach_wait_any");
+    if( ready[0] || !ready[1] || ready[2] ) {
+        fprintf(stderr, "wait_any woke for the wrong channel\n");
         exit(-1);
     }
 
+    int status;
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+        fprintf(stderr, "wait_any publisher failed\n");
+        exit(-1);
+    }
 
-    /* put */
-    p = 42;
-    r = ach_put( &chan, &p, sizeof(p) );
-    test(r, "ach_put");
+    /* one deadline cannot serve two clocks */
+    {
+        ach_create_attr_t attr = create_attr;
+        attr.set_clock = 1;
+        attr.clock = (CLOCK_REALTIME == ACH_DEFAULT_CLOCK) ? CLOCK_MONOTONIC : CLOCK_REALTIME;
+        r = ach_close(&chan[2]);
+        test(r, "ach_close");
+        r = ach_unlink(name[2]);
+        test(r, "ach_unlink");
+        r = ach_create(name[2], 4ul, 64ul, &attr );
+        test(r, "ach_create");
+        r = ach_open(&chan[2], name[2], NULL);
+        test(r, "ach_open");
+        r = ach_wait_any( chans, N_ANY, ready, &abstime );
+        if( ACH_EINVAL != r ) {
+            fprintf(stderr, "wait_any mixed clocks: %s\n", ach_result_to_string(r));
+            exit(-1);
+        }
+    }
 
-    /* get */
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 0);
-    test(r, "first ach_get");
-    if(frame_size!= sizeof(s) || s != 42 ) exit(-1);
+    for( i = 0; i < N_ANY; i ++ ) {
+        r = ach_close(&chan[i]);
+        test(r, "ach_close");
+        r = ach_unlink(name[i]);
+        test(r, "ach_unlink");
+    }
 
-    /* put 2 */
-    p = 43;
-    r = ach_put( &chan, &p, sizeof(p) );
-    test(r, "ach_put");
-    p = 44;
-    r = ach_put( &chan, &p, sizeof(p) );
-    test(r, "ach_put");
+    fprintf(stderr, "wait_any ok\n");
+    return 0;
+}
 
-    /* get last */
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 ACH_O_LAST);
-    if( ACH_MISSED_FRAME != r ) {
-        printf("get last failed: %s\n", ach_result_to_string(r));
+/* A memfd channel reached only through its descriptor */
+int test_memfd() {
+    ach_create_attr_t attr = create_attr;
+    attr.memfd = 1;
+    attr.map_anon = 1;
+    ach_status_t r = ach_create(opt_channel_name, 4ul, 64ul, &attr );
+    if( ACH_EINVAL != r ) {
+        fprintf(stderr, "memfd created in heap: %s\n", ach_result_to_string(r));
         exit(-1);
     }
-    if(frame_size != sizeof(s) || s != 44 ) exit(-1);
 
-    /* wait last */
-    p = 45;
-    r = ach_put( &chan, &p, sizeof(p) );
-    test(r, "ach_put");
-    clock_gettime(ACH_DEFAULT_CLOCK, &ts);
-    ts.tv_sec += 30; /* don't yield too long now */
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, &ts,
-                 ACH_O_LAST | ACH_O_WAIT );
-    if( ACH_OK != r ) {
-        printf("get wait failed: %s\n", ach_result_to_string(r));
+    attr.map_anon = 0;
+    r = ach_create(opt_channel_name, 4ul, 64ul, &attr );
+    test(r, "ach_create");
+
+    /* nothing in shm */
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    if( ACH_ENOENT != r ) {
+        fprintf(stderr, "memfd opened by name: %s\n", ach_result_to_string(r));
         exit(-1);
     }
-    if(frame_size != sizeof(s) || s != 45 ) exit(-1);
 
-    /* get last stale */
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 ACH_O_LAST);
-    if( ACH_STALE_FRAMES != r ) {
-        printf("get stale failed: %s\n", ach_result_to_string(r));
+    ach_attr_t oattr;
+    ach_attr_init(&oattr);
+    oattr.use_fd = 1;
+    oattr.fd = attr.fd;
+    r = ach_open(&chan, NULL, &oattr);
+    test(r, "ach_open");
+    close(attr.fd);
+
+    int sv[2];
+    if( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) ) {
+        perror("socketpair");
         exit(-1);
     }
 
-    /* timeout */
-    clock_gettime(ACH_DEFAULT_CLOCK, &ts);
-    ts.tv_sec -= 10;
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, &ts,
-                 ACH_O_LAST | ACH_O_WAIT );
-    if( ACH_TIMEOUT != r ) {
-        printf("get timeout failed: %s\n", ach_result_to_string(r));
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        ach_channel_t c;
+        close(sv[0]);
+        if( ACH_OK != ach_channel_recv(sv[1], &c, NULL) ||
+            ACH_OK != ach_put(&c, "memfd", 5) )
+        {
+            exit(-1);
+        }
+        exit(0);
+    }
+    close(sv[1]);
+
+    r = ach_channel_send(sv[0], &chan);
+    test(r, "ach_channel_send");
+
+    char buf[8];
+    size_t frame_size;
+    struct timespec abstime;
+    clock_gettime( ACH_DEFAULT_CLOCK, &abstime );
+    abstime.tv_sec += 10;
+    r = ach_get(&chan, buf, sizeof(buf), &frame_size, &abstime, ACH_O_WAIT);
+    test(r, "ach_get");
+    if( 5 != frame_size || memcmp(buf, "memfd", 5) ) {
+        fprintf(stderr, "memfd got bad frame\n");
         exit(-1);
     }
 
-    /* copy last */
-    printf("> copy start\n");
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 ACH_O_LAST | ACH_O_COPY);
-    printf("> copy done\n");
-    if( ACH_OK != r ) {
-        printf("copy_last failed: %s\n", ach_result_to_string(r));
+    int status;
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+        fprintf(stderr, "memfd child failed\n");
         exit(-1);
     }
-    if( p != s ) {
-        printf("wrong copy last : %d\n", s);
+
+    /* nothing to receive from a closed socket */
+    ach_channel_t c;
+    close(sv[0]);
+    if( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) ) {
+        perror("socketpair");
+        exit(-1);
+    }
+    close(sv[1]);
+    r = ach_channel_recv(sv[0], &c, NULL);
+    if( ACH_CLOSED != r ) {
+        fprintf(stderr, "memfd recv from closed socket: %s\n", ach_result_to_string(r));
         exit(-1);
     }
+    close(sv[0]);
 
-    /* get copy */
-    /*ach_dump(chan.shm);*/
-    /*printf("chan seq_num: %"PRIu64"\n", chan.seq_num);*/
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 ACH_O_COPY);
-    if( ACH_OK != r ) {
-        printf("copy_last failed: %s\n", ach_result_to_string(r));
+    r = ach_close(&chan);
+    test(r, "ach_close");
+
+    fprintf(stderr, "memfd ok\n");
+    return 0;
+}
+
+/* Wait for frames with poll() */
+int test_pollfd() {
+    ach_status_t r = ach_unlink(opt_channel_name);
+    if( ! (ACH_OK==r || ACH_ENOENT == r) ) {
+        fprintf(stderr, "ach_unlink failed\n: %s",
+                ach_result_to_string(r));
+        return -1;
+    }
+
+    ach_create_attr_t attr = create_attr;
+    attr.pollfd = 1;
+    r = ach_create(opt_channel_name, 4ul, 64ul, &attr );
+    test(r, "ach_create");
+
+    ach_channel_t chan;
+    r = ach_open(&chan, opt_channel_name, NULL);
+    test(r, "ach_open");
+
+    struct pollfd pfd;
+    r = ach_pollfd_open( &chan, &pfd.fd );
+    test(r, "ach_pollfd_open");
+    pfd.events = POLLIN;
+
+    if( 0 != poll( &pfd, 1, 0 ) ) {
+        fprintf(stderr, "pollfd readable before put\n");
         exit(-1);
     }
 
-    /* missed frames */
-    size_t i;
-    for( i = 0; i < 100; i ++ ) {
-        r = ach_put( &chan, &p, sizeof(p) );
-        test(r, "ach_put");
+    /* put from another process */
+    pid_t pid = fork();
+    if( 0 == pid ) {
+        usleep(10000);
+        ach_channel_t c;
+        if( ACH_OK != ach_open(&c, opt_channel_name, NULL) ||
+            ACH_OK != ach_put(&c, "x", 1) ||
+            ACH_OK != ach_put(&c, "y", 1) )
+        {
+            exit(-1);
+        }
+        exit(0);
     }
-    r = ach_get( &chan, &s, sizeof(s), &frame_size, NULL,
-                 ACH_O_LAST);
-    if( ACH_MISSED_FRAME != r ) {
-        printf("get missed failed: %s\n", ach_result_to_string(r));
+    int status;
+    if( 1 != poll( &pfd, 1, 10000 ) || !(pfd.revents & POLLIN) ) {
+        fprintf(stderr, "pollfd not readable after put\n");
+        exit(-1);
+    }
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ) {
+        fprintf(stderr, "pollfd publisher failed\n");
         exit(-1);
     }
 
-    /* close */
+    r = ach_pollfd_clear( pfd.fd );
+    test(r, "ach_pollfd_clear");
+    if( 0 != poll( &pfd, 1, 0 ) ) {
+        fprintf(stderr, "pollfd readable after clear\n");
+        exit(-1);
+    }
+
+    /* subscribers that exit without closing are dropped */
+    pid = fork();
+    if( 0 == pid ) {
+        int fd;
+        exit( ACH_OK == ach_pollfd_open(&chan, &fd) ? 0 : -1 );
+    }
+    waitpid( pid, &status, 0 );
+    if( !WIFEXITED(status) || 0 != WEXITSTATUS(status) ||
+        2 != ACH_SHM_POLLFD(chan.shm)->cnt )
+    {
+        fprintf(stderr, "pollfd second open failed\n");
+        exit(-1);
+    }
+    r = ach_put( &chan, "z", 1 );
+    test(r, "ach_put");
+    if( 1 != ACH_SHM_POLLFD(chan.shm)->cnt ) {
+        fprintf(stderr, "pollfd kept stale slot\n");
+        exit(-1);
+    }
+
+    r = ach_pollfd_close( &chan, pfd.fd );
+    test(r, "ach_pollfd_close");
+    if( 0 != ACH_SHM_POLLFD(chan.shm)->cnt ) {
+        fprintf(stderr, "pollfd close kept slot\n");
+        exit(-1);
+    }
 
     r = ach_close(&chan);
     test(r, "ach_close");
 
-    /* unlink */
     r = ach_unlink(opt_channel_name);
     test(r, "ach_unlink");
 
-    fprintf(stderr, "basic ok\n");
+    fprintf(stderr, "pollfd ok\n");
     return 0;
 }
 
-
 static int publisher( int32_t i ) {
     ach_channel_t chan;
     ach_status_t r = ach_open( &chan, opt_channel_name, NULL );
@@ -337,7 +2308,8 @@ int test_multi() {
         return -1;
     }
 
-    r = ach_create(opt_channel_name, 32ul, 64ul, NULL );
+    r = ach_create(opt_channel_name, 32ul, 64ul, &create_attr );
+    test(r, "ach_create");
 
 
     pid_t sub_pid[opt_n_sub];
@@ -348,7 +2320,7 @@ int test_multi() {
     for( i = 0; i < opt_n_sub; i++ ) {
         pid_t p = fork();
         if( p < 0 ) exit(-1);
-        else if( 0 == p ) return subscriber(i);
+        else if( 0 == p ) exit(subscriber(i));
         else sub_pid[i] = p;
 
     }
@@ -357,7 +2329,7 @@ int test_multi() {
     for( i = 0; i < opt_n_pub; i++ ) {
         pid_t p = fork();
         if( p < 0 ) exit(-1);
-        else if( 0 == p ) return publisher(i);
+        else if( 0 == p ) exit(publisher(i));
         else pub_pid[i] = p;
     }
 
@@ -415,12 +2387,135 @@ int main( int argc, char **argv ){
     {
         int r;
 
+        ach_create_attr_init(&create_attr);
+        create_attr.layout = ACH_LAYOUT_2;
+        r = test_basic();
+        if( 0 != r ) return r;
+
+        r = test_reserve();
+        if( 0 != r ) return r;
+
+        r = test_view();
+        if( 0 != r ) return r;
+
+        r = test_many();
+        if( 0 != r ) return r;
+
+        r = test_stats();
+        if( 0 != r ) return r;
+
+        r = test_fixed();
+        if( 0 != r ) return r;
+
+        r = test_seq();
+        if( 0 != r ) return r;
+
+        r = test_times();
+        if( 0 != r ) return r;
+
+        r = test_window();
+        if( 0 != r ) return r;
+
+        r = test_resize();
+        if( 0 != r ) return r;
+
+        r = test_readers();
+        if( 0 != r ) return r;
+
+        r = test_single_writer();
+        if( 0 != r ) return r;
+
+        r = test_stream();
+        if( 0 != r ) return r;
+
+        r = test_mirror();
+        if( 0 != r ) return r;
+
+        r = test_trace();
+        if( 0 != r ) return r;
+
+        r = test_mapping();
+        if( 0 != r ) return r;
+
+        r = test_wait_policy();
+        if( 0 != r ) return r;
+
+        r = test_multi();
+        if( 0 != r ) return r;
+
+        /* again, with the original layout */
+        create_attr.layout = ACH_LAYOUT_1;
+        r = test_basic();
+        if( 0 != r ) return r;
+
+        r = test_reserve();
+        if( 0 != r ) return r;
+
+        r = test_view();
+        if( 0 != r ) return r;
+
+        r = test_many();
+        if( 0 != r ) return r;
+
+        r = test_stats();
+        if( 0 != r ) return r;
+
+        r = test_fixed();
+        if( 0 != r ) return r;
+
+        r = test_seq();
+        if( 0 != r ) return r;
+
+        r = test_times();
+        if( 0 != r ) return r;
+
+        r = test_window();
+        if( 0 != r ) return r;
+
+        r = test_resize();
+        if( 0 != r ) return r;
+
+        r = test_readers();
+        if( 0 != r ) return r;
+
+        create_attr.layout = ACH_LAYOUT_DEFAULT;
+        r = test_basic();
+        if( 0 != r ) return r;
+        create_attr.layout = ACH_LAYOUT_2;
+
+#ifdef __linux__
+        r = test_wait_any();
+        if( 0 != r ) return r;
+
+        r = test_pollfd();
+        if( 0 != r ) return r;
+
+        r = test_memfd();
+        if( 0 != r ) return r;
+
+        r = test_multi_put();
+        if( 0 != r ) return r;
+
+        /* again, waiting on a futex */
+        create_attr.futex = 1;
         r = test_basic();
         if( 0 != r ) return r;
 
+        r = test_wait_any();
+        if( 0 != r ) return r;
+
         r = test_multi();
         if( 0 != r ) return r;
 
+        r = test_wait_policy();
+        if( 0 != r ) return r;
+
+        r = test_resize();
+        if( 0 != r ) return r;
+
+        r = test_single_writer();
+        if( 0 != r ) return r;
+#endif
     }
 
     {